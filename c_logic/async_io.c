@@ -0,0 +1,249 @@
+#include "async_io.h"
+#include <stdlib.h> // For malloc, free
+#include <string.h> // For memcpy
+#include <errno.h>  // Failures are reported on the caller's thread
+
+// --- The I/O thread ---
+
+static void* async_main(void* arg) {
+    AsyncFile* async = (AsyncFile*)arg;
+    pthread_mutex_lock(&async->lock);
+    for (;;) {
+        if (async->mode == ASYNC_READ && !async->end
+            && async->ready + async->caller_holds < ASYNC_IO_BUFFER_COUNT) {
+            // Fill the next free buffer; the caller only ever takes buffers already counted in ready
+            int slot = async->next_fill;
+            FILE* file = async->file;
+            async->busy = 1;
+            pthread_mutex_unlock(&async->lock);
+            size_t size = fread(async->buffers[slot], 1, ASYNC_IO_BUFFER_SIZE, file);
+            int failed = size < ASYNC_IO_BUFFER_SIZE && ferror(file) ? (errno != 0 ? errno : EIO) : 0;
+            pthread_mutex_lock(&async->lock);
+            async->busy = 0;
+            if (async->mode == ASYNC_READ) { // Otherwise the session was stopped meanwhile
+                async->sizes[slot] = size;
+                async->next_fill = (slot + 1) % ASYNC_IO_BUFFER_COUNT;
+                async->ready++;
+                if (size < ASYNC_IO_BUFFER_SIZE) {
+                    async->end = 1; // A short read is the last one, with or without an error
+                    async->error = failed;
+                }
+            }
+            pthread_cond_broadcast(&async->changed);
+        } else if (async->mode == ASYNC_WRITE && async->ready > 0) {
+            // Write the oldest queued buffer; it stays counted in ready until it is written
+            int slot = async->next_take;
+            int skip = async->error; // After a failed write the rest is dropped
+            async->busy = 1;
+            pthread_mutex_unlock(&async->lock);
+            int failed = 0;
+            if (!skip && fwrite(async->buffers[slot], 1, async->sizes[slot], async->file) != async->sizes[slot]) {
+                failed = errno != 0 ? errno : EIO;
+            }
+            pthread_mutex_lock(&async->lock);
+            async->busy = 0;
+            if (failed) async->error = failed;
+            async->next_take = (slot + 1) % ASYNC_IO_BUFFER_COUNT;
+            async->ready--;
+            pthread_cond_broadcast(&async->changed);
+        } else if (async->shutting_down) {
+            break;
+        } else {
+            pthread_cond_wait(&async->changed, &async->lock);
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+AsyncFile* create_async_file(void) {
+    AsyncFile* async = (AsyncFile*)calloc(1, sizeof(AsyncFile));
+    if (async == NULL) {
+        return NULL;
+    }
+    int failed = 0;
+    for (int i = 0; i < ASYNC_IO_BUFFER_COUNT; i++) {
+        async->buffers[i] = (unsigned char*)malloc(ASYNC_IO_BUFFER_SIZE);
+        failed |= async->buffers[i] == NULL;
+    }
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->changed, NULL);
+    if (failed || pthread_create(&async->thread, NULL, async_main, async) != 0) {
+        pthread_cond_destroy(&async->changed);
+        pthread_mutex_destroy(&async->lock);
+        for (int i = 0; i < ASYNC_IO_BUFFER_COUNT; i++) {
+            free(async->buffers[i]);
+        }
+        free(async);
+        return NULL;
+    }
+    return async;
+}
+
+void free_async_file(AsyncFile* async) {
+    if (async == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&async->lock);
+    async->mode = ASYNC_IDLE;
+    async->shutting_down = 1;
+    pthread_cond_broadcast(&async->changed);
+    pthread_mutex_unlock(&async->lock);
+    pthread_join(async->thread, NULL);
+
+    pthread_cond_destroy(&async->changed);
+    pthread_mutex_destroy(&async->lock);
+    for (int i = 0; i < ASYNC_IO_BUFFER_COUNT; i++) {
+        free(async->buffers[i]);
+    }
+    free(async);
+}
+
+// --- Sessions ---
+
+void async_start(AsyncFile* async, FILE* file, AsyncFileMode mode) {
+    pthread_mutex_lock(&async->lock);
+    while (async->busy) { // A read the last session stopped in the middle of
+        pthread_cond_wait(&async->changed, &async->lock);
+    }
+    async->file = file;
+    async->mode = mode;
+    async->next_fill = 0;
+    async->next_take = 0;
+    async->ready = 0;
+    async->caller_holds = 0;
+    async->end = 0;
+    async->error = 0;
+    pthread_cond_broadcast(&async->changed);
+    pthread_mutex_unlock(&async->lock);
+
+    async->current = NULL;
+    async->current_size = 0;
+    async->current_pos = 0;
+    async->filling = NULL;
+    async->filling_pos = 0;
+}
+
+int async_stop(AsyncFile* async) {
+    if (async->mode == ASYNC_WRITE) {
+        async_flush(async);
+    }
+    pthread_mutex_lock(&async->lock);
+    int error = async->error;
+    async->mode = ASYNC_IDLE; // A read in progress finishes on its own and is dropped
+    async->file = NULL;
+    pthread_mutex_unlock(&async->lock);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+// --- Reading ---
+
+const unsigned char* async_next(AsyncFile* async, size_t* size) {
+    pthread_mutex_lock(&async->lock);
+    if (async->caller_holds) {
+        async->caller_holds = 0; // The thread may refill the previous buffer now
+        pthread_cond_broadcast(&async->changed);
+    }
+    while (async->ready == 0 && !async->end) {
+        pthread_cond_wait(&async->changed, &async->lock);
+    }
+    if (async->ready == 0) {
+        pthread_mutex_unlock(&async->lock);
+        *size = 0;
+        return NULL;
+    }
+    int slot = async->next_take;
+    async->next_take = (slot + 1) % ASYNC_IO_BUFFER_COUNT;
+    async->ready--;
+    async->caller_holds = 1;
+    pthread_mutex_unlock(&async->lock);
+    *size = async->sizes[slot];
+    return async->buffers[slot];
+}
+
+size_t async_read(AsyncFile* async, void* out, size_t n) {
+    unsigned char* dst = (unsigned char*)out;
+    size_t done = 0;
+    while (done < n) {
+        if (async->current_pos == async->current_size) {
+            async->current = async_next(async, &async->current_size);
+            async->current_pos = 0;
+            if (async->current_size == 0) {
+                break;
+            }
+        }
+        size_t chunk = async->current_size - async->current_pos;
+        if (chunk > n - done) chunk = n - done;
+        memcpy(dst + done, async->current + async->current_pos, chunk);
+        async->current_pos += chunk;
+        done += chunk;
+    }
+    return done;
+}
+
+// --- Writing ---
+
+// Hands the buffer being filled to the thread. Returns 0, or -1 once a write has failed.
+static int submit_filling(AsyncFile* async) {
+    pthread_mutex_lock(&async->lock);
+    async->sizes[async->next_fill] = async->filling_pos;
+    async->next_fill = (async->next_fill + 1) % ASYNC_IO_BUFFER_COUNT;
+    async->ready++;
+    int error = async->error;
+    pthread_cond_broadcast(&async->changed);
+    pthread_mutex_unlock(&async->lock);
+    async->filling = NULL;
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+int async_write(AsyncFile* async, const void* data, size_t n) {
+    const unsigned char* src = (const unsigned char*)data;
+    int status = 0;
+    while (n > 0) {
+        if (async->filling == NULL) {
+            // next_fill only moves on the caller's side, so it is the buffer to fill once one is free
+            pthread_mutex_lock(&async->lock);
+            while (async->ready == ASYNC_IO_BUFFER_COUNT) {
+                pthread_cond_wait(&async->changed, &async->lock);
+            }
+            pthread_mutex_unlock(&async->lock);
+            async->filling = async->buffers[async->next_fill];
+            async->filling_pos = 0;
+        }
+        size_t chunk = ASYNC_IO_BUFFER_SIZE - async->filling_pos;
+        if (chunk > n) chunk = n;
+        memcpy(async->filling + async->filling_pos, src, chunk);
+        async->filling_pos += chunk;
+        src += chunk;
+        n -= chunk;
+        if (async->filling_pos == ASYNC_IO_BUFFER_SIZE && submit_filling(async) != 0) {
+            status = -1;
+        }
+    }
+    return status;
+}
+
+int async_flush(AsyncFile* async) {
+    if (async->filling != NULL && async->filling_pos > 0) {
+        submit_filling(async);
+    }
+    pthread_mutex_lock(&async->lock);
+    while (async->ready > 0) {
+        pthread_cond_wait(&async->changed, &async->lock);
+    }
+    int error = async->error;
+    pthread_mutex_unlock(&async->lock);
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
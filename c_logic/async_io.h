@@ -0,0 +1,72 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+// Ring of ASYNC_IO_BUFFER_COUNT buffers of ASYNC_IO_BUFFER_SIZE bytes per direction: one the
+// caller works on, one the I/O thread works on, and the rest absorb uneven speeds on either side
+#define ASYNC_IO_BUFFER_SIZE (256 * 1024)
+#define ASYNC_IO_BUFFER_COUNT 4
+
+typedef enum AsyncFileMode {
+    ASYNC_IDLE = 0,
+    ASYNC_READ,     // The thread reads the file ahead of the caller
+    ASYNC_WRITE     // The thread writes what the caller hands it, behind the caller
+} AsyncFileMode;
+
+// A FILE read ahead or written behind by a thread of its own, so waiting on a disk, NFS or
+// a pipe overlaps with coding on the calling thread: a run takes about as long as the slower
+// of the two instead of their sum. The thread is started once and serves one FILE at a time;
+// only the calling thread and the I/O thread may touch the FILE between start and stop.
+typedef struct AsyncFile {
+    unsigned char* buffers[ASYNC_IO_BUFFER_COUNT];
+    size_t sizes[ASYNC_IO_BUFFER_COUNT];   // Bytes held by each buffer
+
+    pthread_mutex_t lock;           // Protects the fields below
+    pthread_cond_t changed;
+    pthread_t thread;
+    FILE* file;
+    AsyncFileMode mode;
+    int next_fill;                  // Next buffer to fill (by the thread when reading, the caller when writing)
+    int next_take;                  // Next buffer to empty (by the caller when reading, the thread when writing)
+    int ready;                      // Buffers filled and not yet taken
+    int caller_holds;               // Reading: the caller still uses the buffer it took last
+    int busy;                       // The thread is inside fread/fwrite
+    int end;                        // Reading: the last buffer is in the ring (end of file or error)
+    int error;                      // errno of a read or write that failed, 0 if none did
+    int shutting_down;
+
+    // The caller's side, only touched by the calling thread
+    const unsigned char* current;   // Reading: the buffer being consumed
+    size_t current_size;
+    size_t current_pos;
+    unsigned char* filling;         // Writing: the buffer being filled, NULL until the first write
+    size_t filling_pos;
+} AsyncFile;
+
+// Starts the I/O thread, idle until async_start. Returns NULL if the buffers or the thread
+// can't be had; the caller then reads and writes the FILE itself.
+AsyncFile* create_async_file(void);
+// Stops the thread (a read in progress is waited for) and frees the buffers
+void free_async_file(AsyncFile* async);
+
+// Starts reading file ahead, or writing to it behind the caller
+void async_start(AsyncFile* async, FILE* file, AsyncFileMode mode);
+// Ends the session. Reading: whatever was read ahead is dropped. Writing: everything is
+// written first. Returns 0, or -1 with errno set if a read or write of the session failed.
+int async_stop(AsyncFile* async);
+
+// Returns the next buffer read from the file, with its size in *size (0 at end of file or on
+// error), and gives the previous one back to the thread. The bytes stay valid until the next call.
+const unsigned char* async_next(AsyncFile* async, size_t* size);
+// Reads up to n bytes into out, like fread: fewer only at end of file or on error
+size_t async_read(AsyncFile* async, void* out, size_t n);
+
+// Queues data[0..n) to be written, like fwrite; it is copied, so data can be reused at once.
+// Returns 0, or -1 with errno set once a write has failed.
+int async_write(AsyncFile* async, const void* data, size_t n);
+// Waits until everything queued so far is written (not fflush'ed). Returns 0 or -1 as async_write.
+int async_flush(AsyncFile* async);
+
+#endif // ASYNC_IO_H
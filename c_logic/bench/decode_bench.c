@@ -0,0 +1,234 @@
+// decode_bench.c
+// Measures the decoder in MB/s of output: one character per table lookup against the
+// multi-symbol table, which emits every whole code in the next table_bits bits at once.
+// Both runs decode the same bitstream with the same code table through decode_bitstream; the
+// single-symbol run has the table's multi_symbol flag cleared, so it takes the decoder's
+// checked one-character-per-lookup loop (the only loop before the multi-symbol table).
+// The inputs are generated English-like text and generated log lines, plus any files given.
+//
+// Build from the c_logic directory, after building libhuffman.a:
+//   gcc -O2 bench/decode_bench.c libhuffman.a -pthread -o decode_bench
+// Usage: decode_bench [size_mib] [repeats] [file...]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../decoder.h"
+#include "../encoder.h"
+#include "../histogram.h"
+#include "../huffman_node.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Appends text to data[*pos..size), cutting it off at the end of the buffer
+static void append(unsigned char* data, size_t size, size_t* pos, const char* text) {
+    while (*text != '\0' && *pos < size) {
+        data[(*pos)++] = (unsigned char)*text++;
+    }
+}
+
+// Sentences of common English words, the frequent ones picked far more often (roughly Zipf)
+static void fill_english(unsigned char* data, size_t size) {
+    static const char* words[] = {
+        "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "he", "for", "on", "are",
+        "with", "as", "his", "they", "be", "at", "one", "have", "this", "from", "or", "had", "by",
+        "word", "but", "what", "some", "we", "can", "out", "other", "were", "all", "there", "when",
+        "up", "use", "your", "how", "said", "an", "each", "she", "which", "do", "their", "time",
+        "if", "will", "way", "about", "many", "then", "them", "write", "would", "like", "so",
+        "these", "her", "long", "make", "thing", "see", "him", "two", "has", "look", "more", "day",
+        "could", "go", "come", "did", "number", "sound", "no", "most", "people", "my", "over",
+        "know", "water", "than", "call", "first", "who", "may", "down", "side", "been", "now",
+        "find", "any", "new", "work", "part", "take", "get", "place", "made", "live", "where",
+        "after", "back", "little", "only", "round", "man", "year", "came", "show", "every", "good",
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    size_t pos = 0, line = 0;
+    int sentence_start = 1;
+    while (pos < size) {
+        // The smaller of two uniform picks favours the front of the list
+        size_t a = (size_t)(next_random(&state) % word_count), b = (size_t)(next_random(&state) % word_count);
+        char word[16];
+        strcpy(word, words[a < b ? a : b]);
+        if (sentence_start) word[0] = (char)(word[0] - 'a' + 'A');
+        append(data, size, &pos, word);
+        line += strlen(word);
+
+        uint64_t r = next_random(&state) % 16;
+        sentence_start = r == 0;
+        const char* separator = r == 0 ? ". " : r == 1 ? ", " : " ";
+        if (line > 70) {
+            separator = r == 0 ? ".\n" : r == 1 ? ",\n" : "\n";
+            line = 0;
+        }
+        append(data, size, &pos, separator);
+        line += strlen(separator);
+    }
+}
+
+// Application log lines: timestamps, levels, components, key=value fields with numbers and ids
+static void fill_log(unsigned char* data, size_t size) {
+    static const char* levels[] = {"INFO", "INFO", "INFO", "INFO", "DEBUG", "DEBUG", "WARN", "ERROR"};
+    static const char* components[] = {"http", "db.pool", "auth", "cache", "scheduler", "worker"};
+    static const char* messages[] = {
+        "request completed", "query executed", "token refreshed", "cache miss", "job started",
+        "job finished", "connection reset by peer", "retrying request",
+    };
+    static const char* paths[] = {"/api/v1/items", "/api/v1/users", "/health", "/api/v2/orders", "/login"};
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    unsigned long long millis = 0;
+    size_t pos = 0;
+    while (pos < size) {
+        millis += next_random(&state) % 250;
+        unsigned long long seconds = millis / 1000;
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "2024-05-%02llu %02llu:%02llu:%02llu.%03llu %s [%s] %s id=%08llx path=%s status=%d latency_ms=%llu\n",
+                 1 + seconds / 86400 % 28, seconds / 3600 % 24, seconds / 60 % 60, seconds % 60, millis % 1000,
+                 levels[next_random(&state) % 8], components[next_random(&state) % 6],
+                 messages[next_random(&state) % 8], (unsigned long long)(next_random(&state) & 0xFFFFFFFFu),
+                 paths[next_random(&state) % 5], next_random(&state) % 10 == 0 ? 404 : 200,
+                 (unsigned long long)(next_random(&state) % 500));
+        append(data, size, &pos, line);
+    }
+}
+
+// Best of 'repeats' decodes of the bitstream, in MB/s of output; -1 if the output was wrong
+static double measure(const unsigned char* bits, unsigned long long bit_count, const DecodeTable* table,
+                      const unsigned char* expected, unsigned char* out, size_t size, int repeats) {
+    double best = 0.0;
+    for (int r = 0; r < repeats; r++) {
+        memset(out, 0, size);
+        double start = now_seconds();
+        int status = decode_bitstream(bits, bit_count, table, out, size);
+        double elapsed = now_seconds() - start;
+        if (status != 0 || memcmp(out, expected, size) != 0) {
+            return -1.0;
+        }
+        double rate = (double)size / elapsed / 1e6;
+        if (rate > best) best = rate;
+    }
+    return best;
+}
+
+// Codes data with one table (as one single-table block would) and decodes it both ways.
+// Returns 0, or -1 if the input can't be coded or doesn't decode back to itself.
+static int bench_input(const char* name, const unsigned char* data, size_t size, int repeats) {
+    uint64_t frequencies[HUFFMAN_ALPHABET_SIZE] = {0};
+    count_bytes(data, size, frequencies);
+    HuffmanTree tree;
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    if (build_huffman_tree(frequencies, &tree) != 0
+        || build_huffman_codes(&tree, DEFAULT_MAX_CODE_LENGTH, codes, NULL) != 0) {
+        fprintf(stderr, "%s: needs at least one byte of input\n", name);
+        return -1;
+    }
+
+    EncodedSlice slice = {0, encoded_bit_count(frequencies, codes), 0, 0};
+    size_t bytes = (size_t)((slice.bit_count + 7) / 8);
+    unsigned char* bits = (unsigned char*)calloc(bytes + 1, 1);
+    unsigned char* out = (unsigned char*)malloc(size);
+    if (bits == NULL || out == NULL) {
+        perror("Failed to allocate benchmark buffers");
+        exit(EXIT_FAILURE);
+    }
+    encode_slice(data, size, codes, bits, &slice);
+    merge_slice_edges(bits, &slice, 1);
+
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    for (int c = 0; c < HUFFMAN_ALPHABET_SIZE; c++) {
+        lengths[c] = codes[c].length;
+    }
+    DecodeTable* table = build_decode_table(lengths);
+    int status = 0;
+    if (!table->multi_symbol) {
+        fprintf(stderr, "%s: codes longer than the table, no multi-symbol table\n", name);
+        status = -1;
+    } else {
+        double multi = measure(bits, slice.bit_count, table, data, out, size, repeats);
+        table->multi_symbol = 0;
+        double single = measure(bits, slice.bit_count, table, data, out, size, repeats);
+        if (multi < 0 || single < 0) {
+            fprintf(stderr, "%s: decoded output differs from the input\n", name);
+            status = -1;
+        } else {
+            printf("%-16s %9.2f %12.1f %12.1f %8.2fx\n", name, (double)slice.bit_count / (double)size,
+                   single, multi, multi / single);
+        }
+    }
+
+    free_decode_table(table);
+    free(out);
+    free(bits);
+    return status;
+}
+
+int main(int argc, char* argv[]) {
+    size_t size_mib = argc > 1 ? (size_t)atol(argv[1]) : 64;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    if (size_mib == 0 || repeats < 1) {
+        fprintf(stderr, "Usage: %s [size_mib] [repeats] [file...]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size = size_mib << 20;
+    unsigned char* data = (unsigned char*)malloc(size);
+    if (data == NULL) {
+        perror("Failed to allocate benchmark buffer");
+        return 1;
+    }
+
+    struct {
+        const char* name;
+        void (*fill)(unsigned char* data, size_t size);
+    } inputs[] = {
+        {"english text", fill_english},
+        {"log lines", fill_log},
+    };
+
+    int status = 0;
+    printf("Decoding %zu MiB, best of %d runs\n", size_mib, repeats);
+    printf("%-16s %9s %12s %12s %9s\n", "input", "bits/char", "single MB/s", "multi MB/s", "speedup");
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        inputs[i].fill(data, size);
+        if (bench_input(inputs[i].name, data, size, repeats) != 0) status = 1;
+    }
+    free(data);
+
+    // Files are benchmarked whole, at their own size
+    for (int i = 3; i < argc; i++) {
+        FILE* file = fopen(argv[i], "rb");
+        if (file == NULL) {
+            perror(argv[i]);
+            status = 1;
+            continue;
+        }
+        fseek(file, 0, SEEK_END);
+        long file_size = ftell(file);
+        rewind(file);
+        unsigned char* contents = file_size > 0 ? (unsigned char*)malloc((size_t)file_size) : NULL;
+        if (contents != NULL && fread(contents, 1, (size_t)file_size, file) == (size_t)file_size) {
+            const char* name = strrchr(argv[i], '/') != NULL ? strrchr(argv[i], '/') + 1 : argv[i];
+            if (bench_input(name, contents, (size_t)file_size, repeats) != 0) status = 1;
+        } else {
+            fprintf(stderr, "%s: could not read the file\n", argv[i]);
+            status = 1;
+        }
+        free(contents);
+        fclose(file);
+    }
+    return status;
+}
@@ -0,0 +1,107 @@
+// histogram_bench.c
+// Measures the frequency counting pass in GB/s: the old one-table byte loop against the
+// interleaved-table kernel in histogram.c, on text, random bytes and a run of one byte
+// (the worst case for a single table, every increment hits the same counter).
+//
+// Build from the c_logic directory:
+//   gcc -O2 bench/histogram_bench.c histogram.c -o histogram_bench
+// Usage: histogram_bench [size_mib] [repeats]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../histogram.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// The loop the compressor used before: one table, one increment per byte
+static void count_bytes_simple(const unsigned char* data, size_t size, uint64_t counts[256]) {
+    for (size_t i = 0; i < size; i++) {
+        counts[data[i]]++;
+    }
+}
+
+typedef void (*CountFunction)(const unsigned char* data, size_t size, uint64_t counts[256]);
+
+// Best of 'repeats' runs, in GB/s. The checksum keeps the compiler from dropping the work.
+static double measure(CountFunction count, const unsigned char* data, size_t size, int repeats, uint64_t* checksum) {
+    double best = 0.0;
+    for (int r = 0; r < repeats; r++) {
+        uint64_t counts[256] = {0};
+        double start = now_seconds();
+        count(data, size, counts);
+        double elapsed = now_seconds() - start;
+        for (int c = 0; c < 256; c++) {
+            *checksum += counts[c] * (uint64_t)(c + 1);
+        }
+        double rate = (double)size / elapsed / 1e9;
+        if (rate > best) best = rate;
+    }
+    return best;
+}
+
+static void fill_text(unsigned char* data, size_t size) {
+    static const char words[] = "the quick brown fox jumps over the lazy dog and keeps on running\n";
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (unsigned char)words[i % (sizeof(words) - 1)];
+    }
+}
+
+static void fill_random(unsigned char* data, size_t size) {
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < size; i++) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[i] = (unsigned char)state;
+    }
+}
+
+static void fill_run(unsigned char* data, size_t size) {
+    memset(data, 'a', size);
+}
+
+int main(int argc, char* argv[]) {
+    size_t size_mib = argc > 1 ? (size_t)atol(argv[1]) : 256;
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    if (size_mib == 0 || repeats < 1) {
+        fprintf(stderr, "Usage: %s [size_mib] [repeats]\n", argv[0]);
+        return 1;
+    }
+
+    size_t size = size_mib << 20;
+    unsigned char* data = (unsigned char*)malloc(size);
+    if (data == NULL) {
+        perror("Failed to allocate benchmark buffer");
+        return 1;
+    }
+
+    struct {
+        const char* name;
+        void (*fill)(unsigned char* data, size_t size);
+    } inputs[] = {
+        {"text", fill_text},
+        {"random", fill_random},
+        {"single byte run", fill_run},
+    };
+
+    uint64_t checksum = 0;
+    printf("Histogram of %zu MiB, best of %d runs\n", size_mib, repeats);
+    printf("%-16s %12s %12s %9s\n", "input", "simple GB/s", "kernel GB/s", "speedup");
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+        inputs[i].fill(data, size);
+        double simple = measure(count_bytes_simple, data, size, repeats, &checksum);
+        double kernel = measure(count_bytes, data, size, repeats, &checksum);
+        printf("%-16s %12.2f %12.2f %8.2fx\n", inputs[i].name, simple, kernel, kernel / simple);
+    }
+    printf("(checksum %llu)\n", (unsigned long long)checksum);
+
+    free(data);
+    return 0;
+}
@@ -0,0 +1,551 @@
+// stage_bench.c
+// Times every stage of compression and decompression separately, on reproducible generated
+// corpora, and writes the results as JSON so runs can be kept and compared:
+//   histogram     count_bytes over the input
+//   tree          build_huffman_tree from the counts
+//   codes         build_huffman_codes (code lengths, length limit, canonical codes)
+//   encode        the bit-packing loop (encode_slice), codes already built
+//   header_parse  reading a block's code length table and building its decode table
+//   decode        decode_bitstream with the decode table already built
+//   compress      huffman_compress, the whole library call (all of the above plus framing)
+//   decompress    huffman_decompress, the whole library call
+// Each stage reports the best of 'repeats' timings as MB/s of input and cycles per byte.
+// The tree, codes and header_parse stages don't depend on the input size; they are repeated
+// until a timing covers at least a millisecond and reported per call, and their MB/s is the
+// throughput they would allow at this block size. Cycles are TSC reference cycles on x86 (the
+// constant-rate counter, not the core clock) and null elsewhere. peak_rss_kib is the
+// process's peak resident memory after the stage, so it only grows through a run.
+//
+// With --compare, the results are also checked against a JSON file of an earlier run: every
+// stage whose MB/s fell by more than the threshold is listed, and the exit status is 2.
+//
+// Build from the c_logic directory, after building libhuffman.a:
+//   gcc -O2 bench/stage_bench.c libhuffman.a -pthread -lm -o stage_bench
+// Usage: stage_bench [-s kib,kib,...] [-c corpus,...] [-r repeats] [-o results.json]
+//                    [--compare baseline.json] [--threshold percent]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h> // For getrusage
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>    // For __rdtsc
+#define HAVE_CYCLE_COUNTER 1
+#else
+#define HAVE_CYCLE_COUNTER 0
+#endif
+
+#include "../huffman.h"
+#include "../decoder.h"
+#include "../encoder.h"
+#include "../histogram.h"
+#include "../huffman_node.h"
+#include "../canonical_codes.h"
+
+#define DEFAULT_SIZES "1,64,1024,16384"
+#define MAX_SIZES 32
+#define MAX_RESULTS 4096
+#define MIN_TIMING 1e-3 // Seconds a timing of the per-call stages must cover
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t now_cycles(void) {
+#if HAVE_CYCLE_COUNTER
+    return (uint64_t)__rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static long peak_rss_kib(void) {
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1; // KiB on Linux
+}
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// --- Corpora: every generator has a fixed seed, so a size always gives the same bytes ---
+
+static void append(unsigned char* data, size_t size, size_t* pos, const char* text) {
+    while (*text != '\0' && *pos < size) {
+        data[(*pos)++] = (unsigned char)*text++;
+    }
+}
+
+// Geometric byte distribution: byte k about twice as likely as byte k + 1
+static void fill_skewed(unsigned char* data, size_t size) {
+    uint64_t state = 0x853C49E6748FEA9Bull;
+    for (size_t i = 0; i < size; i++) {
+        uint64_t r = next_random(&state);
+        int k = 0;
+        while ((r & 1) && k < 255) {
+            r >>= 1;
+            k++;
+            if (r == 0) r = next_random(&state);
+        }
+        data[i] = (unsigned char)k;
+    }
+}
+
+// Every byte value equally likely: the raw-block case
+static void fill_uniform(unsigned char* data, size_t size) {
+    uint64_t state = 0x9E3779B97F4A7C15ull;
+    for (size_t i = 0; i < size; i++) {
+        data[i] = (unsigned char)(next_random(&state) >> 56);
+    }
+}
+
+// Sentences of common English words, the frequent ones picked far more often
+static void fill_english(unsigned char* data, size_t size) {
+    static const char* words[] = {
+        "the", "of", "and", "to", "a", "in", "is", "it", "that", "was", "he", "for", "on", "are",
+        "with", "as", "his", "they", "be", "at", "one", "have", "this", "from", "or", "had", "by",
+        "word", "but", "what", "some", "we", "can", "out", "other", "were", "all", "there", "when",
+        "up", "use", "your", "how", "said", "an", "each", "she", "which", "do", "their", "time",
+        "if", "will", "way", "about", "many", "then", "them", "write", "would", "like", "so",
+        "these", "her", "long", "make", "thing", "see", "him", "two", "has", "look", "more", "day",
+        "could", "go", "come", "did", "number", "sound", "no", "most", "people", "my", "over",
+        "know", "water", "than", "call", "first", "who", "may", "down", "side", "been", "now",
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    uint64_t state = 0x2545F4914F6CDD1Dull;
+    size_t pos = 0, line = 0;
+    int sentence_start = 1;
+    while (pos < size) {
+        size_t a = (size_t)(next_random(&state) % word_count), b = (size_t)(next_random(&state) % word_count);
+        char word[16];
+        strcpy(word, words[a < b ? a : b]);
+        if (sentence_start) word[0] = (char)(word[0] - 'a' + 'A');
+        append(data, size, &pos, word);
+        line += strlen(word);
+        uint64_t r = next_random(&state) % 16;
+        sentence_start = r == 0;
+        const char* separator = r == 0 ? ". " : r == 1 ? ", " : " ";
+        if (line > 70) {
+            separator = r == 0 ? ".\n" : r == 1 ? ",\n" : "\n";
+            line = 0;
+        }
+        append(data, size, &pos, separator);
+        line += strlen(separator);
+    }
+}
+
+// One JSON object per line, as structured application logs are written
+static void fill_json(unsigned char* data, size_t size) {
+    static const char* levels[] = {"info", "info", "info", "debug", "warn", "error"};
+    static const char* events[] = {"request.done", "db.query", "cache.miss", "auth.refresh", "job.retry"};
+    uint64_t state = 0xDA3E39CB94B95BDBull;
+    unsigned long long millis = 1700000000000ull;
+    size_t pos = 0;
+    while (pos < size) {
+        millis += next_random(&state) % 250;
+        char line[256];
+        snprintf(line, sizeof(line),
+                 "{\"ts\":%llu,\"level\":\"%s\",\"event\":\"%s\",\"trace\":\"%016llx\",\"user\":%llu,\"ms\":%llu}\n",
+                 millis, levels[next_random(&state) % 6], events[next_random(&state) % 5],
+                 (unsigned long long)next_random(&state), (unsigned long long)(next_random(&state) % 100000),
+                 (unsigned long long)(next_random(&state) % 900));
+        append(data, size, &pos, line);
+    }
+}
+
+// Fixed-size binary records: small little-endian counters, flags, a float and padding
+static void fill_binary(unsigned char* data, size_t size) {
+    uint64_t state = 0xA0761D6478BD642Full;
+    uint32_t sequence = 0;
+    for (size_t pos = 0; pos < size; pos += 32) {
+        unsigned char record[32] = {0};
+        sequence += 1 + (uint32_t)(next_random(&state) % 3);
+        float value = (float)(next_random(&state) % 10000) / 100.0f;
+        uint16_t kind = (uint16_t)(next_random(&state) % 12);
+        memcpy(record, &sequence, sizeof(sequence));
+        memcpy(record + 4, &kind, sizeof(kind));
+        record[6] = (unsigned char)(next_random(&state) % 4 == 0);
+        memcpy(record + 8, &value, sizeof(value));
+        uint64_t id = next_random(&state) & 0xFFFFFF;
+        memcpy(record + 16, &id, sizeof(id));
+        memcpy(data + pos, record, size - pos < 32 ? size - pos : 32);
+    }
+}
+
+// One byte value only: the smallest tree and the longest runs
+static void fill_single(unsigned char* data, size_t size) {
+    memset(data, 'a', size);
+}
+
+typedef struct Corpus {
+    const char* name;
+    void (*fill)(unsigned char* data, size_t size);
+} Corpus;
+
+static const Corpus corpora[] = {
+    {"skewed", fill_skewed},
+    {"uniform", fill_uniform},
+    {"english", fill_english},
+    {"json", fill_json},
+    {"binary", fill_binary},
+    {"single", fill_single},
+};
+#define CORPUS_COUNT (sizeof(corpora) / sizeof(corpora[0]))
+
+// --- Timing ---
+
+typedef struct Result {
+    char corpus[32];
+    unsigned long long size;
+    char stage[32];
+    double mb_per_s;
+    double cycles_per_byte;     // < 0 without a cycle counter
+    double seconds;             // Best time of one call
+    long peak_rss_kib;
+} Result;
+
+typedef struct Results {
+    Result items[MAX_RESULTS];
+    int count;
+} Results;
+
+// Everything one corpus and size needs, built once and shared by the stages
+typedef struct StageInput {
+    const unsigned char* data;
+    size_t size;
+    uint64_t frequencies[HUFFMAN_ALPHABET_SIZE];
+    HuffmanTree tree;
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    unsigned char table_bytes[CODE_LENGTHS_MAX_BYTES];
+    size_t table_size;
+    DecodeTable* table;
+    unsigned char* bits;        // The input's bitstream
+    unsigned long long bit_count;
+    unsigned char* out;         // Decoded input
+    unsigned char* compressed;  // huffman_compress output
+    size_t compressed_capacity;
+    size_t compressed_size;
+    HuffmanContext* ctx;
+    int failed;                 // A stage's output was wrong
+} StageInput;
+
+typedef void (*StageFunction)(StageInput* input);
+
+static void stage_histogram(StageInput* input) {
+    memset(input->frequencies, 0, sizeof(input->frequencies));
+    count_bytes(input->data, input->size, input->frequencies);
+}
+
+static void stage_tree(StageInput* input) {
+    if (build_huffman_tree(input->frequencies, &input->tree) != 0) input->failed = 1;
+}
+
+static void stage_codes(StageInput* input) {
+    if (build_huffman_codes(&input->tree, DEFAULT_MAX_CODE_LENGTH, input->codes, NULL) != 0) input->failed = 1;
+}
+
+static void stage_encode(StageInput* input) {
+    EncodedSlice slice = {0, input->bit_count, 0, 0};
+    encode_slice(input->data, input->size, input->codes, input->bits, &slice);
+    merge_slice_edges(input->bits, &slice, 1);
+}
+
+static void stage_header_parse(StageInput* input) {
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    if (read_code_lengths(input->table_bytes, input->table_size, lengths) < 0) {
+        input->failed = 1;
+        return;
+    }
+    free_decode_table(build_decode_table(lengths));
+}
+
+static void stage_decode(StageInput* input) {
+    if (decode_bitstream(input->bits, input->bit_count, input->table, input->out, input->size) != 0) input->failed = 1;
+}
+
+static void stage_compress(StageInput* input) {
+    if (huffman_compress(input->ctx, input->data, input->size, input->compressed, input->compressed_capacity,
+                         &input->compressed_size) != HUFFMAN_OK) {
+        input->failed = 1;
+    }
+}
+
+static void stage_decompress(StageInput* input) {
+    size_t decompressed_size;
+    if (huffman_decompress(input->ctx, input->compressed, input->compressed_size, input->out, input->size,
+                           &decompressed_size) != HUFFMAN_OK || decompressed_size != input->size) {
+        input->failed = 1;
+    }
+}
+
+// Best of 'repeats' timings of 'calls' calls each; per_call stages pick calls themselves
+static void time_stage(Results* results, const char* corpus, StageInput* input, const char* stage,
+                       StageFunction run, int per_call, int repeats) {
+    long calls = 1;
+    if (per_call) {
+        double start = now_seconds();
+        run(input);
+        double once = now_seconds() - start;
+        calls = once >= MIN_TIMING ? 1 : (long)(MIN_TIMING / (once > 1e-9 ? once : 1e-9)) + 1;
+    }
+    double best_seconds = 0.0;
+    uint64_t best_cycles = 0;
+    for (int r = 0; r < repeats; r++) {
+        double start = now_seconds();
+        uint64_t start_cycles = now_cycles();
+        for (long c = 0; c < calls; c++) {
+            run(input);
+        }
+        uint64_t cycles = now_cycles() - start_cycles;
+        double elapsed = now_seconds() - start;
+        if (r == 0 || elapsed < best_seconds) {
+            best_seconds = elapsed;
+            best_cycles = cycles;
+        }
+    }
+    if (results->count == MAX_RESULTS) {
+        fprintf(stderr, "Too many results; use fewer sizes or corpora\n");
+        exit(EXIT_FAILURE);
+    }
+    Result* result = &results->items[results->count++];
+    snprintf(result->corpus, sizeof(result->corpus), "%s", corpus);
+    snprintf(result->stage, sizeof(result->stage), "%s", stage);
+    result->size = input->size;
+    result->seconds = best_seconds / (double)calls;
+    result->mb_per_s = result->seconds > 0.0 ? (double)input->size / result->seconds / 1e6 : 0.0;
+    result->cycles_per_byte = HAVE_CYCLE_COUNTER ? (double)best_cycles / (double)calls / (double)input->size : -1.0;
+    result->peak_rss_kib = peak_rss_kib();
+}
+
+// Runs every stage on one corpus and size. Returns 0, or -1 if a stage's output was wrong.
+static int bench_corpus(Results* results, const Corpus* corpus, size_t size, int repeats) {
+    StageInput* input = (StageInput*)calloc(1, sizeof(StageInput));
+    unsigned char* data = (unsigned char*)malloc(size);
+    if (input == NULL || data == NULL) {
+        perror("Failed to allocate benchmark input");
+        exit(EXIT_FAILURE);
+    }
+    corpus->fill(data, size);
+    input->data = data;
+    input->size = size;
+
+    // The stages run in pipeline order, each on the previous stage's output
+    time_stage(results, corpus->name, input, "histogram", stage_histogram, 0, repeats);
+    time_stage(results, corpus->name, input, "tree", stage_tree, 1, repeats);
+    time_stage(results, corpus->name, input, "codes", stage_codes, 1, repeats);
+
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    for (int c = 0; c < HUFFMAN_ALPHABET_SIZE; c++) {
+        lengths[c] = input->codes[c].length;
+    }
+    input->table_size = write_code_lengths(lengths, input->table_bytes);
+    input->bit_count = encoded_bit_count(input->frequencies, input->codes);
+    input->bits = (unsigned char*)calloc((size_t)((input->bit_count + 7) / 8) + 1, 1);
+    input->out = (unsigned char*)malloc(size);
+    HuffmanOptions options;
+    huffman_default_options(&options);
+    input->ctx = huffman_create_context(&options);
+    input->compressed_capacity = huffman_compress_bound(input->ctx, size);
+    input->compressed = (unsigned char*)malloc(input->compressed_capacity);
+    if (input->bits == NULL || input->out == NULL || input->ctx == NULL || input->compressed == NULL) {
+        perror("Failed to allocate benchmark buffers");
+        exit(EXIT_FAILURE);
+    }
+    input->table = build_decode_table(lengths);
+
+    time_stage(results, corpus->name, input, "encode", stage_encode, 0, repeats);
+    time_stage(results, corpus->name, input, "header_parse", stage_header_parse, 1, repeats);
+    time_stage(results, corpus->name, input, "decode", stage_decode, 0, repeats);
+    if (memcmp(input->out, data, size) != 0) input->failed = 1;
+    time_stage(results, corpus->name, input, "compress", stage_compress, 0, repeats);
+    memset(input->out, 0, size);
+    time_stage(results, corpus->name, input, "decompress", stage_decompress, 0, repeats);
+    if (memcmp(input->out, data, size) != 0) input->failed = 1;
+
+    int status = input->failed ? -1 : 0;
+    if (status != 0) {
+        fprintf(stderr, "%s, %zu bytes: a stage's output didn't match its input\n", corpus->name, size);
+    }
+    huffman_free_context(input->ctx);
+    free_decode_table(input->table);
+    free(input->compressed);
+    free(input->out);
+    free(input->bits);
+    free(data);
+    free(input);
+    return status;
+}
+
+static void write_results(FILE* out, const Results* results, int repeats) {
+    fprintf(out, "{\n  \"benchmark\": \"stage_bench\",\n  \"version\": 1,\n");
+    fprintf(out, "  \"max_code_length\": %d,\n  \"repeats\": %d,\n", DEFAULT_MAX_CODE_LENGTH, repeats);
+    fprintf(out, "  \"cycle_counter\": \"%s\",\n", HAVE_CYCLE_COUNTER ? "tsc" : "none");
+    fprintf(out, "  \"peak_rss_kib\": %ld,\n  \"results\": [\n", peak_rss_kib());
+    // One result per line: --compare reads them back line by line
+    for (int i = 0; i < results->count; i++) {
+        const Result* r = &results->items[i];
+        fprintf(out, "    {\"corpus\": \"%s\", \"size\": %llu, \"stage\": \"%s\", \"mb_per_s\": %.3f, ",
+                r->corpus, r->size, r->stage, r->mb_per_s);
+        if (r->cycles_per_byte >= 0.0) {
+            fprintf(out, "\"cycles_per_byte\": %.4f, ", r->cycles_per_byte);
+        } else {
+            fprintf(out, "\"cycles_per_byte\": null, ");
+        }
+        fprintf(out, "\"seconds\": %.9f, \"peak_rss_kib\": %ld}%s\n", r->seconds, r->peak_rss_kib,
+                i + 1 < results->count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Lists every stage of results slower than in the baseline file by more than threshold percent.
+// Returns the number of such regressions, or -1 if the baseline can't be read.
+static int compare_results(const Results* results, const char* baseline_filename, double threshold) {
+    FILE* file = fopen(baseline_filename, "r");
+    if (file == NULL) {
+        perror(baseline_filename);
+        return -1;
+    }
+    Results* baseline = (Results*)calloc(1, sizeof(Results));
+    if (baseline == NULL) {
+        perror("Failed to allocate baseline results");
+        exit(EXIT_FAILURE);
+    }
+    char line[512];
+    while (fgets(line, sizeof(line), file) != NULL && baseline->count < MAX_RESULTS) {
+        Result* r = &baseline->items[baseline->count];
+        if (sscanf(line, " {\"corpus\": \"%31[^\"]\", \"size\": %llu, \"stage\": \"%31[^\"]\", \"mb_per_s\": %lf",
+                   r->corpus, &r->size, r->stage, &r->mb_per_s) == 4) {
+            baseline->count++;
+        }
+    }
+    fclose(file);
+
+    int regressions = 0, matched = 0;
+    fprintf(stderr, "%-10s %12s %-13s %12s %12s %9s\n", "corpus", "size", "stage", "base MB/s", "MB/s", "change");
+    for (int i = 0; i < results->count; i++) {
+        const Result* r = &results->items[i];
+        for (int j = 0; j < baseline->count; j++) {
+            const Result* b = &baseline->items[j];
+            if (b->size != r->size || strcmp(b->corpus, r->corpus) != 0 || strcmp(b->stage, r->stage) != 0
+                || b->mb_per_s <= 0.0) {
+                continue;
+            }
+            double change = 100.0 * (r->mb_per_s / b->mb_per_s - 1.0);
+            int regressed = change < -threshold;
+            regressions += regressed;
+            matched++;
+            fprintf(stderr, "%-10s %12llu %-13s %12.1f %12.1f %+8.1f%%%s\n", r->corpus, r->size, r->stage,
+                    b->mb_per_s, r->mb_per_s, change, regressed ? "  REGRESSION" : "");
+            break;
+        }
+    }
+    fprintf(stderr, "%d of %d stages compared, %d slower by more than %.1f%%\n", matched, results->count,
+            regressions, threshold);
+    free(baseline);
+    return regressions;
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-s kib,kib,...] [-c corpus,...] [-r repeats] [-o results.json]\n", program);
+    fprintf(stderr, "          [--compare baseline.json] [--threshold percent]\n");
+    fprintf(stderr, "  -s  Input sizes in KiB (default %s)\n", DEFAULT_SIZES);
+    fprintf(stderr, "  -c  Corpora (default all):");
+    for (size_t i = 0; i < CORPUS_COUNT; i++) fprintf(stderr, " %s", corpora[i].name);
+    fprintf(stderr, "\n  -r  Timings per stage, the best is kept (default 5)\n");
+    fprintf(stderr, "  -o  Write the JSON results to a file instead of stdout\n");
+    fprintf(stderr, "  --compare    Report stages slower than in an earlier run's JSON (exit status 2)\n");
+    fprintf(stderr, "  --threshold  Slowdown in percent that counts as a regression (default 5)\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* sizes_arg = DEFAULT_SIZES;
+    const char* corpora_arg = NULL;
+    const char* output_filename = NULL;
+    const char* baseline_filename = NULL;
+    double threshold = 5.0;
+    int repeats = 5;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            sizes_arg = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            corpora_arg = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            repeats = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+            baseline_filename = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = atof(argv[++i]);
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    size_t sizes[MAX_SIZES];
+    int size_count = 0;
+    for (const char* p = sizes_arg; *p != '\0' && size_count < MAX_SIZES; ) {
+        char* end;
+        unsigned long long kib = strtoull(p, &end, 10);
+        if (end == p || kib == 0 || (*end != ',' && *end != '\0')) {
+            fprintf(stderr, "Error: -s expects sizes in KiB separated by commas, e.g. -s 1,64,1048576.\n");
+            return 1;
+        }
+        sizes[size_count++] = (size_t)kib * 1024;
+        p = *end == ',' ? end + 1 : end;
+    }
+    if (repeats < 1 || size_count == 0) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    Results* results = (Results*)calloc(1, sizeof(Results));
+    if (results == NULL) {
+        perror("Failed to allocate results");
+        return 1;
+    }
+    int status = 0;
+    for (size_t c = 0; c < CORPUS_COUNT; c++) {
+        if (corpora_arg != NULL) {
+            // Whole names only: "json" must not pick a corpus whose name merely contains it
+            const char* found = strstr(corpora_arg, corpora[c].name);
+            size_t length = strlen(corpora[c].name);
+            while (found != NULL && !((found == corpora_arg || found[-1] == ',')
+                                      && (found[length] == ',' || found[length] == '\0'))) {
+                found = strstr(found + 1, corpora[c].name);
+            }
+            if (found == NULL) continue;
+        }
+        for (int s = 0; s < size_count; s++) {
+            fprintf(stderr, "%s, %zu KiB...\n", corpora[c].name, sizes[s] / 1024);
+            if (bench_corpus(results, &corpora[c], sizes[s], repeats) != 0) status = 1;
+        }
+    }
+
+    FILE* out = output_filename != NULL ? fopen(output_filename, "w") : stdout;
+    if (out == NULL) {
+        perror(output_filename);
+        free(results);
+        return 1;
+    }
+    write_results(out, results, repeats);
+    if (out != stdout && fclose(out) != 0) {
+        perror(output_filename);
+        status = 1;
+    }
+
+    if (baseline_filename != NULL) {
+        int regressions = compare_results(results, baseline_filename, threshold);
+        if (regressions < 0) status = 1;
+        else if (regressions > 0 && status == 0) status = 2;
+    }
+    free(results);
+    return status;
+}
@@ -0,0 +1,144 @@
+#include "block_index.h"
+#include "huffman_format.h" // Footer layout and stream header size
+#include <stdlib.h> // For realloc, free
+#include <string.h> // For memcmp
+
+void init_block_index(BlockIndex* index) {
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+void free_block_index(BlockIndex* index) {
+    free(index->entries);
+    init_block_index(index);
+}
+
+void clear_block_index(BlockIndex* index) {
+    index->count = 0;
+}
+
+int add_block_index_entry(BlockIndex* index, unsigned long long uncompressed_size, unsigned long long compressed_size) {
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity > 0 ? index->capacity * 2 : 64;
+        BlockIndexEntry* entries = (BlockIndexEntry*)realloc(index->entries, sizeof(BlockIndexEntry) * capacity);
+        if (entries == NULL) {
+            return -1;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+
+    BlockIndexEntry* entry = &index->entries[index->count];
+    if (index->count == 0) {
+        entry->compressed_offset = HUFFMAN_STREAM_HEADER_SIZE;
+        entry->uncompressed_offset = 0;
+    } else {
+        const BlockIndexEntry* previous = entry - 1;
+        entry->compressed_offset = previous->compressed_offset + previous->compressed_size;
+        entry->uncompressed_offset = previous->uncompressed_offset + previous->uncompressed_size;
+    }
+    entry->compressed_size = compressed_size;
+    entry->uncompressed_size = uncompressed_size;
+    index->count++;
+    return 0;
+}
+
+unsigned long long block_index_uncompressed_size(const BlockIndex* index) {
+    if (index->count == 0) {
+        return 0;
+    }
+    const BlockIndexEntry* last = &index->entries[index->count - 1];
+    return last->uncompressed_offset + last->uncompressed_size;
+}
+
+size_t find_block_for_offset(const BlockIndex* index, unsigned long long position) {
+    // Binary search over the block end positions, which are sorted
+    size_t low = 0;
+    size_t high = index->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const BlockIndexEntry* entry = &index->entries[middle];
+        if (entry->uncompressed_offset + entry->uncompressed_size <= position) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Reads a varint from data[*pos..end); returns -1 if it runs past end
+static int parse_varint(const unsigned char* data, size_t end, size_t* pos, unsigned long long* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64 && *pos < end; shift += 7) {
+        unsigned char byte = data[(*pos)++];
+        *value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1;
+}
+
+int read_block_index_offset(const unsigned char* footer, unsigned long long* index_offset) {
+    if (memcmp(footer + 8, HUFFMAN_INDEX_MAGIC, HUFFMAN_INDEX_MAGIC_SIZE) != 0) {
+        return -1;
+    }
+    *index_offset = 0;
+    for (int i = 7; i >= 0; i--) {
+        *index_offset = (*index_offset << 8) | footer[i];
+    }
+    return 0;
+}
+
+int read_block_index(const unsigned char* data, size_t size, BlockIndex* index) {
+    return read_block_index_tail(data, size, size, index);
+}
+
+int read_block_index_tail(const unsigned char* tail, size_t tail_size, unsigned long long stream_size, BlockIndex* index) {
+    clear_block_index(index);
+    unsigned long long index_offset;
+    if (stream_size < HUFFMAN_STREAM_HEADER_SIZE + 1 + HUFFMAN_FOOTER_SIZE || tail_size < HUFFMAN_FOOTER_SIZE
+        || tail_size > stream_size || read_block_index_offset(tail + tail_size - HUFFMAN_FOOTER_SIZE, &index_offset) != 0) {
+        return -1;
+    }
+    unsigned long long tail_start = stream_size - tail_size; // Stream position of tail[0]
+    unsigned long long index_end = stream_size - HUFFMAN_FOOTER_SIZE;
+    if (index_offset <= HUFFMAN_STREAM_HEADER_SIZE || index_offset > index_end || index_offset - 1 < tail_start
+        || tail[index_offset - 1 - tail_start] != HUFFMAN_BLOCK_END) {
+        return -1;
+    }
+
+    const unsigned char* data = tail + (index_offset - tail_start);
+    size_t end = (size_t)(index_end - index_offset);
+    size_t pos = 0;
+    unsigned long long block_count;
+    // Every entry takes at least two bytes, which also bounds the allocation below
+    if (parse_varint(data, end, &pos, &block_count) != 0 || block_count > (end - pos) / 2) {
+        return -1;
+    }
+    for (unsigned long long i = 0; i < block_count; i++) {
+        unsigned long long uncompressed_size, compressed_size;
+        if (parse_varint(data, end, &pos, &uncompressed_size) != 0
+            || parse_varint(data, end, &pos, &compressed_size) != 0
+            || compressed_size == 0 || compressed_size > index_offset
+            || uncompressed_size > compressed_size * 8) { // Codes are at least one bit long
+            clear_block_index(index);
+            return -1;
+        }
+        if (add_block_index_entry(index, uncompressed_size, compressed_size) != 0) {
+            clear_block_index(index);
+            return -2;
+        }
+    }
+
+    // The blocks must exactly fill the space between the stream header and the END byte
+    unsigned long long blocks_end = HUFFMAN_STREAM_HEADER_SIZE;
+    if (index->count > 0) {
+        blocks_end = index->entries[index->count - 1].compressed_offset + index->entries[index->count - 1].compressed_size;
+    }
+    if (pos != end || blocks_end != index_offset - 1) {
+        clear_block_index(index);
+        return -1;
+    }
+    return 0;
+}
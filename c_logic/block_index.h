@@ -0,0 +1,49 @@
+#ifndef BLOCK_INDEX_H
+#define BLOCK_INDEX_H
+
+#include <stddef.h>
+
+// Where one block sits in the compressed stream and in the decompressed output
+typedef struct BlockIndexEntry {
+    unsigned long long compressed_offset;   // Position of the block's type byte in the stream
+    unsigned long long compressed_size;     // Type byte through the block's last padded byte
+    unsigned long long uncompressed_offset; // Position of the block's first decoded byte
+    unsigned long long uncompressed_size;   // Characters the block decodes to
+} BlockIndexEntry;
+
+// The index written after the last block (see huffman_format.h). Offsets are not stored in
+// the file; they are the running sums of the sizes and are filled in as entries are added.
+typedef struct BlockIndex {
+    BlockIndexEntry* entries;   // malloc'd, grows as needed
+    size_t count;
+    size_t capacity;
+} BlockIndex;
+
+void init_block_index(BlockIndex* index);
+void free_block_index(BlockIndex* index);
+// Removes all entries but keeps the memory for the next stream
+void clear_block_index(BlockIndex* index);
+
+// Appends the next block of the stream. Returns 0, or -1 if the index can't grow.
+int add_block_index_entry(BlockIndex* index, unsigned long long uncompressed_size, unsigned long long compressed_size);
+
+// Total decompressed size covered by the index
+unsigned long long block_index_uncompressed_size(const BlockIndex* index);
+
+// First block whose decoded bytes reach past 'position' (index->count if there is none)
+size_t find_block_for_offset(const BlockIndex* index, unsigned long long position);
+
+// Reads the index of a whole compressed stream held in memory, using the footer at its end,
+// into an initialized index (replacing its entries). Returns 0 on success, -1 (with the index
+// left empty) if there is no footer or the index doesn't match the stream, or -2 if there is
+// no memory for the entries.
+int read_block_index(const unsigned char* data, size_t size, BlockIndex* index);
+// The same from the end of a stream alone: tail holds its last tail_size of stream_size
+// bytes, reaching back at least to the END byte before the index. Enough to append to a
+// stream without reading its blocks.
+int read_block_index_tail(const unsigned char* tail, size_t tail_size, unsigned long long stream_size, BlockIndex* index);
+// Reads the index offset from a footer (its HUFFMAN_FOOTER_SIZE bytes). Returns 0, or -1 if
+// the footer's magic is missing.
+int read_block_index_offset(const unsigned char* footer, unsigned long long* index_offset);
+
+#endif // BLOCK_INDEX_H
@@ -0,0 +1,79 @@
+#include "block_split.h"
+#include "histogram.h"       // Frequency counting kernel
+#include "canonical_codes.h" // Size of a code length table
+#include <math.h>            // For log2
+#include <string.h>
+
+double entropy_bits(const uint64_t frequencies[256], unsigned long long symbol_count) {
+    if (symbol_count == 0) {
+        return 0.0;
+    }
+    double bits = (double)symbol_count * log2((double)symbol_count);
+    for (int i = 0; i < 256; i++) {
+        if (frequencies[i] > 0) {
+            bits -= (double)frequencies[i] * log2((double)frequencies[i]);
+        }
+    }
+    return bits > 0.0 ? bits : 0.0;
+}
+
+unsigned long long block_header_estimate(const uint64_t frequencies[256]) {
+    int present = 0;
+    for (int i = 0; i < 256; i++) {
+        present += frequencies[i] > 0;
+    }
+    // Codes of up to 15 bits take 4-bit length fields; the varints are the symbol and bit
+    // counts and the index entry's two sizes, about 3-4 bytes each for 64 KB-16 MB blocks
+    return 1 + CODE_LENGTHS_PREFIX_BYTES + ((unsigned long long)present * 4 + 7) / 8 + 4 * 4;
+}
+
+size_t next_block_size(const unsigned char* data, size_t size, size_t max_block_size, uint64_t frequencies[256],
+                       BlockSplitCarry* carry) {
+    size_t block = size < BLOCK_SPLIT_CHUNK ? size : BLOCK_SPLIT_CHUNK;
+    if (max_block_size < block) {
+        block = max_block_size;
+    }
+    if (carry->size > 0 && carry->size <= size && carry->size <= max_block_size) {
+        // The chunk the last block stopped before opens this one, counts and all. It is a
+        // whole chunk unless max_block_size cut it short, which shifts later cuts a little.
+        block = carry->size;
+        memcpy(frequencies, carry->counts, sizeof(carry->counts));
+    } else {
+        memset(frequencies, 0, sizeof(uint64_t) * 256);
+        count_bytes(data, block, frequencies);
+    }
+    carry->size = 0;
+    double block_bits = entropy_bits(frequencies, block);
+
+    uint64_t chunk_counts[256];
+    uint64_t merged[256];
+    while (block < size && block < max_block_size) {
+        size_t chunk = size - block < BLOCK_SPLIT_CHUNK ? size - block : BLOCK_SPLIT_CHUNK;
+        if (max_block_size - block < chunk) {
+            chunk = max_block_size - block;
+        }
+        memset(chunk_counts, 0, sizeof(chunk_counts));
+        count_bytes(data + block, chunk, chunk_counts);
+        for (int i = 0; i < 256; i++) {
+            merged[i] = frequencies[i] + chunk_counts[i];
+        }
+
+        // Coding the chunk with the block's (merged) table costs the growth in the merged
+        // block's bits; a table of its own costs the chunk's bits and one more header. Whole
+        // bit code lengths don't realize small entropy gains, so those must exceed
+        // BLOCK_SPLIT_MARGIN of the chunk's bits too, or near-identical text splits for nothing.
+        double merged_bits = entropy_bits(merged, block + chunk);
+        double chunk_bits = entropy_bits(chunk_counts, chunk);
+        double own_bits = chunk_bits * (1.0 + BLOCK_SPLIT_MARGIN) + 8.0 * (double)block_header_estimate(chunk_counts);
+        if (merged_bits - block_bits > own_bits) {
+            // The statistics shifted: the chunk starts the next block, which keeps its counts
+            memcpy(carry->counts, chunk_counts, sizeof(chunk_counts));
+            carry->size = chunk;
+            break;
+        }
+        memcpy(frequencies, merged, sizeof(merged));
+        block_bits = merged_bits;
+        block += chunk;
+    }
+    return block;
+}
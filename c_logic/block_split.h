@@ -0,0 +1,39 @@
+#ifndef BLOCK_SPLIT_H
+#define BLOCK_SPLIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Adaptive blocks: instead of cutting the input every block_size bytes, a block grows one
+// chunk at a time for as long as the chunk's bytes cost less coded with the block's table
+// than with a table of their own, header included. Homogeneous data then gets few, large
+// blocks (one table and one tree per block_size bytes), and data whose statistics shift
+// (JSON followed by stack traces) gets a new table where the shift happens.
+
+// Blocks end on a multiple of this many bytes (or at the end of the input)
+#define BLOCK_SPLIT_CHUNK (64 * 1024)
+// Share of a chunk's bits a table of its own must save on top of the header cost
+#define BLOCK_SPLIT_MARGIN (1.0 / 256)
+
+// Shannon bound in bits of symbol_count bytes with these counts: the sum of -f * log2(f / n).
+// Huffman codes stay within one bit per byte of it, and much closer on typical data.
+double entropy_bits(const uint64_t frequencies[256], unsigned long long symbol_count);
+
+// Estimated bytes of a block's header with these counts: type byte, counts, code length table
+// and index entry
+unsigned long long block_header_estimate(const uint64_t frequencies[256]);
+
+// The chunk a block was ended before, counted already: it is where the next block starts
+typedef struct BlockSplitCarry {
+    uint64_t counts[256];
+    size_t size;            // Bytes of the chunk, 0 if the last block didn't end on a shift
+} BlockSplitCarry;
+
+// Length of the next block of data[0..size), at most max_block_size bytes, and its counts in
+// frequencies (overwritten). carry holds the chunk at the start of data if the previous call
+// ended its block before it, and is set for the next call; zero it before a stream's first
+// block. Every chunk is counted exactly once, including the one that starts the next block.
+size_t next_block_size(const unsigned char* data, size_t size, size_t max_block_size, uint64_t frequencies[256],
+                       BlockSplitCarry* carry);
+
+#endif // BLOCK_SPLIT_H
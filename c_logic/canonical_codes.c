@@ -0,0 +1,129 @@
+#include "canonical_codes.h"
+#include <string.h> // For memset
+
+void assign_canonical_codes(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]) {
+    int length_count[MAX_CODE_LENGTH + 1] = {0};
+    uint64_t next_code[MAX_CODE_LENGTH + 1];
+
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        length_count[lengths[i]]++;
+    }
+    length_count[0] = 0;
+
+    // First code of each length: one past the last code of the previous length, shifted left
+    uint64_t code = 0;
+    next_code[0] = 0;
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++) {
+        code = (code + length_count[len - 1]) << 1;
+        next_code[len] = code;
+    }
+
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        codes[i].length = lengths[i];
+        codes[i].bits = lengths[i] != 0 ? next_code[lengths[i]]++ : 0;
+    }
+}
+
+int validate_code_lengths(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]) {
+    int length_count[MAX_CODE_LENGTH + 1] = {0};
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] > MAX_CODE_LENGTH) {
+            return -1;
+        }
+        length_count[lengths[i]]++;
+    }
+
+    // Count the unused codes at each length; going negative means the code is over-subscribed.
+    // Once more codes are free than there are characters left, it can't go negative anymore.
+    long long left = 1;
+    for (int len = 1; len <= MAX_CODE_LENGTH && left <= HUFFMAN_ALPHABET_SIZE; len++) {
+        left = (left << 1) - length_count[len];
+        if (left < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+size_t write_code_lengths(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], unsigned char* out) {
+    int max_length = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] > max_length) max_length = lengths[i];
+    }
+
+    int width = 0;
+    while ((1 << width) <= max_length) {
+        width++;
+    }
+
+    size_t pos = 0;
+    out[pos++] = (unsigned char)width;
+    memset(out + pos, 0, CODE_LENGTHS_BITMAP_BYTES);
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] != 0) {
+            out[pos + i / 8] |= (unsigned char)(0x80 >> (i % 8));
+        }
+    }
+    pos += CODE_LENGTHS_BITMAP_BYTES;
+
+    // Pack the lengths of the present characters, width bits each
+    unsigned int acc = 0;
+    int acc_bits = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] == 0) continue;
+        acc = (acc << width) | lengths[i];
+        acc_bits += width;
+        if (acc_bits >= 8) {
+            acc_bits -= 8;
+            out[pos++] = (unsigned char)(acc >> acc_bits);
+        }
+    }
+    if (acc_bits > 0) {
+        out[pos++] = (unsigned char)(acc << (8 - acc_bits));
+    }
+    return pos;
+}
+
+size_t code_lengths_table_size(const unsigned char* prefix) {
+    int width = prefix[0];
+    if (width > 7) {
+        return 0;
+    }
+    int present = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (prefix[1 + i / 8] & (0x80 >> (i % 8))) present++;
+    }
+    return CODE_LENGTHS_PREFIX_BYTES + ((size_t)present * width + 7) / 8;
+}
+
+long read_code_lengths(const unsigned char* in, size_t in_size, unsigned char lengths[HUFFMAN_ALPHABET_SIZE]) {
+    memset(lengths, 0, HUFFMAN_ALPHABET_SIZE);
+    if (in_size < CODE_LENGTHS_PREFIX_BYTES) {
+        return -1;
+    }
+
+    int width = in[0];
+    size_t size = code_lengths_table_size(in);
+    if (size == 0 || in_size < size) {
+        return -1;
+    }
+
+    const unsigned char* packed = in + CODE_LENGTHS_PREFIX_BYTES;
+    size_t bit_pos = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (!(in[1 + i / 8] & (0x80 >> (i % 8)))) continue;
+        int len = 0;
+        for (int b = 0; b < width; b++, bit_pos++) {
+            len = (len << 1) | ((packed[bit_pos / 8] >> (7 - bit_pos % 8)) & 1);
+        }
+        if (len == 0) {
+            return -1; // A present character must have a code
+        }
+        lengths[i] = (unsigned char)len;
+    }
+
+    if (validate_code_lengths(lengths) != 0) {
+        return -1;
+    }
+    return (long)size;
+}
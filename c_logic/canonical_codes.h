@@ -0,0 +1,39 @@
+#ifndef CANONICAL_CODES_H
+#define CANONICAL_CODES_H
+
+#include <stddef.h>
+#include "encoder.h" // For HuffmanCode and MAX_CODE_LENGTH
+
+// Canonical Huffman codes are fully determined by their lengths: codes of the same length
+// are consecutive integers in character order, and shorter codes come first. Only the
+// lengths are stored in the compressed file; both sides rebuild the codes from them.
+//
+// Serialized code length table:
+//   byte 0     width w of each length field in bits (0 = no characters)
+//   32 bytes   presence bitmap, bit (7 - i % 8) of byte i / 8 is set if character i has a code
+//   ...        lengths of the present characters in character order, w bits each, MSB first
+
+#define CODE_LENGTHS_BITMAP_BYTES (HUFFMAN_ALPHABET_SIZE / 8)
+// The width byte and bitmap, which are enough to know the size of the whole table
+#define CODE_LENGTHS_PREFIX_BYTES (1 + CODE_LENGTHS_BITMAP_BYTES)
+// Largest possible serialized table: width byte + bitmap + 256 lengths of 7 bits
+#define CODE_LENGTHS_MAX_BYTES (CODE_LENGTHS_PREFIX_BYTES + HUFFMAN_ALPHABET_SIZE * 7 / 8)
+
+// Fills codes[] with the canonical code for every non-zero length
+void assign_canonical_codes(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]);
+
+// Returns 0 if the lengths describe a valid prefix code (Kraft inequality holds), -1 otherwise
+int validate_code_lengths(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]);
+
+// Serializes the lengths into out (at least CODE_LENGTHS_MAX_BYTES) and returns the bytes written
+size_t write_code_lengths(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], unsigned char* out);
+
+// Size of a whole serialized table given its first CODE_LENGTHS_PREFIX_BYTES bytes,
+// or 0 if the width byte is invalid
+size_t code_lengths_table_size(const unsigned char* prefix);
+
+// Parses a table written by write_code_lengths. Returns the bytes consumed, or -1 if the
+// table is truncated or invalid.
+long read_code_lengths(const unsigned char* in, size_t in_size, unsigned char lengths[HUFFMAN_ALPHABET_SIZE]);
+
+#endif // CANONICAL_CODES_H
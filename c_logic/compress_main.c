@@ -1,274 +1,552 @@
 // main.c
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h> // For strlen, etc. if needed later
-#include <math.h> // For round() to round percentage
-
-
-#include "huffman_node.h"         // Defines HuffmanNode struct (indirectly used by PQ and codes)
-#include "min_priority_queue.h"   // PQ functions
-#include "encoder.h"        // Code generation functions
-#include "linked_list.h"          // Linked list functions
-
-HuffmanNode* create_huffman_node(int ch, int freq, HuffmanNode* left, HuffmanNode* right) {
-    HuffmanNode* node = (HuffmanNode*)malloc(sizeof(HuffmanNode));
-    if (node == NULL) { perror("Failed to allocate HuffmanNode"); exit(EXIT_FAILURE); }
-    node->ch = ch;
-    node->frequency = freq; // Use 'frequency' instead of 'f' for consistency
-    node->left = left;
-    node->right = right;
-    return node;
+#include <string.h> // For strcmp
+#include <errno.h>  // For ENOENT
+
+#ifdef _WIN32
+#include <io.h>    // For _setmode
+#include <fcntl.h> // For _O_BINARY
+#endif
+
+#include "huffman.h"              // Compression library
+#include "encoder.h"              // Printing and exporting the first block's codes
+#include "canonical_codes.h"      // Rebuilding those codes from their lengths
+#include "huffman_format.h"       // Block size limits
+#include "file_mapping.h"         // Single read-only view of the input
+#include "thread_pool.h"          // For online_cpu_count
+
+// Why huffman_create_context returned NULL
+static void print_context_error(const HuffmanOptions* options) {
+    if (huffman_check_options(options) != HUFFMAN_OK) {
+        fprintf(stderr, "Error: Invalid compression options.\n");
+    } else {
+        fprintf(stderr, "Error: Can't set up compression (%s).\n", huffman_status_string(HUFFMAN_ERROR_NO_MEMORY));
+    }
 }
 
-long get_file_size(const char *filename) {
-    FILE *file = fopen(filename, "rb"); // Open in binary read mode
-    if (file == NULL) {
-        perror("Error opening file to get size");
-        return -1; // Indicate error
+// The library only returns a status; this adds what it means for the files involved
+static void print_compress_error(HuffmanStatus status, int append, int read_from_stdin) {
+    if (append && status == HUFFMAN_ERROR_CORRUPT_INPUT) {
+        fprintf(stderr, "Error: Can only append to a compressed stream produced by this version of huffman_compressor.\n");
+    } else if (status == HUFFMAN_ERROR_IO) {
+        fprintf(stderr, "Compression failed: error %s.\n", read_from_stdin ? "reading stdin or writing the compressed output"
+                                                                              : "writing the compressed output");
+    } else {
+        fprintf(stderr, "Compression failed: %s.\n", huffman_status_string(status));
     }
-
-    fseek(file, 0, SEEK_END); // Go to the end of the file
-    long size = ftell(file);  // Get the current position (which is the size)
-    fclose(file);             // Close the file
-
-    return size;
 }
 
-int main(int argc, char *argv[]) {
-    // Check if enough arguments are provided for COMPRESSION
-    // Now expecting: program_name, input_file, output_compressed_file, output_map_file
-    if (argc < 4) {
-        fprintf(stderr, "Usage: %s <input_text_file> <output_compressed_file> <output_map_file>\n", argv[0]);
+// --estimate: prints what compressing data[0..size) with these options would give
+static int print_estimate(const HuffmanOptions* options, const unsigned char* data, size_t size, size_t sample_size) {
+    HuffmanContext* ctx = huffman_create_context(options);
+    if (ctx == NULL) {
+        print_context_error(options);
         return 1;
     }
-
-    const char *filename = argv[1];
-    const char *output_compressed_filename = argv[2]; // This will store the actual compressed bits
-    const char *output_map_filename = argv[3];        // This will store the char-to-code map
-
-    printf("Input Filename: %s\n", filename);
-    printf("Compressed Output Filename: %s\n", output_compressed_filename);
-    printf("Map Output Filename: %s\n", output_map_filename);
-    
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-        perror("Error opening file");
+    HuffmanEstimate estimate;
+    HuffmanStatus status = huffman_estimate(ctx, data, size, sample_size, &estimate);
+    huffman_free_context(ctx);
+    if (status != HUFFMAN_OK) {
+        fprintf(stderr, "Estimate failed: %s.\n", huffman_status_string(status));
         return 1;
     }
 
-    int character;
-    int frequency_table[128][2];
-    for (int i = 0; i < 128; i++) {
-        frequency_table[i][0] = i;
-        frequency_table[i][1] = 0;
+    int sampled = estimate.sampled_size < estimate.input_size;
+    printf("\n--- Compression Estimate ---\n");
+    printf("Original Size: %llu bytes\n", estimate.input_size);
+    if (sampled) {
+        printf("Sampled: first %llu bytes (%.2f%%)\n", estimate.sampled_size,
+               100.0 * (double)estimate.sampled_size / (double)estimate.input_size);
     }
-    int largest_freq_val = 0; // Renamed 'largest' for clarity, this is the max frequency value
+    printf("Compressed Size: %llu bytes (%s)\n", estimate.compressed_size,
+           sampled ? "extrapolated from the sample" : "exact");
+    if (estimate.input_size > 0) {
+        printf("Compression Ratio: %.2f%%\n", 100.0 * (double)estimate.compressed_size / (double)estimate.input_size);
+    }
+    printf("Blocks: %llu%s (%llu stored raw)\n", estimate.block_count, sampled ? " sampled" : "", estimate.raw_blocks);
+    if (estimate.sampled_size > 0) {
+        double bytes = (double)estimate.sampled_size;
+        printf("Coded Bits: %llu (%.4f bits per byte)\n", estimate.coded_bits, (double)estimate.coded_bits / bytes);
+        printf("Entropy Bound: %.0f bits (%.4f bits per byte, codes +%.4f%%)\n", estimate.entropy_bits,
+               estimate.entropy_bits / bytes,
+               estimate.entropy_bits > 0.0 ? 100.0 * ((double)estimate.coded_bits / estimate.entropy_bits - 1.0) : 0.0);
+        printf("Block Headers: %llu bytes\n", estimate.header_bytes);
+    }
+    printf("----------------------------\n");
+    return 0;
+}
 
-    printf("Reading file contents:\n");
-    while ((character = fgetc(file)) != EOF) {
-        //putchar(character);
-        if (character >= 0 && character < 128) {
-            frequency_table[character][1]++;
-            if (frequency_table[character][1] > largest_freq_val) {
-                largest_freq_val = frequency_table[character][1];
-            }
+// --train: builds a shared table from sample messages and writes it to table_filename
+static int train_table(const char *table_filename, const char *const *sample_names, int sample_count, int max_code_length) {
+    MappedFile *samples = (MappedFile *)calloc((size_t)sample_count, sizeof(MappedFile));
+    const void **sample_data = (const void **)calloc((size_t)sample_count, sizeof(void *));
+    size_t *sample_sizes = (size_t *)calloc((size_t)sample_count, sizeof(size_t));
+    if (samples == NULL || sample_data == NULL || sample_sizes == NULL) {
+        perror("Failed to allocate sample list");
+        exit(EXIT_FAILURE);
+    }
+    int result = 0;
+    int loaded = 0;
+    unsigned long long sample_bytes = 0;
+    for (; loaded < sample_count && result == 0; loaded++) {
+        if (strcmp(sample_names[loaded], "-") == 0) {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            result = read_whole_file(stdin, &samples[loaded]);
+        } else {
+            result = map_input_file(sample_names[loaded], &samples[loaded]);
         }
+        sample_data[loaded] = samples[loaded].data;
+        sample_sizes[loaded] = samples[loaded].size;
+        sample_bytes += samples[loaded].size;
     }
-    fclose(file);
-    printf("\nFile closed successfully.\n");
 
-    printf("\nCharacter Frequency Table:\n");
-    for (int i = 0; i < 128; i++) {
-        if (frequency_table[i][1] > 0) {
-            printf("'%c'\t\t%d\t\t%d\n", frequency_table[i][0], frequency_table[i][0], frequency_table[i][1]);
+    unsigned char table[HUFFMAN_TABLE_MAX_SIZE];
+    size_t table_size;
+    uint32_t table_id;
+    if (result == 0) {
+        HuffmanStatus status = huffman_train_table(sample_data, sample_sizes, (size_t)sample_count, max_code_length,
+                                                   table, sizeof(table), &table_size, &table_id);
+        if (status != HUFFMAN_OK) {
+            fprintf(stderr, "Training failed: %s (a table needs -L 8 or more).\n", huffman_status_string(status));
+            result = 1;
+        }
+    }
+    if (result == 0) {
+        FILE *out = fopen(table_filename, "wb");
+        if (out == NULL || fwrite(table, 1, table_size, out) != table_size || fclose(out) != 0) {
+            perror("Error writing table file");
+            result = 1;
         }
     }
-    printf("\nLargest frequency count: %d\n", largest_freq_val);
+    if (result == 0) {
+        // The id alone is enough to find the table again as <id>.huft in $HUFFMAN_TABLE_DIR
+        printf("Trained table %08x on %d samples (%llu bytes): %zu bytes written to %s\n",
+               (unsigned)table_id, sample_count, sample_bytes, table_size, table_filename);
+    }
+    for (int i = 0; i < loaded; i++) {
+        unmap_input_file(&samples[i]);
+    }
+    free(sample_sizes);
+    free(sample_data);
+    free(samples);
+    return result == 0 ? 0 : 1;
+}
 
-    // Linked list setup
-    Node* key[largest_freq_val + 1]; // Array of linked list heads
-    for (int i = 0; i <= largest_freq_val; i++) {
-        key[i] = NULL;
+// --stats=json: the run's counters and stage times as one JSON object on one line
+static void print_stats_json(FILE *out, const HuffmanStats *stats, int thread_count) {
+    const HuffmanTimings *t = &stats->timings;
+    int symbols = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (stats->frequencies[i] > 0) symbols++;
     }
+    fprintf(out, "{\"input_bytes\": %llu, \"output_bytes\": %llu, \"blocks\": %llu, \"raw_blocks\": %llu, "
+            "\"sampled_blocks\": %llu, \"symbols\": %d, \"tree_depth\": %d, \"max_code_length\": %d, \"threads\": %d, "
+            "\"total_ns\": %llu, \"histogram_ns\": %llu, \"table_ns\": %llu, \"encode_ns\": %llu, "
+            "\"read_ns\": %llu, \"write_ns\": %llu, \"wait_ns\": %llu}\n",
+            stats->uncompressed_size, stats->compressed_size, stats->block_count, stats->raw_blocks,
+            stats->sampled_blocks, symbols, stats->optimal_max_length, stats->max_code_length, thread_count,
+            t->total_ns, t->histogram_ns, t->table_ns, t->coding_ns, t->read_ns, t->write_ns, t->wait_ns);
+}
 
-    int unique_characters = 0;
-    for (int i = 0; i < 128; i++) {
-        int frequency = frequency_table[i][1];
-        if (frequency > 0) {
-            linked_list_push(&key[frequency], frequency_table[i][0]);
-            unique_characters++; // Count unique characters here
-        }
+// --message: compresses the whole input as one frameless message and writes it to out
+static HuffmanStatus write_message(HuffmanContext *ctx, const MappedFile *input, FILE *out, unsigned long long *dst_size) {
+    size_t capacity = huffman_compress_bound(ctx, input->size);
+    unsigned char *message = (unsigned char *)malloc(capacity);
+    if (message == NULL) {
+        perror("Failed to allocate message buffer");
+        exit(EXIT_FAILURE);
     }
-    printf("\nTotal unique characters: %d\n", unique_characters);
+    size_t message_size = 0;
+    HuffmanStatus status = huffman_compress_message(ctx, input->data, input->size, message, capacity, &message_size);
+    if (status == HUFFMAN_OK && fwrite(message, 1, message_size, out) != message_size) {
+        status = HUFFMAN_ERROR_IO;
+    }
+    free(message);
+    *dst_size = message_size;
+    return status;
+}
 
-    // Print linked lists (optional, for debugging)
-    printf("\nLinked Lists of Characters by Frequency (for debugging):\n");
-    for (int i = 0; i <= largest_freq_val; i++) {
-        if (key[i] != NULL) {
-            printf("Frequency %d: ", i);
-            Node *current = key[i];
-            while (current != NULL) {
-                printf("'%c' ", current->ch);
-                current = current->next;
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-v|-vv] [--stats=json] [--sync-io] [--append] [--message] [-L max_code_length] [-b block_size_kib] [-T threads] [-S] [-I] [-A] [-s sample_kib] [-t table] <input_file|-> <output_compressed_file|-> [output_map_file]\n", program);
+    fprintf(stderr, "       %s --estimate [--sample sample_kib] [-L max_code_length] [-b block_size_kib] [-S] [-I] [-A] <input_file|->\n", program);
+    fprintf(stderr, "       %s --train [-L max_code_length] <table_file> <sample_file|->...\n", program);
+    fprintf(stderr, "  -v  Print the file names and compression statistics (-vv: also the first\n");
+    fprintf(stderr, "      block's codes and the byte frequencies); nothing is printed by default\n");
+    fprintf(stderr, "  --stats=json  Print the counters and per-stage times as a JSON object\n");
+    fprintf(stderr, "  --sync-io     Read and write on the coding thread instead of on I/O threads\n");
+    fprintf(stderr, "  --append      Add the input as new blocks to the end of an existing compressed\n");
+    fprintf(stderr, "                file (created if missing) instead of overwriting it; not atomic:\n");
+    fprintf(stderr, "                a crash while appending can leave the file undecodable\n");
+    fprintf(stderr, "  --message     Write the input as one frameless message: a lone block with no\n");
+    fprintf(stderr, "                stream header, index or footer (with -t: table id and bits only)\n");
+    fprintf(stderr, "  -L  Longest allowed code in bits (default %d)\n", DEFAULT_MAX_CODE_LENGTH);
+    fprintf(stderr, "  -b  Input block size in KiB (default %d); each block gets its own code table\n", HUFFMAN_DEFAULT_BLOCK_SIZE / 1024);
+    fprintf(stderr, "  -T  Number of threads compressing blocks in parallel (default 1, 0 = one per CPU)\n");
+    fprintf(stderr, "  -S  Single table: a file becomes one block with one code table and one\n");
+    fprintf(stderr, "      continuous bitstream, and the -T threads split the work inside the block\n");
+    fprintf(stderr, "  -I  Interleaved streams: code each block as 4 substreams the decompressor\n");
+    fprintf(stderr, "      decodes side by side (faster decoding, a few bytes more per block)\n");
+    fprintf(stderr, "  -A  Adaptive blocks: end a block where the data's statistics change, up to\n");
+    fprintf(stderr, "      -b KiB per block (default %d with -A)\n", HUFFMAN_DEFAULT_ADAPTIVE_BLOCK_SIZE / 1024);
+    fprintf(stderr, "  -s  Sampled tables: build each block's table from about sample_kib KiB of it\n");
+    fprintf(stderr, "      and encode it in one pass (lower latency, slightly larger output)\n");
+    fprintf(stderr, "  -t  Shared table: code every block with a table made by --train, given as its\n");
+    fprintf(stderr, "      file or its id (found as <id>%s in $%s, default .)\n", HUFFMAN_TABLE_SUFFIX, HUFFMAN_TABLE_DIR_ENV);
+    fprintf(stderr, "  --train     Build a shared table from sample messages for many small inputs;\n");
+    fprintf(stderr, "              the decompressor needs the same table (-t)\n");
+    fprintf(stderr, "  --estimate  Only print the compressed size the options would give, from the\n");
+    fprintf(stderr, "              byte counts alone (nothing is encoded or written)\n");
+    fprintf(stderr, "  --sample    Estimate from the first sample_kib KiB of the input only\n");
+    fprintf(stderr, "  Use - to read from stdin or write to stdout.\n");
+}
+
+int main(int argc, char *argv[]) {
+    // Check if enough arguments are provided for COMPRESSION
+    // Now expecting: program_name, [options], input_file, output_compressed_file, [output_map_file]
+    int max_code_length = DEFAULT_MAX_CODE_LENGTH;
+    size_t block_size = HUFFMAN_DEFAULT_BLOCK_SIZE;
+    int thread_count = 1;
+    int single_table = 0;
+    int four_streams = 0;
+    int adaptive_blocks = 0;
+    int block_size_given = 0;
+    int estimate_only = 0;
+    size_t sample_size = 0;
+    size_t table_sample_size = 0;
+    const char *shared_table = NULL;
+    int train = 0;
+    int verbosity = 0;
+    int stats_json = 0;
+    int async_io = 1;
+    int append = 0;
+    int message = 0;
+    const char **positional = (const char **)calloc((size_t)argc, sizeof(char *)); // --train takes any number
+    if (positional == NULL) {
+        perror("Failed to allocate argument list");
+        exit(EXIT_FAILURE);
+    }
+    // Every exit after this point goes through cleanup, which releases what was set up so far
+    int result = 1;
+    MappedFile input = {NULL, 0, 0};
+    FILE *outfile = NULL;
+    HuffmanContext *ctx = NULL;
+    int positional_count = 0;
+    int usage_error = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "-vv") == 0) {
+            verbosity += (int)strlen(argv[i]) - 1;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_json = 1;
+        } else if (strcmp(argv[i], "--sync-io") == 0) {
+            async_io = 0;
+        } else if (strcmp(argv[i], "--append") == 0) {
+            append = 1;
+        } else if (strcmp(argv[i], "--message") == 0) {
+            message = 1;
+        } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+            max_code_length = atoi(argv[++i]);
+            if (max_code_length < 1 || max_code_length > MAX_CODE_LENGTH) {
+                fprintf(stderr, "Error: -L must be between 1 and %d.\n", MAX_CODE_LENGTH);
+                goto cleanup;
+            }
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            long block_kib = atol(argv[++i]);
+            block_size = (size_t)block_kib * 1024;
+            block_size_given = 1;
+            if (block_kib < 1 || block_kib > HUFFMAN_MAX_BLOCK_SIZE / 1024) {
+                fprintf(stderr, "Error: -b must be between 1 and %d KiB.\n", HUFFMAN_MAX_BLOCK_SIZE / 1024);
+                goto cleanup;
             }
-            printf("\n");
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+            if (thread_count == 0) {
+                thread_count = online_cpu_count();
+            }
+            if (thread_count < 1 || thread_count > 1024) {
+                fprintf(stderr, "Error: -T must be between 0 and 1024.\n");
+                goto cleanup;
+            }
+        } else if (strcmp(argv[i], "-S") == 0) {
+            single_table = 1;
+        } else if (strcmp(argv[i], "-I") == 0) {
+            four_streams = 1;
+        } else if (strcmp(argv[i], "-A") == 0) {
+            adaptive_blocks = 1;
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            long sample_kib = atol(argv[++i]);
+            if (sample_kib < 1 || sample_kib > HUFFMAN_MAX_BLOCK_SIZE / 1024) {
+                fprintf(stderr, "Error: -s must be between 1 and %d KiB.\n", HUFFMAN_MAX_BLOCK_SIZE / 1024);
+                goto cleanup;
+            }
+            table_sample_size = (size_t)sample_kib * 1024;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            shared_table = argv[++i];
+        } else if (strcmp(argv[i], "--train") == 0) {
+            train = 1;
+        } else if (strcmp(argv[i], "--estimate") == 0) {
+            estimate_only = 1;
+        } else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            long sample_kib = atol(argv[++i]);
+            if (sample_kib < 1) {
+                fprintf(stderr, "Error: --sample must be at least 1 KiB.\n");
+                goto cleanup;
+            }
+            sample_size = (size_t)sample_kib * 1024;
+        } else if (positional_count < 3 || train) {
+            positional[positional_count++] = argv[i];
+        } else {
+            usage_error = 1;
         }
     }
-
-
-    // --- Huffman Tree Building ---
-    MinPriorityQueue* pq = NULL;
-    HuffmanNode* huffman_root = NULL;
-
-    if (unique_characters == 0) {
-        printf("No characters found in file. Huffman tree cannot be built.\n");
-        // Free linked lists (if not already handled)
-        linked_list_free(key, largest_freq_val);
-        return 0; // Exit gracefully
+    if (positional_count < (estimate_only ? 1 : 2) || (estimate_only && positional_count > 1) || usage_error
+        || (train && estimate_only) || ((append || message) && (train || estimate_only)) || (append && message)) {
+        print_usage(argv[0]);
+        goto cleanup;
+    }
+    if (train) {
+        result = train_table(positional[0], positional + 1, positional_count - 1, max_code_length);
+        goto cleanup;
     }
 
-    // Initialize the Min-Priority Queue for HuffmanNodes
-    // Capacity should be at least unique_characters, it will resize if needed
-    pq = create_min_pq(unique_characters + 1); // +1 just for a small buffer
+    HuffmanOptions options;
+    huffman_default_options(&options);
+    options.max_code_length = max_code_length;
+    options.block_size = block_size_given ? block_size : 0; // 0: one block per file with -S
+    options.thread_count = thread_count;
+    options.single_table = single_table;
+    options.four_streams = four_streams;
+    options.sample_size = table_sample_size;
+    options.adaptive_blocks = adaptive_blocks;
+    options.async_io = async_io;
+    // What sampling cost is only worth counting every sampled block again when it is printed
+    options.exact_sample_stats = verbosity >= 1 || stats_json;
+    if (adaptive_blocks && (single_table || table_sample_size > 0)) {
+        fprintf(stderr, "Error: -A can't be combined with -S or -s.\n");
+        goto cleanup;
+    }
+    if (table_sample_size > 0 && (single_table || max_code_length < 8)) {
+        fprintf(stderr, "Error: -s needs -L 8 or more and can't be combined with -S.\n");
+        goto cleanup;
+    }
+    if (shared_table != NULL && (single_table || table_sample_size > 0 || estimate_only)) {
+        fprintf(stderr, "Error: -t can't be combined with -S, -s or --estimate.\n");
+        goto cleanup;
+    }
 
-    // Populate PQ with initial leaf HuffmanNodes
-    // Iterate through frequencies from 1 up to largest_freq_val
-    for (int freq = 1; freq <= largest_freq_val; freq++) {
-        // For each frequency, extract characters from the linked list at that 'key' index
-        while (!is_empty_pq(pq) || key[freq] != NULL) { // Need a way to check if linked list at key[freq] is empty
-            if (key[freq] != NULL) {
-                int ch = linked_list_pop(&key[freq]);
-                if (ch != -1) { // -1 means list was empty
-                    HuffmanNode* leaf_node = create_huffman_node(ch, freq, NULL, NULL);
-                    insert_pq(pq, leaf_node);
-                } else {
-                    // This specific linked list is empty, break and move to next frequency
-                    break;
-                }
-            } else {
-                // If key[freq] is NULL, it means no characters had this frequency.
-                // Move to the next frequency.
-                break;
+    if (estimate_only) {
+        // Counting is all an estimate costs, so the input is simply read into memory
+        if (strcmp(positional[0], "-") == 0) {
+#ifdef _WIN32
+            _setmode(_fileno(stdin), _O_BINARY);
+#endif
+            if (read_whole_file(stdin, &input) != 0) {
+                goto cleanup;
             }
+        } else if (map_input_file(positional[0], &input) != 0) {
+            goto cleanup;
         }
+        result = print_estimate(&options, input.data, input.size, sample_size);
+        goto cleanup;
     }
 
-    // A crucial step that was missing: after all initial leaf nodes are inserted,
-    // the PQ needs to be ready. The loop above isn't quite right for this.
-    // Let's re-do the PQ population to be simpler and more standard:
-
-    // Repopulate PQ (correct approach)
-    // First, free the old PQ if it was created and populated incorrectly
-    if (pq != NULL) {
-        // You'll need to decide how to free nodes if they are still in PQ and not extracted.
-        // For this example, let's assume `create_min_pq` is called once and is empty before this loop.
-        free_min_pq(pq);
-        pq = create_min_pq(unique_characters + 1);
+    const char *filename = positional[0];
+    const char *output_compressed_filename = positional[1]; // Stream of self-contained blocks
+    const char *output_map_filename = positional_count > 2 ? positional[2] : NULL; // Optional map of the first block's codes
+    int read_from_stdin = strcmp(filename, "-") == 0;
+    int write_to_stdout = strcmp(output_compressed_filename, "-") == 0;
+    if (append && write_to_stdout) {
+        fprintf(stderr, "Error: --append needs a compressed file to append to, not stdout.\n");
+        goto cleanup;
     }
 
+    // Progress and statistics must not end up in the compressed data
+    FILE *info = write_to_stdout ? stderr : stdout;
 
-    for (int i = 0; i < 128; i++) {
-        if (frequency_table[i][1] > 0) {
-            HuffmanNode* leaf_node = create_huffman_node(frequency_table[i][0], frequency_table[i][1], NULL, NULL);
-            insert_pq(pq, leaf_node);
+    if (verbosity >= 1) {
+        fprintf(info, "Input Filename: %s\n", read_from_stdin ? "(stdin)" : filename);
+        fprintf(info, "Compressed Output Filename: %s\n", write_to_stdout ? "(stdout)" : output_compressed_filename);
+        if (output_map_filename != NULL) {
+            fprintf(info, "Map Output Filename: %s\n", output_map_filename);
         }
     }
 
-    // Build the Huffman Tree
-    while (pq->size > 1) { // Continue until only one node (the root) remains
-        HuffmanNode* left_child = extract_min_pq(pq);
-        HuffmanNode* right_child = extract_min_pq(pq);
-
-        if (left_child == NULL || right_child == NULL) {
-            fprintf(stderr, "Error: Not enough nodes in PQ to build tree. This shouldn't happen with correct logic.\n");
-            // Free any remaining nodes in PQ if you exit early
-            while(!is_empty_pq(pq)) {
-                free_huffman_tree(extract_min_pq(pq));
-            }
-            free_min_pq(pq);
-            linked_list_free(key, largest_freq_val);
-            return 1;
+    // A regular file is mapped (or read) exactly once and compressed block by block straight
+    // from that memory. stdin is read one block at a time into reusable buffers, so memory
+    // use stays at a few blocks per thread no matter how long the stream is.
+    if (read_from_stdin) {
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        if (message && read_whole_file(stdin, &input) != 0) { // A message is compressed in one piece
+            goto cleanup;
         }
-
-        // Create a new internal parent node
-        HuffmanNode* parent_node = create_huffman_node(-1, left_child->frequency + right_child->frequency, left_child, right_child);
-        insert_pq(pq, parent_node);
+    } else if (map_input_file(filename, &input) != 0) {
+        goto cleanup;
     }
 
-    // The last node in the PQ is the root of the Huffman tree
-    if (pq->size == 1) {
-        huffman_root = extract_min_pq(pq);
-    } else if (unique_characters == 1) {
-        // If unique_characters is 1, the while loop (pq->size > 1) never ran.
-        // The one node inserted initially is the root.
-        // Need to extract it if it's still in the PQ.
-        huffman_root = extract_min_pq(pq);
-    } else if (unique_characters > 1 && pq->size == 0) {
-        // This indicates an error where all nodes were processed but no root was formed.
-        fprintf(stderr, "Error: Huffman tree construction failed. PQ is empty but multiple unique characters were present.\n");
-        huffman_root = NULL; // Explicitly set to NULL to avoid issues
-    } else { // Should not happen
-        fprintf(stderr, "Error: Unexpected PQ size after Huffman tree construction: %d\n", pq->size);
-        huffman_root = NULL; // Explicitly set to NULL
+    if (write_to_stdout) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        outfile = stdout;
+    } else if (append) {
+        // Only the end of the existing stream is read and rewritten, so it is opened for both
+        outfile = fopen(output_compressed_filename, "r+b");
+        if (outfile == NULL && errno == ENOENT) {
+            outfile = fopen(output_compressed_filename, "w+b");
+        }
+        if (outfile == NULL) {
+            perror("Error opening compressed file for appending");
+            goto cleanup;
+        }
+    } else {
+        outfile = fopen(output_compressed_filename, "wb"); // "wb" for binary write
+        if (outfile == NULL) {
+            perror("Error opening output file for writing compressed data");
+            goto cleanup;
+        }
     }
 
-    if (huffman_root != NULL) {
-        // 1. Build Huffman Codes (this populates the huffman_codes global array)
-        build_huffman_codes(huffman_root);
-        print_huffman_codes(); // Optional: Print to console
-
-        // 2. Write the character-to-code map to the specified file
-        write_huffman_map_to_file(output_map_filename);
-
-        // 3. Encode the input file and write compressed bits to the specified output file
-        encode_and_write_file(filename, output_compressed_filename);
-        
-        // --- NEW: Display Compression Statistics ---
-        printf("\n--- Compression Statistics ---\n");
-
-        long size_before_compression = get_file_size(filename);
-        long size_compressed_data = get_file_size(output_compressed_filename);
-        long size_map_file = get_file_size(output_map_filename);
+    // The library does the block pipeline: one table per block, blocks compressed on the
+    // context's threads and written in order, then the block index and footer
+    ctx = huffman_create_context(&options);
+    if (ctx == NULL) {
+        print_context_error(&options);
+        goto cleanup;
+    }
+    if (shared_table != NULL) {
+        uint32_t table_id;
+        HuffmanStatus table_status = huffman_load_shared_table(ctx, shared_table, &table_id);
+        if (table_status == HUFFMAN_OK) {
+            table_status = huffman_use_shared_table(ctx, table_id);
+        }
+        if (table_status != HUFFMAN_OK) {
+            fprintf(stderr, "Error: Can't use shared table %s: %s.\n", shared_table, huffman_status_string(table_status));
+            goto cleanup;
+        }
+        if (verbosity >= 1) {
+            fprintf(info, "Shared Table: %08x\n", (unsigned)table_id);
+        }
+    }
 
-        if (size_before_compression != -1 && size_compressed_data != -1 && size_map_file != -1) {
-            long size_after_compression = size_compressed_data + size_map_file;
+    unsigned long long size_after_compression;
+    HuffmanStatus status;
+    if (message) {
+        status = write_message(ctx, &input, outfile, &size_after_compression);
+    } else if (append) {
+        status = read_from_stdin
+            ? huffman_append_stream(ctx, stdin, outfile, &size_after_compression)
+            : huffman_append_to_file(ctx, input.data, input.size, outfile, &size_after_compression);
+    } else {
+        status = read_from_stdin
+            ? huffman_compress_stream(ctx, stdin, outfile, &size_after_compression)
+            : huffman_compress_to_file(ctx, input.data, input.size, outfile, &size_after_compression);
+    }
+    unmap_input_file(&input);
+    if (!write_to_stdout && fclose(outfile) != 0 && status == HUFFMAN_OK) {
+        status = HUFFMAN_ERROR_IO;
+    }
+    outfile = NULL;
+    if (status != HUFFMAN_OK) {
+        print_compress_error(status, append, read_from_stdin);
+        goto cleanup;
+    }
+    result = 0;
 
-            printf("Original File: %s (Size: %ld bytes)\n", filename, size_before_compression);
-            printf("Compressed Data File: %s (Size: %ld bytes)\n", output_compressed_filename, size_compressed_data);
-            printf("Map File: %s (Size: %ld bytes)\n", output_map_filename, size_map_file);
-            printf("Total Compressed Size (Data + Map): %ld bytes\n", size_after_compression);
+    const HuffmanStats *stats = huffman_last_stats(ctx);
+    if (stats_json) {
+        print_stats_json(info, stats, thread_count);
+    }
+    if (stats->block_count > stats->raw_blocks) {
+        // The first coded block's codes are canonical, so its code lengths are enough to show them
+        HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+        init_huffman_codes_array(codes);
+        assign_canonical_codes(stats->first_block_code_lengths, codes);
+        if (verbosity >= 2) {
+            print_huffman_codes(codes, info);
+        }
 
-            if (size_before_compression > 0) {
-                double compression_ratio = (double)size_after_compression / size_before_compression;
-                double percentage_reduction = (1.0 - compression_ratio) * 100.0;
-                double percentage_of_original = compression_ratio * 100.0;
+        // Optionally export the character-to-code map (not needed for decompression)
+        if (output_map_filename != NULL) {
+            if (write_huffman_map_to_file(codes, output_map_filename) != 0) {
+                perror("Error writing map file");
+            } else if (verbosity >= 1) {
+                fprintf(info, "Huffman map of the first block written to %s\n", output_map_filename);
+            }
+        }
+    }
+    if (verbosity < 1) {
+        goto cleanup;
+    }
 
-                printf("Compression Ratio: %.2f%%\n", percentage_of_original); // Size after / Size before * 100
-                printf("Space Saved: %.2f%%\n", percentage_reduction); // (1 - Ratio) * 100
-            } else {
-                printf("Cannot calculate percentage for an empty input file.\n");
+    if (verbosity >= 2) {
+        fprintf(info, "\nCharacter Frequency Table:\n");
+        for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+            if (stats->frequencies[i] > 0) {
+                if (i >= 32 && i <= 126) {
+                    fprintf(info, "'%c'\t\t%d\t\t%llu\n", i, i, (unsigned long long)stats->frequencies[i]);
+                } else {
+                    fprintf(info, "0x%02X\t\t%d\t\t%llu\n", i, i, (unsigned long long)stats->frequencies[i]);
+                }
             }
-        } else {
-            fprintf(stderr, "Could not retrieve all file sizes for compression statistics.\n");
         }
-        printf("------------------------------\n");
+    }
 
-    } else {
-        printf("Failed to build Huffman tree. Codes cannot be generated, and file cannot be compressed.\n");
+    // --- NEW: Display Compression Statistics ---
+    // The sizes come from the encoder's byte counters, not from reopening the files
+    unsigned long long size_before_compression = stats->uncompressed_size;
+    unsigned long long stream_size = size_after_compression;
+    size_after_compression = stats->compressed_size; // With --append, only what this run added
+    fprintf(info, "\n--- Compression Statistics ---\n");
+    fprintf(info, "Original Size: %llu bytes\n", size_before_compression);
+    fprintf(info, "Compressed Size: %llu bytes (%llu blocks on %d threads, code lengths included)\n", size_after_compression, stats->block_count, thread_count);
+    if (append) {
+        fprintf(info, "Compressed File Size: %llu bytes after appending\n", stream_size);
+    }
+    if (stats->raw_blocks > 0) {
+        fprintf(info, "Stored Blocks: %llu (incompressible, copied as is)\n", stats->raw_blocks);
     }
 
-    // Free the PQ structure itself
-    free_min_pq(pq);
+    if (size_before_compression > 0) {
+        double compression_ratio = (double)size_after_compression / size_before_compression;
+        double percentage_reduction = (1.0 - compression_ratio) * 100.0;
+        double percentage_of_original = compression_ratio * 100.0;
 
-    // Free the linked lists that held character frequencies
-    printf("\nFreeing linked lists...\n");
-    linked_list_free(key, largest_freq_val);
-    printf("Linked lists freed successfully.\n");
+        fprintf(info, "Compression Ratio: %.2f%%\n", percentage_of_original); // Size after / Size before * 100
+        fprintf(info, "Space Saved: %.2f%%\n", percentage_reduction); // (1 - Ratio) * 100
+    } else {
+        fprintf(info, "Cannot calculate percentage for an empty input file.\n");
+    }
 
-    // Free the entire Huffman tree to prevent memory leaks
-    printf("Freeing Huffman tree...\n");
-    free_huffman_tree(huffman_root);
-    printf("Huffman tree freed successfully.\n");
+    // Cost of building tables from samples, compared with every block's exact histogram
+    if (stats->sampled_blocks > 0) {
+        long long loss = (long long)(stats->sampled_block_bytes - stats->exact_block_bytes);
+        fprintf(info, "Sampled Tables: %llu blocks, %llu bytes vs %llu with exact counts (%+lld bytes, %+.4f%%)\n",
+                stats->sampled_blocks, stats->sampled_block_bytes, stats->exact_block_bytes, loss,
+                100.0 * (double)loss / (double)stats->exact_block_bytes);
+    }
 
-    return 0;
-}
\ No newline at end of file
+    // Cost of capping the code length, compared with the unrestricted Huffman trees
+    if (stats->block_count > stats->raw_blocks) {
+        fprintf(info, "Max Code Length: %d bits (limit %d, unrestricted tree depth %d)\n",
+                stats->max_code_length, max_code_length, stats->optimal_max_length);
+    }
+    if (stats->optimal_bits > 0) {
+        unsigned long long penalty_bits = stats->encoded_bits - stats->optimal_bits;
+        fprintf(info, "Length Limit Penalty: %llu bits (+%.4f%% vs optimal tree)\n",
+                penalty_bits, 100.0 * (double)penalty_bits / (double)stats->optimal_bits);
+    }
+    fprintf(info, "------------------------------\n");
+
+cleanup:
+    huffman_free_context(ctx);
+    if (outfile != NULL && outfile != stdout) {
+        fclose(outfile); // Only left open on an error; the compressed file is incomplete
+    }
+    unmap_input_file(&input);
+    free(positional);
+    return result;
+}
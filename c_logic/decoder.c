@@ -1,113 +1,1050 @@
 #include "decoder.h"
+#include "canonical_codes.h" // Rebuilding canonical codes from the stored lengths
+#include "huffman_format.h"  // Stream and block layout
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h> // For strlen
-
-// External HuffmanNode creation function (from min_priority_queue.c)
-extern HuffmanNode* create_huffman_node(int ch, int freq, HuffmanNode* left, HuffmanNode* right);
-// External Huffman tree freeing function (from encoder.c)
-extern void free_huffman_tree(HuffmanNode* node);
-
-// This function builds the decoding tree from the char-to-code map
-// It's a bit tricky: for each code, you traverse/create nodes.
-HuffmanNode* build_decoding_tree_from_map_file(const char* map_filename) {
-    FILE* map_file = fopen(map_filename, "r");
-    if (map_file == NULL) {
-        perror("Error opening map file for decoding");
+#include <string.h> // For memcmp
+#include <stdint.h> // For uint64_t bit buffer
+#include "thread_pool.h" // Decoding blocks in parallel
+#include "shared_table.h" // Blocks coded with a table the caller registered
+#include "instrument.h"   // Stage timers for DecodeStats
+
+// --- Table-driven decoding ---
+
+DecodeTable* build_decode_table(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]) {
+    DecodeTable* table = (DecodeTable*)calloc(1, sizeof(DecodeTable));
+    if (table == NULL) {
         return NULL;
     }
 
-    HuffmanNode* root = create_huffman_node(-1, 0, NULL, NULL); // Root of the decoding tree
-    char code_str[MAX_CODE_LENGTH]; // Buffer for reading code strings
-    int ascii_val;
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    assign_canonical_codes(lengths, codes);
+
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (codes[i].length > table->max_length) table->max_length = codes[i].length;
+    }
+    // Size the table to the longest code, so small alphabets get small, quick-to-build tables
+    table->table_bits = table->max_length < DECODE_TABLE_BITS ? table->max_length : DECODE_TABLE_BITS;
+    if (table->table_bits == 0) table->table_bits = 1;
+    int table_bits = table->table_bits;
+
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        int len = codes[i].length;
+        if (len == 0) continue;
+        table->length_count[len]++;
+
+        if (len <= table_bits) {
+            // Every index that starts with this code decodes to the same character
+            int shift = table_bits - len;
+            unsigned int first = (unsigned int)codes[i].bits << shift;
+            unsigned int count = 1u << shift;
+            for (unsigned int j = 0; j < count; j++) {
+                table->entries[first + j].symbol = (short)i;
+                table->entries[first + j].length = (unsigned char)len;
+            }
+        } else {
+            // Code is longer than the table: its first table_bits bits send us to the slow path
+            unsigned int prefix = (unsigned int)(codes[i].bits >> (len - table_bits));
+            table->entries[prefix].symbol = -1;
+            table->entries[prefix].length = (unsigned char)table_bits;
+        }
+    }
 
-    while (fscanf(map_file, "%d %s", &ascii_val, code_str) == 2) {
-        HuffmanNode* current_node = root;
-        // Traverse the tree, creating nodes as needed
-        for (int i = 0; code_str[i] != '\0'; i++) {
-            if (code_str[i] == '0') {
-                if (current_node->left == NULL) {
-                    current_node->left = create_huffman_node(-1, 0, NULL, NULL);
+    // Canonical codes of one length are consecutive, so a length's first code and
+    // count are enough to find any of its characters
+    int index = 0;
+    for (int len = 1; len <= table->max_length; len++) {
+        table->first_index[len] = index;
+        for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+            if (codes[i].length == len) {
+                if (index == table->first_index[len]) {
+                    table->first_code[len] = codes[i].bits;
                 }
-                current_node = current_node->left;
-            } else if (code_str[i] == '1') {
-                if (current_node->right == NULL) {
-                    current_node->right = create_huffman_node(-1, 0, NULL, NULL);
+                table->sorted_symbols[index++] = (unsigned char)i;
+            }
+        }
+    }
+
+    // With every code inside the table width, the bits after an index's first code are known
+    // too: chain single lookups on the shifted index while the next code still fits
+    table->multi_symbol = table->max_length <= table_bits;
+    if (table->multi_symbol) {
+        unsigned int mask = (1u << table_bits) - 1;
+        for (unsigned int i = 0; i <= mask; i++) {
+            MultiDecodeEntry* multi = &table->multi[i];
+            int used = 0;
+            while (multi->count < DECODE_MULTI_MAX_SYMBOLS) {
+                const DecodeEntry* entry = &table->entries[(i << used) & mask];
+                if (entry->length == 0 || used + entry->length > table_bits) break;
+                multi->symbols[multi->count++] = (unsigned char)entry->symbol;
+                used += entry->length;
+            }
+            multi->length = (unsigned char)used;
+        }
+    }
+
+    return table;
+}
+
+void free_decode_table(DecodeTable* table) {
+    free(table);
+}
+
+#define DECODE_IO_BUFFER_SIZE (64 * 1024)
+
+// Reads the compressed stream in large chunks and keeps up to 64 bits ready for lookups.
+// Bits are kept MSB-aligned in 'bits', so the next code always starts at bit 63.
+// A reader without a file reads a block that is already in memory (a mapped file).
+typedef struct BitReader {
+    FILE* file;                     // NULL when 'data' already holds all the input
+    unsigned char* buffer;          // Read buffer for a file (DECODE_IO_BUFFER_SIZE bytes)
+    const unsigned char* data;      // Bytes being read: 'buffer', or the block in memory
+    size_t pos;
+    size_t len;
+    unsigned long long bits_left;   // Bits of the current block not yet loaded into 'bits'
+    uint64_t bits;
+    int count;                      // Number of valid bits in 'bits'
+    // Stream decoding only: time in fread and in fwrite of the output, and bytes read
+    unsigned long long read_ns;
+    unsigned long long write_ns;
+    unsigned long long bytes_read;
+    AsyncFile* ahead;               // Set to take the input from its read-ahead thread instead of fread
+    AsyncFile* behind;              // Set to hand the output to its writing thread instead of fwrite
+} BitReader;
+
+// Returns the next byte of the stream, or -1 at end of file
+static int read_byte(BitReader* reader) {
+    if (reader->pos == reader->len) {
+        if (reader->file == NULL) {
+            return -1;
+        }
+        uint64_t start = instrument_now_ns();
+        if (reader->ahead != NULL) {
+            reader->data = async_next(reader->ahead, &reader->len); // Decoded in place, no copy
+        } else {
+            reader->len = fread(reader->buffer, 1, DECODE_IO_BUFFER_SIZE, reader->file);
+        }
+        reader->read_ns += instrument_now_ns() - start;
+        reader->bytes_read += reader->len;
+        reader->pos = 0;
+        if (reader->len == 0) {
+            return -1;
+        }
+    }
+    return reader->data[reader->pos++];
+}
+
+// Writes decoded bytes to output_file, timed into the reader. Returns 0, or -1 if the write failed.
+static int write_output(BitReader* reader, const unsigned char* out, size_t n, FILE* output_file) {
+    uint64_t start = instrument_now_ns();
+    int failed = reader->behind != NULL ? async_write(reader->behind, out, n) != 0
+                                        : fwrite(out, 1, n, output_file) != n;
+    reader->write_ns += instrument_now_ns() - start;
+    return failed ? -1 : 0;
+}
+
+static int read_bytes(BitReader* reader, unsigned char* out, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int byte = read_byte(reader);
+        if (byte < 0) return -1;
+        out[i] = (unsigned char)byte;
+    }
+    return 0;
+}
+
+static int read_varint(BitReader* reader, unsigned long long* value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = read_byte(reader);
+        if (byte < 0) return -1;
+        *value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1; // Longer than any 64-bit value
+}
+
+// One 8-byte load for a reader with fewer than 64 bits buffered and at least 8 bytes and 64
+// bits of its block left. Only the whole bytes that fit are counted; the bits of the next byte
+// that land below them are the same bits that byte will bring later.
+static inline void refill_bits_unchecked(BitReader* reader) {
+    const unsigned char* p = reader->data + reader->pos;
+    uint64_t word = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32)
+                  | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+    int bytes = (64 - reader->count) >> 3;
+    reader->bits |= word >> reader->count;
+    reader->pos += (size_t)bytes;
+    reader->count += bytes * 8;
+    reader->bits_left -= (unsigned long long)bytes * 8;
+}
+
+// Loads whole bytes of the current block until at least 57 bits are buffered.
+// Only the block's real bits are counted, so padding in its last byte is never decoded.
+static inline void refill_bits(BitReader* reader) {
+    if (reader->count <= 56 && reader->bits_left >= 64 && reader->len - reader->pos >= 8) {
+        refill_bits_unchecked(reader);
+        return;
+    }
+    while (reader->count <= 56 && reader->bits_left > 0) {
+        int byte = read_byte(reader);
+        if (byte < 0) {
+            reader->bits_left = 0; // Stream shorter than the block header promised
+            return;
+        }
+        reader->bits |= (uint64_t)byte << (56 - reader->count);
+        int loaded = reader->bits_left >= 8 ? 8 : (int)reader->bits_left;
+        reader->count += loaded;
+        reader->bits_left -= loaded;
+    }
+}
+
+static void consume_bits(BitReader* reader, int n) {
+    reader->bits <<= n;
+    reader->count -= n;
+}
+
+// Slow path for codes longer than the table: try each length in turn
+static int decode_long_code(const DecodeTable* table, const BitReader* reader, int* length) {
+    for (int len = table->table_bits + 1; len <= table->max_length && len <= reader->count; len++) {
+        uint64_t code = reader->bits >> (64 - len);
+        uint64_t offset = code - table->first_code[len];
+        if (code >= table->first_code[len] && offset < (uint64_t)table->length_count[len]) {
+            *length = len;
+            return table->sorted_symbols[table->first_index[len] + offset];
+        }
+    }
+    return -1;
+}
+
+// Decodes the next character, or returns -1 if the bits don't form a valid code
+static inline int decode_next_symbol(BitReader* reader, const DecodeTable* table) {
+    refill_bits(reader);
+
+    // Look up the next table_bits bits (zero-filled past the end of the data)
+    const DecodeEntry* entry = &table->entries[reader->bits >> (64 - table->table_bits)];
+    int ch = entry->symbol;
+    int length = entry->length;
+    if (ch < 0 && length != 0) {
+        ch = decode_long_code(table, reader, &length);
+    }
+    if (ch < 0 || length == 0 || length > reader->count) {
+        return -1;
+    }
+    consume_bits(reader, length);
+    return ch;
+}
+
+// Where a block's bits are: one stream, or the substreams of a HUFFMAN_BLOCK_FLAG_4_STREAMS block
+typedef struct BlockStreams {
+    int count;                                      // 1 or HUFFMAN_STREAM_COUNT
+    unsigned long long bits[HUFFMAN_STREAM_COUNT];  // Exact bit count of each substream
+    size_t payload_size;                            // Bytes of all (padded) substreams together
+} BlockStreams;
+
+// Returns 0 if a block type byte is a raw block, or a Huffman block with flags this decoder knows
+static int check_block_type(int block_type) {
+    if (block_type == HUFFMAN_BLOCK_RAW) {
+        return 0;
+    }
+    int known_flags = HUFFMAN_BLOCK_FLAG_4_STREAMS | HUFFMAN_BLOCK_FLAG_SHARED_TABLE;
+    return (block_type & HUFFMAN_BLOCK_TYPE_MASK) == HUFFMAN_BLOCK_HUFFMAN
+           && (block_type & ~HUFFMAN_BLOCK_TYPE_MASK & ~known_flags) == 0 ? 0 : -1;
+}
+
+// Reads the rest of a block header after its type byte and sets the reader up for its bits.
+// For a 4-stream block it reads the jump table into streams instead; the substreams follow.
+// The block's lookup table is returned in *table: a shared table's from the set, or a new
+// one built from the stored code lengths, which is also returned in *owned for the caller
+// to free (*owned is NULL for a shared table). Returns 0, -1 for a corrupt header, -2 for a
+// shared table id the set doesn't have, or -3 if there is no memory for the lookup table.
+static int read_block_header(BitReader* reader, int block_type, unsigned long long* symbol_count,
+                             BlockStreams* streams, const SharedTables* shared,
+                             const DecodeTable** table, DecodeTable** owned) {
+    unsigned long long bit_count;
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    const SharedTable* shared_table = NULL;
+    if (read_varint(reader, symbol_count) != 0 || read_varint(reader, &bit_count) != 0) {
+        return -1;
+    }
+    if (block_type & HUFFMAN_BLOCK_FLAG_SHARED_TABLE) {
+        unsigned char id_bytes[4];
+        if (read_bytes(reader, id_bytes, sizeof(id_bytes)) != 0) {
+            return -1;
+        }
+        uint32_t table_id = (uint32_t)id_bytes[0] | (uint32_t)id_bytes[1] << 8 | (uint32_t)id_bytes[2] << 16 | (uint32_t)id_bytes[3] << 24;
+        shared_table = shared != NULL ? find_shared_table(shared, table_id) : NULL;
+        if (shared_table == NULL) {
+            return -2;
+        }
+    } else {
+        unsigned char table_bytes[CODE_LENGTHS_MAX_BYTES];
+        size_t table_size = 0;
+        if (read_bytes(reader, table_bytes, CODE_LENGTHS_PREFIX_BYTES) != 0
+            || (table_size = code_lengths_table_size(table_bytes)) == 0
+            || read_bytes(reader, table_bytes + CODE_LENGTHS_PREFIX_BYTES, table_size - CODE_LENGTHS_PREFIX_BYTES) != 0
+            || read_code_lengths(table_bytes, table_size, lengths) < 0) {
+            return -1;
+        }
+    }
+
+    streams->count = block_type & HUFFMAN_BLOCK_FLAG_4_STREAMS ? HUFFMAN_STREAM_COUNT : 1;
+    streams->bits[0] = bit_count;
+    if (streams->count > 1) {
+        // The substreams are held in memory, so their size must fit in a size_t
+        if (bit_count >= (unsigned long long)(SIZE_MAX >> 1)) {
+            return -1;
+        }
+        unsigned long long rest = bit_count;
+        for (int i = 0; i < HUFFMAN_STREAM_COUNT - 1; i++) {
+            if (read_varint(reader, &streams->bits[i]) != 0 || streams->bits[i] > rest) {
+                return -1;
+            }
+            rest -= streams->bits[i];
+        }
+        streams->bits[HUFFMAN_STREAM_COUNT - 1] = rest;
+    }
+    streams->payload_size = 0;
+    for (int i = 0; i < streams->count; i++) {
+        streams->payload_size += (size_t)((streams->bits[i] + 7) / 8);
+    }
+    reader->bits_left = streams->count == 1 ? bit_count : 0;
+    reader->bits = 0;
+    reader->count = 0;
+    *owned = shared_table == NULL ? build_decode_table(lengths) : NULL;
+    *table = shared_table == NULL ? *owned : shared_table->decode_table;
+    return *table != NULL ? 0 : -3;
+}
+
+// One multi-symbol lookup: stores DECODE_MULTI_MAX_SYMBOLS bytes at out and returns how many
+// of them are real. An invalid code (count 0) consumes nothing and is reported through
+// *invalid, so the caller checks once per batch.
+static inline size_t decode_multi_symbols(BitReader* reader, const DecodeTable* table, unsigned char* out, int* invalid) {
+    const MultiDecodeEntry* entry = &table->multi[reader->bits >> (64 - table->table_bits)];
+    memcpy(out, entry->symbols, DECODE_MULTI_MAX_SYMBOLS);
+    *invalid |= entry->count == 0;
+    reader->bits <<= entry->length;
+    reader->count -= entry->length;
+    return entry->count;
+}
+
+// One single-symbol lookup for tables with codes longer than the table, without the checks of
+// decode_next_symbol: the caller refilled and knows the buffered bits hold the code. An invalid
+// code consumes nothing and is reported through *invalid, as in decode_multi_symbols.
+static inline unsigned char decode_symbol_unchecked(BitReader* reader, const DecodeTable* table, int* invalid) {
+    const DecodeEntry* entry = &table->entries[reader->bits >> (64 - table->table_bits)];
+    int ch = entry->symbol;
+    int length = entry->length;
+    if (ch < 0) {
+        ch = length != 0 ? decode_long_code(table, reader, &length) : -1;
+        if (ch < 0) {
+            *invalid = 1;
+            return 0;
+        }
+    }
+    consume_bits(reader, length);
+    return (unsigned char)ch;
+}
+
+static inline int reader_has_word(const BitReader* reader) {
+    return reader->len - reader->pos >= 8 && reader->bits_left >= 64;
+}
+
+// Lookups per reader between refills of the fast loops: a refill leaves at least 57 bits, and
+// a lookup consumes at most DECODE_TABLE_BITS of them
+#define DECODE_FAST_LOOKUPS (57 / DECODE_TABLE_BITS)
+// Most characters one batch of lookups can produce (or store) per reader
+#define DECODE_FAST_BATCH (DECODE_FAST_LOOKUPS * DECODE_MULTI_MAX_SYMBOLS)
+
+// Single-symbol lookups per refill for a table with longer codes: as many of its longest code
+// as 57 bits hold, 0 if even one doesn't fit (the checked path then decodes everything)
+static inline int decode_fast_lookups(const DecodeTable* table) {
+    return table->multi_symbol ? DECODE_FAST_LOOKUPS : 57 / table->max_length;
+}
+
+// Decodes the substreams of a 4-stream block, all of them in memory at payload, into
+// out[0..symbol_count). The four readers are independent, so the loop keeps four lookups in
+// flight instead of waiting for each code length before the next lookup can start.
+static int decode_streams(const unsigned char* payload, const BlockStreams* streams, const DecodeTable* table,
+                          unsigned long long symbol_count, unsigned char* out) {
+    BitReader readers[HUFFMAN_STREAM_COUNT];
+    unsigned char* outs[HUFFMAN_STREAM_COUNT];
+    size_t sizes[HUFFMAN_STREAM_COUNT];
+    size_t segment = (size_t)HUFFMAN_STREAM_SEGMENT(symbol_count);
+    size_t offset = 0;
+    for (int i = 0; i < HUFFMAN_STREAM_COUNT; i++) {
+        size_t start = segment * i < symbol_count ? segment * i : (size_t)symbol_count;
+        sizes[i] = (size_t)symbol_count - start > segment ? segment : (size_t)symbol_count - start;
+        outs[i] = out + start;
+        size_t bytes = (size_t)((streams->bits[i] + 7) / 8);
+        BitReader reader = {.data = payload + offset, .len = bytes, .bits_left = streams->bits[i]};
+        readers[i] = reader;
+        offset += bytes;
+    }
+
+    size_t p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+    int lookups = decode_fast_lookups(table);
+    if (lookups > 0) {
+        // After one refill per reader, a batch of lookups per substream needs no further
+        // checks. Valid codes are at least one bit long, so no reader has 64 bits buffered at
+        // a refill.
+        size_t batch = table->multi_symbol ? DECODE_FAST_BATCH : (size_t)lookups;
+        BitReader r0 = readers[0], r1 = readers[1], r2 = readers[2], r3 = readers[3];
+        unsigned char *o0 = outs[0], *o1 = outs[1], *o2 = outs[2], *o3 = outs[3];
+        int invalid = 0;
+        while (!invalid && sizes[0] - p0 >= batch && sizes[1] - p1 >= batch
+               && sizes[2] - p2 >= batch && sizes[3] - p3 >= batch
+               && reader_has_word(&r0) && reader_has_word(&r1) && reader_has_word(&r2) && reader_has_word(&r3)) {
+            refill_bits_unchecked(&r0);
+            refill_bits_unchecked(&r1);
+            refill_bits_unchecked(&r2);
+            refill_bits_unchecked(&r3);
+            if (table->multi_symbol) {
+                for (int k = 0; k < DECODE_FAST_LOOKUPS; k++) {
+                    p0 += decode_multi_symbols(&r0, table, o0 + p0, &invalid);
+                    p1 += decode_multi_symbols(&r1, table, o1 + p1, &invalid);
+                    p2 += decode_multi_symbols(&r2, table, o2 + p2, &invalid);
+                    p3 += decode_multi_symbols(&r3, table, o3 + p3, &invalid);
                 }
-                current_node = current_node->right;
             } else {
-                fprintf(stderr, "Error: Invalid character in Huffman code string in map file: %s\n", code_str);
-                // Free partially built tree before returning NULL
-                free_huffman_tree(root);
-                fclose(map_file);
-                return NULL;
+                for (int k = 0; k < lookups; k++) {
+                    o0[p0++] = decode_symbol_unchecked(&r0, table, &invalid);
+                    o1[p1++] = decode_symbol_unchecked(&r1, table, &invalid);
+                    o2[p2++] = decode_symbol_unchecked(&r2, table, &invalid);
+                    o3[p3++] = decode_symbol_unchecked(&r3, table, &invalid);
+                }
             }
         }
-        // At the end of the code string, we should be at a leaf node
-        // (or an internal node that needs to become a leaf for this character)
-        if (current_node->left != NULL || current_node->right != NULL) {
-            fprintf(stderr, "Warning: Code for %d (%s) overlaps with another code path. This map is invalid for Huffman.\n", ascii_val, code_str);
-            // This indicates a non-prefix code, which Huffman guarantees, so this would imply a bad map file.
+        if (invalid) {
+            return -1;
         }
-        current_node->ch = ascii_val; // Set the character for this leaf node
-        // Frequency is not strictly needed for decoding, but set to 0 for consistency
-        current_node->frequency = 0;
+        readers[0] = r0;
+        readers[1] = r1;
+        readers[2] = r2;
+        readers[3] = r3;
     }
 
-    fclose(map_file);
-    return root;
+    // Segments only get shorter, so the last one is where the four-way part ends
+    size_t common = sizes[HUFFMAN_STREAM_COUNT - 1];
+    for (; p0 < common && p1 < common && p2 < common && p3 < common; p0++, p1++, p2++, p3++) {
+        int c0 = decode_next_symbol(&readers[0], table);
+        int c1 = decode_next_symbol(&readers[1], table);
+        int c2 = decode_next_symbol(&readers[2], table);
+        int c3 = decode_next_symbol(&readers[3], table);
+        if ((c0 | c1 | c2 | c3) < 0) {
+            return -1;
+        }
+        outs[0][p0] = (unsigned char)c0;
+        outs[1][p1] = (unsigned char)c1;
+        outs[2][p2] = (unsigned char)c2;
+        outs[3][p3] = (unsigned char)c3;
+    }
+    size_t done[HUFFMAN_STREAM_COUNT] = {p0, p1, p2, p3};
+    for (int i = 0; i < HUFFMAN_STREAM_COUNT; i++) {
+        for (size_t k = done[i]; k < sizes[i]; k++) {
+            int ch = decode_next_symbol(&readers[i], table);
+            if (ch < 0) {
+                return -1;
+            }
+            outs[i][k] = (unsigned char)ch;
+        }
+        // Every substream must end exactly where the jump table said it would
+        if (readers[i].count != 0 || readers[i].bits_left != 0) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
-// Function to read and decode bits from the compressed file
-void decode_and_write_file(const char* compressed_filename, const char* output_filename, HuffmanNode* decoding_tree_root) {
-    FILE* compressed_file = fopen(compressed_filename, "rb"); // "rb" for binary read
-    if (compressed_file == NULL) {
-        perror("Error opening compressed file for decoding");
-        return;
+// Decodes the bitstream of one block into out (out_capacity bytes). When out fills up it is
+// flushed to output_file; without an output file, out must be big enough for the whole block.
+static int decode_block(BitReader* reader, const DecodeTable* table, unsigned long long symbol_count,
+                        unsigned char* out, size_t out_capacity, size_t* out_pos, FILE* output_file) {
+    int lookups = decode_fast_lookups(table);
+    size_t batch = table->multi_symbol ? DECODE_FAST_BATCH : (size_t)lookups;
+    for (unsigned long long n = 0; n < symbol_count; n++) {
+        if (lookups > 0) {
+            // Batches of unchecked lookups while the read buffer, the block and out all have
+            // room for one; the checked path below crosses read buffer refills, output flushes
+            // and the block's last bits
+            int invalid = 0;
+            size_t pos = *out_pos;
+            while (!invalid && symbol_count - n >= batch && reader_has_word(reader)) {
+                if (out_capacity - pos < batch) {
+                    if (output_file == NULL) break;
+                    if (write_output(reader, out, pos, output_file) != 0) {
+                        return -1;
+                    }
+                    pos = 0;
+                }
+                refill_bits_unchecked(reader);
+                size_t start = pos;
+                if (table->multi_symbol) {
+                    for (int k = 0; k < DECODE_FAST_LOOKUPS; k++) {
+                        pos += decode_multi_symbols(reader, table, out + pos, &invalid);
+                    }
+                } else {
+                    for (int k = 0; k < lookups; k++) {
+                        out[pos++] = decode_symbol_unchecked(reader, table, &invalid);
+                    }
+                }
+                n += pos - start;
+            }
+            *out_pos = pos;
+            if (invalid) {
+                return -1;
+            }
+            if (n == symbol_count) {
+                break;
+            }
+        }
+
+        int ch = decode_next_symbol(reader, table);
+        if (ch < 0) {
+            return -1;
+        }
+
+        if (*out_pos == out_capacity) {
+            if (output_file == NULL) {
+                return -1;
+            }
+            if (write_output(reader, out, *out_pos, output_file) != 0) {
+                return -1;
+            }
+            *out_pos = 0;
+        }
+        out[(*out_pos)++] = (unsigned char)ch;
     }
 
-    FILE* output_file = fopen(output_filename, "w"); // "w" for text write
-    if (output_file == NULL) {
-        perror("Error opening output file for decompressed data");
-        fclose(compressed_file);
-        return;
+    // The block must end exactly where its header said it would
+    return (reader->count == 0 && reader->bits_left == 0) ? 0 : -1;
+}
+
+int decode_bitstream(const unsigned char* data, unsigned long long bit_count, const DecodeTable* table,
+                     unsigned char* out, size_t symbol_count) {
+    BitReader reader = {.data = data, .len = (size_t)((bit_count + 7) / 8), .bits_left = bit_count};
+    size_t out_pos = 0;
+    return decode_block(&reader, table, symbol_count, out, symbol_count, &out_pos, NULL);
+}
+
+// Copies the n bytes of a raw block into out (out_capacity bytes), flushing it to output_file
+// whenever it fills up, in chunks straight from the read buffer
+static int copy_raw_block(BitReader* reader, unsigned long long n, unsigned char* out, size_t out_capacity,
+                          size_t* out_pos, FILE* output_file) {
+    while (n > 0) {
+        if (*out_pos == out_capacity) {
+            if (write_output(reader, out, *out_pos, output_file) != 0) {
+                return -1;
+            }
+            *out_pos = 0;
+        }
+        if (reader->pos == reader->len) {
+            int byte = read_byte(reader); // Refills the read buffer
+            if (byte < 0) return -1;
+            out[(*out_pos)++] = (unsigned char)byte;
+            n--;
+            continue;
+        }
+        size_t chunk = reader->len - reader->pos;
+        if (chunk > n) chunk = (size_t)n;
+        if (chunk > out_capacity - *out_pos) chunk = out_capacity - *out_pos;
+        memcpy(out + *out_pos, reader->data + reader->pos, chunk);
+        reader->pos += chunk;
+        *out_pos += chunk;
+        n -= chunk;
     }
+    return 0;
+}
 
-    unsigned char byte_buffer;
-    int bit_index = 0; // Current bit within the byte (0-7)
-    HuffmanNode* current_decode_node = decoding_tree_root;
-    int bytes_read;
+// Reads the n bytes of a 4-stream block's substreams into *buffer, growing it only as the
+// bytes actually arrive, so a corrupt header can't make the decoder allocate more than the
+// input really holds. Returns 0, -1 if the input ends first, or -3 if the buffer can't grow.
+static int read_payload(BitReader* reader, size_t n, unsigned char** buffer, size_t* capacity) {
+    size_t have = 0;
+    while (have < n) {
+        if (have == *capacity) {
+            size_t grown = *capacity > 0 ? *capacity * 2 : DECODE_IO_BUFFER_SIZE;
+            if (grown > n) grown = n;
+            unsigned char* bigger = (unsigned char*)realloc(*buffer, grown);
+            if (bigger == NULL) {
+                return -3;
+            }
+            *buffer = bigger;
+            *capacity = grown;
+        }
+        if (reader->pos == reader->len) {
+            int byte = read_byte(reader); // Refills the read buffer
+            if (byte < 0) return -1;
+            (*buffer)[have++] = (unsigned char)byte;
+            continue;
+        }
+        size_t chunk = reader->len - reader->pos;
+        if (chunk > n - have) chunk = n - have;
+        if (chunk > *capacity - have) chunk = *capacity - have;
+        memcpy(*buffer + have, reader->data + reader->pos, chunk);
+        reader->pos += chunk;
+        have += chunk;
+    }
+    return 0;
+}
 
-    // Read the first byte
-    bytes_read = fread(&byte_buffer, 1, 1, compressed_file);
+// Bytes of the stream the reader has consumed so far
+static unsigned long long reader_offset(const BitReader* reader) {
+    return reader->bytes_read - (unsigned long long)(reader->len - reader->pos);
+}
 
-    while (bytes_read > 0) {
-        for (bit_index = 0; bit_index < 8; bit_index++) {
-            // Get the current bit (MSB first: 7 - bit_index)
-            int bit = (byte_buffer >> (7 - bit_index)) & 1;
+// Reads the block index and footer that follow the END byte at index_offset - 1. They are
+// the stream's trailer of totals: they must list block_count blocks whose sizes add up to the
+// decompressed_size bytes decoded and to the bytes between the stream header and the END byte,
+// point back at index_offset, and be the last bytes of the stream.
+static int check_block_index(BitReader* reader, unsigned long long block_count,
+                             unsigned long long decompressed_size, unsigned long long index_offset) {
+    unsigned long long listed_blocks, uncompressed_size, compressed_size;
+    unsigned long long uncompressed_total = 0, compressed_total = 0;
+    if (read_varint(reader, &listed_blocks) != 0 || listed_blocks != block_count) {
+        return -1;
+    }
+    for (unsigned long long i = 0; i < listed_blocks; i++) {
+        if (read_varint(reader, &uncompressed_size) != 0 || read_varint(reader, &compressed_size) != 0) {
+            return -1;
+        }
+        uncompressed_total += uncompressed_size;
+        compressed_total += compressed_size;
+    }
+    unsigned char footer[HUFFMAN_FOOTER_SIZE];
+    if (read_bytes(reader, footer, HUFFMAN_FOOTER_SIZE) != 0
+        || memcmp(footer + 8, HUFFMAN_INDEX_MAGIC, HUFFMAN_INDEX_MAGIC_SIZE) != 0
+        || read_byte(reader) >= 0) {
+        return -1;
+    }
+    unsigned long long listed_offset = 0;
+    for (int i = 7; i >= 0; i--) {
+        listed_offset = (listed_offset << 8) | footer[i];
+    }
+    if (listed_offset != index_offset || uncompressed_total != decompressed_size
+        || compressed_total != index_offset - HUFFMAN_STREAM_HEADER_SIZE - 1) {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to read a compressed stream block by block and write the decoded characters
+long long decode_and_write_file(FILE* compressed_file, FILE* output_file, const SharedTables* shared,
+                                AsyncFile* input_ahead, AsyncFile* output_behind, DecodeStats* stats) {
+    BitReader* reader = (BitReader*)malloc(sizeof(BitReader));
+    unsigned char* read_buffer = (unsigned char*)malloc(DECODE_IO_BUFFER_SIZE);
+    unsigned char* out_buffer = (unsigned char*)malloc(DECODE_IO_BUFFER_SIZE);
+    if (reader == NULL || read_buffer == NULL || out_buffer == NULL) {
+        free(out_buffer);
+        free(read_buffer);
+        free(reader);
+        if (stats != NULL) {
+            memset(stats, 0, sizeof(*stats));
+        }
+        return -3;
+    }
+    reader->file = compressed_file;
+    reader->buffer = read_buffer;
+    reader->data = read_buffer;
+    reader->pos = 0;
+    reader->len = 0;
+    reader->bits_left = 0;
+    reader->bits = 0;
+    reader->count = 0;
+    reader->read_ns = 0;
+    reader->write_ns = 0;
+    reader->bytes_read = 0;
+    reader->ahead = input_ahead;
+    reader->behind = output_behind;
+    if (input_ahead != NULL) async_start(input_ahead, compressed_file, ASYNC_READ);
+    if (output_behind != NULL) async_start(output_behind, output_file, ASYNC_WRITE);
+    uint64_t start = instrument_now_ns();
+    unsigned long long table_ns = 0;
+
+    long long total_output = 0;
+    unsigned long long block_count = 0;
+    unsigned long long raw_blocks = 0;
+    size_t out_pos = 0;
+    // 4-stream blocks are decoded whole: their substreams and output are kept here
+    unsigned char* payload = NULL;
+    size_t payload_capacity = 0;
+    unsigned char* block_out = NULL;
+    size_t block_out_capacity = 0;
+    unsigned char header[HUFFMAN_STREAM_HEADER_SIZE];
+    if (read_bytes(reader, header, sizeof(header)) != 0
+        || memcmp(header, HUFFMAN_MAGIC, HUFFMAN_MAGIC_SIZE) != 0
+        || header[3] != HUFFMAN_FORMAT_VERSION) {
+        total_output = -1; // Not a stream of this format version
+    }
 
-            if (bit == 0) {
-                current_decode_node = current_decode_node->left;
-            } else { // bit == 1
-                current_decode_node = current_decode_node->right;
+    while (total_output >= 0) {
+        int block_type = read_byte(reader);
+        if (block_type == HUFFMAN_BLOCK_END) {
+            // A streaming decoder doesn't need the block index, but checking it against what
+            // was decoded catches truncated or spliced files, and reading it to the end never
+            // leaves a compressor writing into a closed pipe
+            if (check_block_index(reader, block_count, (unsigned long long)total_output, reader_offset(reader)) != 0) {
+                total_output = -1;
             }
+            break;
+        }
+        if (check_block_type(block_type) != 0) {
+            total_output = -1; // Unknown block type, or the input ended without an END byte
+            break;
+        }
+        if (block_type == HUFFMAN_BLOCK_RAW) {
+            unsigned long long raw_size;
+            if (read_varint(reader, &raw_size) != 0
+                || copy_raw_block(reader, raw_size, out_buffer, DECODE_IO_BUFFER_SIZE, &out_pos, output_file) != 0) {
+                total_output = -1;
+                break;
+            }
+            total_output += (long long)raw_size;
+            block_count++;
+            raw_blocks++;
+            continue;
+        }
 
-            // Check if we've reached a leaf node (a character)
-            if (current_decode_node->left == NULL && current_decode_node->right == NULL) {
-                fputc(current_decode_node->ch, output_file);
-                current_decode_node = decoding_tree_root; // Reset to root for next character
+        unsigned long long symbol_count;
+        BlockStreams streams;
+        const DecodeTable* table;
+        DecodeTable* owned;
+        uint64_t header_start = instrument_now_ns();
+        unsigned long long read_before = reader->read_ns;
+        int header_status = read_block_header(reader, block_type, &symbol_count, &streams, shared, &table, &owned);
+        table_ns += instrument_now_ns() - header_start - (reader->read_ns - read_before);
+        if (header_status != 0) {
+            total_output = header_status;
+            break;
+        }
+
+        int status;
+        if (streams.count == 1) {
+            status = decode_block(reader, table, symbol_count, out_buffer, DECODE_IO_BUFFER_SIZE, &out_pos, output_file);
+        } else {
+            // Every code is at least one bit, which bounds the output once the bits are read
+            status = read_payload(reader, streams.payload_size, &payload, &payload_capacity);
+            if (status == 0 && symbol_count > (unsigned long long)streams.payload_size * 8) {
+                status = -1;
             }
+            if (status == 0 && symbol_count > block_out_capacity) {
+                free(block_out);
+                block_out = (unsigned char*)malloc((size_t)symbol_count);
+                block_out_capacity = block_out != NULL ? (size_t)symbol_count : 0;
+                if (block_out == NULL) {
+                    status = -3;
+                }
+            }
+            if (status == 0) {
+                status = decode_streams(payload, &streams, table, symbol_count, block_out);
+            }
+            if (status == 0) {
+                // Whatever earlier one-stream blocks left in out_buffer goes first
+                if ((out_pos > 0 && write_output(reader, out_buffer, out_pos, output_file) != 0)
+                    || write_output(reader, block_out, (size_t)symbol_count, output_file) != 0) {
+                    free_decode_table(owned);
+                    total_output = -1;
+                    out_pos = 0;
+                    break;
+                }
+                out_pos = 0;
+            }
+        }
+        free_decode_table(owned);
+        if (status != 0) {
+            total_output = status; // A bad or truncated code, or no memory for the block
+            break;
+        }
+        total_output += (long long)symbol_count;
+        block_count++;
+    }
+
+    if (out_pos > 0 && write_output(reader, out_buffer, out_pos, output_file) != 0) {
+        if (total_output >= 0) total_output = -1;
+    }
+    if (output_behind != NULL) {
+        uint64_t stop_start = instrument_now_ns(); // Waiting for the writer to catch up
+        if (async_stop(output_behind) != 0 && total_output >= 0) {
+            total_output = -1;
         }
-        // Read the next byte
-        bytes_read = fread(&byte_buffer, 1, 1, compressed_file);
+        reader->write_ns += instrument_now_ns() - stop_start;
+    }
+    if (input_ahead != NULL) {
+        async_stop(input_ahead); // A read error already ended the stream early
+    }
+    if (fflush(output_file) != 0) {
+        total_output = -1;
+    }
+    if (stats != NULL) {
+        // Whatever isn't headers or I/O is decoding
+        memset(stats, 0, sizeof(*stats));
+        stats->block_count = block_count;
+        stats->raw_blocks = raw_blocks;
+        stats->compressed_bytes = reader->bytes_read;
+        stats->table_ns = table_ns;
+        stats->read_ns = reader->read_ns;
+        stats->write_ns = reader->write_ns;
+        uint64_t elapsed = instrument_now_ns() - start;
+        unsigned long long other = table_ns + reader->read_ns + reader->write_ns;
+        stats->decode_ns = elapsed > other ? elapsed - other : 0;
     }
 
-    // --- IMPORTANT NOTE ---
-    // The current bit-reading loop assumes the compressed file ends exactly on a byte boundary
-    // AND that there are no padding bits. In a real compressor, you'd need to store
-    // the *actual* number of bits in the last byte (if it's not a full 8 bits) in the header.
-    // For your visualizer, you might simplify or assume full bytes for now.
+    free(block_out);
+    free(payload);
+    free(out_buffer);
+    free(read_buffer);
+    free(reader);
+    return total_output;
+}
 
-    fclose(compressed_file);
-    fclose(output_file);
+// --- Random access through the block index ---
+
+int check_stream_header(const unsigned char* data, size_t size) {
+    if (size < HUFFMAN_STREAM_HEADER_SIZE
+        || memcmp(data, HUFFMAN_MAGIC, HUFFMAN_MAGIC_SIZE) != 0
+        || data[3] != HUFFMAN_FORMAT_VERSION) {
+        return -1;
+    }
+    return 0;
+}
+
+int read_block_symbol_count(const unsigned char* block, size_t block_size, unsigned long long* symbol_count) {
+    // Raw and Huffman blocks both start with their character count
+    BitReader reader = {.data = block, .len = block_size};
+    int block_type = read_byte(&reader);
+    if (block_type < 0 || check_block_type(block_type) != 0) {
+        return -1;
+    }
+    return read_varint(&reader, symbol_count);
+}
+
+long long decode_block_to_memory(const unsigned char* block, size_t block_size, unsigned char* out, size_t out_size,
+                                 const SharedTables* shared, DecodeStats* stats) {
+    BitReader reader = {.data = block, .len = block_size};
+    uint64_t start = instrument_now_ns();
+    if (stats != NULL) {
+        stats->block_count++;
+        stats->compressed_bytes += block_size;
+    }
+
+    unsigned long long symbol_count;
+    BlockStreams streams;
+    const DecodeTable* table;
+    DecodeTable* owned;
+    int block_type = read_byte(&reader);
+    if (block_type == HUFFMAN_BLOCK_RAW) {
+        // Stored bytes: the rest of the block, exactly as many as the index lists
+        unsigned long long raw_size;
+        if (read_varint(&reader, &raw_size) != 0 || raw_size != out_size || block_size - reader.pos != raw_size) {
+            return -1;
+        }
+        memcpy(out, block + reader.pos, out_size);
+        if (stats != NULL) {
+            stats->raw_blocks++;
+            stats->decode_ns += instrument_now_ns() - start;
+        }
+        return (long long)out_size;
+    }
+    if (check_block_type(block_type) != 0) {
+        return -1;
+    }
+    int header_status = read_block_header(&reader, block_type, &symbol_count, &streams, shared, &table, &owned);
+    uint64_t tabled = instrument_now_ns();
+    if (stats != NULL) {
+        stats->table_ns += tabled - start;
+    }
+    if (header_status != 0) {
+        return header_status;
+    }
+    if (symbol_count != out_size) {
+        free_decode_table(owned);
+        return -1;
+    }
+
+    int status;
+    if (streams.count == 1) {
+        size_t out_pos = 0;
+        status = decode_block(&reader, table, symbol_count, out, out_size, &out_pos, NULL);
+    } else if (block_size - reader.pos != streams.payload_size) {
+        status = -1;
+    } else {
+        // The substreams are the rest of the block, already in memory
+        status = decode_streams(block + reader.pos, &streams, table, symbol_count, out);
+        reader.pos = block_size;
+    }
+    free_decode_table(owned);
+    if (stats != NULL) {
+        stats->decode_ns += instrument_now_ns() - tabled;
+    }
+
+    // The block must also end exactly where the index says the next one starts
+    if (status != 0 || reader.pos != block_size) {
+        return -1;
+    }
+    return (long long)symbol_count;
+}
+
+// One block decoded on a worker thread
+typedef struct DecodeJob {
+    const unsigned char* block;
+    size_t block_size;
+    unsigned char* out;         // Reused between blocks, grown as needed
+    size_t out_size;
+    size_t out_capacity;
+    long long result;           // Decoded bytes, or an error as from decode_block_to_memory
+    const SharedTables* shared;
+    DecodeStats stats;          // This job's blocks, merged into the caller's stats at the end
+
+    int done;
+    pthread_mutex_t* lock;
+    pthread_cond_t* finished;
+} DecodeJob;
+
+static void decode_job(void* arg) {
+    DecodeJob* job = (DecodeJob*)arg;
+    job->result = decode_block_to_memory(job->block, job->block_size, job->out, job->out_size, job->shared, &job->stats);
+
+    pthread_mutex_lock(job->lock);
+    job->done = 1;
+    pthread_cond_broadcast(job->finished);
+    pthread_mutex_unlock(job->lock);
+}
+
+long long decode_indexed_range(const unsigned char* data, size_t size, unsigned long long start,
+                               unsigned long long length, FILE* output_file, ThreadPool* pool, int thread_count,
+                               const SharedTables* shared, AsyncFile* output_behind, DecodeStats* stats) {
+    DecodeStats main_stats; // The calling thread's waits and writes, then everything
+    memset(&main_stats, 0, sizeof(main_stats));
+    if (stats != NULL) {
+        *stats = main_stats;
+    }
+    if (check_stream_header(data, size) != 0) {
+        return -1;
+    }
+    BlockIndex index;
+    init_block_index(&index);
+    int index_status = read_block_index(data, size, &index);
+    if (index_status != 0) {
+        free_block_index(&index);
+        return index_status == -2 ? -3 : -1;
+    }
+
+    unsigned long long total = block_index_uncompressed_size(&index);
+    unsigned long long end = (start < total && length < total - start) ? start + length : total;
+    size_t first_block = find_block_for_offset(&index, start);
+
+    // Same scheme as the compressor: up to two blocks per thread in flight, written in order
+    int window = pool != NULL ? 2 * thread_count : 1;
+    DecodeJob* jobs = (DecodeJob*)calloc((size_t)window, sizeof(DecodeJob));
+    if (jobs == NULL) {
+        free_block_index(&index);
+        return -3;
+    }
+    pthread_mutex_t job_lock;
+    pthread_cond_t job_finished;
+    pthread_mutex_init(&job_lock, NULL);
+    pthread_cond_init(&job_finished, NULL);
+    for (int i = 0; i < window; i++) {
+        jobs[i].lock = &job_lock;
+        jobs[i].finished = &job_finished;
+        jobs[i].shared = shared;
+    }
+
+    if (output_behind != NULL) {
+        async_start(output_behind, output_file, ASYNC_WRITE);
+    }
+    long long total_output = 0;
+    size_t next_submit = first_block;
+    size_t next_write = first_block;
+    for (;;) {
+        // --- Hand out the blocks that overlap [start, end) ---
+        while (total_output >= 0 && next_submit < index.count && next_submit - next_write < (size_t)window
+               && index.entries[next_submit].uncompressed_offset < end) {
+            const BlockIndexEntry* entry = &index.entries[next_submit];
+            DecodeJob* job = &jobs[next_submit % window];
+            job->block = data + entry->compressed_offset;
+            job->block_size = (size_t)entry->compressed_size;
+            job->out_size = (size_t)entry->uncompressed_size;
+            if (job->out_size > job->out_capacity) {
+                free(job->out);
+                job->out = (unsigned char*)malloc(job->out_size);
+                job->out_capacity = job->out != NULL ? job->out_size : 0;
+                if (job->out == NULL) {
+                    total_output = -3; // Stop here; the blocks in flight are drained below
+                    break;
+                }
+            }
+            job->done = 0;
+            if (pool != NULL) {
+                thread_pool_submit(pool, decode_job, job);
+            } else {
+                decode_job(job);
+            }
+            next_submit++;
+        }
+        if (next_write == next_submit) {
+            break;
+        }
+
+        // --- Write the wanted part of the oldest block once it is decoded ---
+        DecodeJob* job = &jobs[next_write % window];
+        uint64_t wait_start = instrument_now_ns();
+        pthread_mutex_lock(&job_lock);
+        while (!job->done) {
+            pthread_cond_wait(&job_finished, &job_lock);
+        }
+        pthread_mutex_unlock(&job_lock);
+        main_stats.wait_ns += instrument_now_ns() - wait_start;
+        const BlockIndexEntry* entry = &index.entries[next_write];
+        next_write++;
+
+        if (total_output < 0) {
+            continue; // Only draining the blocks still in flight
+        }
+        if (job->result < 0) {
+            total_output = job->result;
+            continue;
+        }
+        size_t from = start > entry->uncompressed_offset ? (size_t)(start - entry->uncompressed_offset) : 0;
+        size_t to = end < entry->uncompressed_offset + entry->uncompressed_size
+                    ? (size_t)(end - entry->uncompressed_offset) : job->out_size;
+        uint64_t write_start = instrument_now_ns();
+        int failed = 0;
+        if (to > from) {
+            failed = output_behind != NULL ? async_write(output_behind, job->out + from, to - from) != 0
+                                           : fwrite(job->out + from, 1, to - from, output_file) != to - from;
+        }
+        main_stats.write_ns += instrument_now_ns() - write_start;
+        if (failed) {
+            total_output = -1;
+            continue;
+        }
+        total_output += (long long)(to - from);
+    }
+
+    for (int i = 0; i < window; i++) {
+        main_stats.block_count += jobs[i].stats.block_count;
+        main_stats.raw_blocks += jobs[i].stats.raw_blocks;
+        main_stats.compressed_bytes += jobs[i].stats.compressed_bytes;
+        main_stats.table_ns += jobs[i].stats.table_ns;
+        main_stats.decode_ns += jobs[i].stats.decode_ns;
+        free(jobs[i].out);
+    }
+    free(jobs);
+    pthread_cond_destroy(&job_finished);
+    pthread_mutex_destroy(&job_lock);
+    free_block_index(&index);
+
+    if (output_behind != NULL) {
+        uint64_t stop_start = instrument_now_ns();
+        if (async_stop(output_behind) != 0 && total_output >= 0) {
+            total_output = -1;
+        }
+        main_stats.write_ns += instrument_now_ns() - stop_start;
+    }
+    if (fflush(output_file) != 0) {
+        total_output = -1;
+    }
+    if (stats != NULL) {
+        *stats = main_stats;
+    }
+    return total_output;
 }
@@ -1,13 +1,72 @@
 #ifndef DECODER_H
 #define DECODER_H
 
-#include "huffman_node.h" // Assumes HuffmanNode is defined here
-#include "encoder.h" // To access MAX_CODE_LENGTH if needed
+#include "encoder.h" // For HuffmanCode and MAX_CODE_LENGTH
+#include "huffman_tables.h" // DecodeTable
+#include "thread_pool.h" // Threads for indexed decoding
+#include "async_io.h"    // Reading ahead and writing behind the decoder
 
-// Function to build a Huffman tree for decoding from the character-to-code map
-HuffmanNode* build_decoding_tree_from_map_file(const char* map_filename);
+struct SharedTables; // See shared_table.h
 
-// Function to read compressed bits and decode
-void decode_and_write_file(const char* compressed_filename, const char* output_filename, HuffmanNode* decoding_tree_root);
+// Counters and stage times (in nanoseconds, zero with HUFFMAN_NO_INSTRUMENTATION) of a decode
+typedef struct DecodeStats {
+    unsigned long long block_count;
+    unsigned long long raw_blocks;
+    unsigned long long compressed_bytes;    // Input consumed
+    unsigned long long table_ns;            // Reading block headers and building decode tables
+    unsigned long long decode_ns;           // Decoding the bits (and copying raw blocks)
+    unsigned long long read_ns;             // In fread of the compressed input
+    unsigned long long write_ns;            // In fwrite of the output
+    unsigned long long wait_ns;             // Waiting for worker threads (indexed decoding)
+} DecodeStats;
 
-#endif // DECODER_H
\ No newline at end of file
+// Builds the lookup table from the code lengths stored in a block header (no tree needed).
+// Returns NULL if there is no memory for it.
+DecodeTable* build_decode_table(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]);
+void free_decode_table(DecodeTable* table);
+
+// Decodes the symbol_count characters of one bitstream of exactly bit_count bits at
+// data[0..(bit_count + 7) / 8) into out. Returns 0, or -1 if the bits are not exactly
+// symbol_count valid codes.
+int decode_bitstream(const unsigned char* data, unsigned long long bit_count, const DecodeTable* table,
+                     unsigned char* out, size_t symbol_count);
+
+// Function to read a compressed stream block by block and write the decoded characters.
+// Works on pipes with constant memory. Blocks coded with a shared table are decoded with
+// the table of that id in shared (may be NULL if none are loaded). With input_ahead and
+// output_behind (either may be NULL), the files are read and written on their threads while
+// the calling thread decodes.
+// Returns the number of bytes written, -1 for corrupt input or a failed read or write (the
+// FILE's error indicator tells which), -2 for a shared table not in shared, or -3 if memory
+// ran out. Fills in *stats unless it is NULL.
+long long decode_and_write_file(FILE* compressed_file, FILE* output_file, const struct SharedTables* shared,
+                                AsyncFile* input_ahead, AsyncFile* output_behind, DecodeStats* stats);
+
+// Returns 0 if data starts with the magic and format version of this build's streams, -1 otherwise
+int check_stream_header(const unsigned char* data, size_t size);
+
+// Reads the number of characters the block at block[0..block_size) decodes to from its
+// header. Returns 0, or -1 if the block's type is unknown or its header is cut short.
+int read_block_symbol_count(const unsigned char* block, size_t block_size, unsigned long long* symbol_count);
+
+// Decodes the single block at block[0..block_size) (type byte through padding) into out, which
+// must hold exactly the out_size characters the block index lists for it.
+// Returns out_size, -1 if the block is corrupt or doesn't match the index, -2 if it was coded
+// with a shared table that is not in shared, or -3 if there is no memory for its lookup table.
+// Adds the block to *stats unless it is NULL.
+long long decode_block_to_memory(const unsigned char* block, size_t block_size, unsigned char* out, size_t out_size,
+                                 const struct SharedTables* shared, DecodeStats* stats);
+
+// Uses the block index of a whole compressed file in memory (e.g. a mapped file) to write
+// decompressed bytes [start, start + length) to output_file, decoding only the blocks that
+// overlap the range, on the thread_count threads of pool (NULL decodes on the calling thread).
+// Pass length = ULLONG_MAX for everything from start.
+// The output goes through output_behind's thread unless it is NULL.
+// Returns the number of bytes written (less than length if the range runs past the end), or
+// an error as from decode_and_write_file. Fills in *stats unless it is NULL; the table and
+// decode times are summed over the threads.
+long long decode_indexed_range(const unsigned char* data, size_t size, unsigned long long start,
+                               unsigned long long length, FILE* output_file, ThreadPool* pool, int thread_count,
+                               const struct SharedTables* shared, AsyncFile* output_behind, DecodeStats* stats);
+
+#endif // DECODER_H
@@ -1,48 +1,253 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h> // For ULLONG_MAX
 
-#include "huffman_node.h" // Needed for HuffmanNode struct
-#include "encoder.h" // To use huffman_codes array or related functions
-#include "decoder.h" // For new decoding functions
+#ifdef _WIN32
+#include <io.h>    // For _setmode
+#include <fcntl.h> // For _O_BINARY
+#endif
 
-// Definition for freeing the Huffman tree
-void free_huffman_tree(HuffmanNode* node) {
-    if (node == NULL) return;
-    free_huffman_tree(node->left);
-    free_huffman_tree(node->right);
-    free(node);
+#include "huffman.h"      // Decompression library
+#include "file_mapping.h" // Whole compressed file in memory for indexed decoding
+#include "thread_pool.h"  // For online_cpu_count
+
+#define DECOMPRESS_MAX_TABLES 64 // -t options
+
+// --stats=json: the run's counters and stage times as one JSON object on one line
+static void print_stats_json(FILE *out, const HuffmanDecodeStats *stats, int thread_count) {
+    const HuffmanTimings *t = &stats->timings;
+    fprintf(out, "{\"input_bytes\": %llu, \"output_bytes\": %llu, \"blocks\": %llu, \"raw_blocks\": %llu, \"threads\": %d, "
+            "\"total_ns\": %llu, \"table_ns\": %llu, \"decode_ns\": %llu, \"read_ns\": %llu, \"write_ns\": %llu, "
+            "\"wait_ns\": %llu}\n",
+            stats->compressed_size, stats->decompressed_size, stats->block_count, stats->raw_blocks, thread_count,
+            t->total_ns, t->table_ns, t->coding_ns, t->read_ns, t->write_ns, t->wait_ns);
+}
+
+// --message: decodes a frameless message (huffman_compress_message) in memory and writes it to out
+static HuffmanStatus read_message(HuffmanContext *ctx, const MappedFile *input, FILE *out, unsigned long long *dst_size) {
+    size_t size = 0;
+    HuffmanStatus status = huffman_decompress_message(ctx, input->data, input->size, NULL, 0, &size);
+    if (status != HUFFMAN_ERROR_DST_TOO_SMALL) {
+        *dst_size = 0;
+        return status; // Corrupt, or empty: nothing to write either way
+    }
+    unsigned char *message = (unsigned char *)malloc(size);
+    if (message == NULL) {
+        perror("Failed to allocate message buffer");
+        exit(EXIT_FAILURE);
+    }
+    status = huffman_decompress_message(ctx, input->data, input->size, message, size, &size);
+    if (status == HUFFMAN_OK && fwrite(message, 1, size, out) != size) {
+        status = HUFFMAN_ERROR_IO;
+    }
+    free(message);
+    *dst_size = size;
+    return status;
+}
+
+// The library only returns a status; this says what it means for the input
+static void print_decompress_error(HuffmanStatus status, const char *input_kind) {
+    if (status == HUFFMAN_ERROR_CORRUPT_INPUT) {
+        fprintf(stderr, "Error: Input is not a compressed %s produced by this version of huffman_compressor, "
+                        "or it is corrupt or truncated.\n", input_kind);
+    } else if (status == HUFFMAN_ERROR_UNKNOWN_TABLE) {
+        fprintf(stderr, "Error: The compressed data uses a shared table that was not loaded (see -t).\n");
+    } else if (status == HUFFMAN_ERROR_IO) {
+        fprintf(stderr, "Error: Decompression failed reading the input or writing decompressed data.\n");
+    } else {
+        fprintf(stderr, "Error: Decompression failed (%s).\n", huffman_status_string(status));
+    }
 }
 
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-v] [--stats=json] [--sync-io] [-T threads] [-r offset:length] [-t table]... [--message] <compressed_input_file|-> <decompressed_output_file|->\n", program);
+    fprintf(stderr, "  -v  Print the file names and the decompressed size; nothing is printed by default\n");
+    fprintf(stderr, "  --stats=json  Print the counters and per-stage times as a JSON object\n");
+    fprintf(stderr, "  --sync-io     Read and write on the decoding thread instead of on I/O threads\n");
+    fprintf(stderr, "  -T  Number of threads decoding blocks in parallel (default 1, 0 = one per CPU)\n");
+    fprintf(stderr, "  -r  Only write decompressed bytes offset .. offset+length-1, decoding just the blocks that hold them\n");
+    fprintf(stderr, "  -t  Load a shared table the input was compressed with, as its file or its id\n");
+    fprintf(stderr, "      (found as <id>%s in $%s, default .); may be given more than once\n", HUFFMAN_TABLE_SUFFIX, HUFFMAN_TABLE_DIR_ENV);
+    fprintf(stderr, "  --message     The input is one frameless message (huffman_compressor --message)\n");
+    fprintf(stderr, "  Use - to read from stdin or write to stdout. -T and -r need a compressed file, not stdin.\n");
+}
 
 int main(int argc, char *argv[]) {
-    if (argc < 4) { // program_name, compressed_file, map_file, output_file
-        fprintf(stderr, "Usage: %s <compressed_input_file> <map_file> <decompressed_output_file>\n", argv[0]);
+    int thread_count = 1;
+    int extract_range = 0;
+    unsigned long long range_start = 0;
+    unsigned long long range_length = ULLONG_MAX;
+    const char *tables[DECOMPRESS_MAX_TABLES];
+    int table_count = 0;
+    int verbosity = 0;
+    int stats_json = 0;
+    int async_io = 1;
+    int message = 0;
+    const char *positional[2];
+    int positional_count = 0;
+    int usage_error = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-v") == 0) {
+            verbosity++;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_json = 1;
+        } else if (strcmp(argv[i], "--sync-io") == 0) {
+            async_io = 0;
+        } else if (strcmp(argv[i], "--message") == 0) {
+            message = 1;
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+            if (thread_count == 0) {
+                thread_count = online_cpu_count();
+            }
+            if (thread_count < 1 || thread_count > 1024) {
+                fprintf(stderr, "Error: -T must be between 0 and 1024.\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%llu:%llu", &range_start, &range_length) != 2) {
+                fprintf(stderr, "Error: -r expects offset:length in bytes, e.g. -r 1048576:4096.\n");
+                return 1;
+            }
+            extract_range = 1;
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            if (table_count == DECOMPRESS_MAX_TABLES) {
+                fprintf(stderr, "Error: At most %d shared tables (-t).\n", DECOMPRESS_MAX_TABLES);
+                return 1;
+            }
+            tables[table_count++] = argv[++i];
+        } else if (positional_count < 2) {
+            positional[positional_count++] = argv[i];
+        } else {
+            usage_error = 1;
+        }
+    }
+    if (positional_count < 2 || usage_error || (message && extract_range)) { // program_name, compressed_file, output_file
+        print_usage(argv[0]);
         return 1;
     }
 
-    const char *compressed_filename = argv[1];
-    const char *map_filename = argv[2];
-    const char *decompressed_filename = argv[3];
+    const char *compressed_filename = positional[0];
+    const char *decompressed_filename = positional[1];
+    int read_from_stdin = strcmp(compressed_filename, "-") == 0;
+    int write_to_stdout = strcmp(decompressed_filename, "-") == 0;
 
-    printf("Compressed Input: %s\n", compressed_filename);
-    printf("Map File: %s\n", map_filename);
-    printf("Decompressed Output: %s\n", decompressed_filename);
+    // The block index sits at the end of the file, so random access needs the whole file
+    int use_index = !message && (extract_range || thread_count > 1);
+    if (use_index && read_from_stdin) {
+        fprintf(stderr, "Error: -T and -r need a compressed file; stdin can only be decoded as a stream.\n");
+        return 1;
+    }
+
+    // Progress messages must not end up in the decompressed data
+    FILE *info = write_to_stdout ? stderr : stdout;
+
+    if (verbosity >= 1) {
+        fprintf(info, "Compressed Input: %s\n", read_from_stdin ? "(stdin)" : compressed_filename);
+        fprintf(info, "Decompressed Output: %s\n", write_to_stdout ? "(stdout)" : decompressed_filename);
+    }
+
+    // Every exit after this point goes through cleanup, which releases what was opened so far
+    int result = 1;
+    FILE *compressed_file = NULL; // Only used for stream decoding
+    FILE *output_file = NULL;
+    MappedFile compressed = {NULL, 0, 0};
+    HuffmanContext *ctx = NULL;
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    if (message) {
+        // A message has no blocks to stream: it is decoded in one piece
+        if ((read_from_stdin ? read_whole_file(stdin, &compressed) : map_input_file(compressed_filename, &compressed)) != 0) {
+            goto cleanup;
+        }
+    } else if (use_index) {
+        if (map_input_file(compressed_filename, &compressed) != 0) {
+            goto cleanup;
+        }
+    } else if (read_from_stdin) {
+        compressed_file = stdin;
+    } else {
+        compressed_file = fopen(compressed_filename, "rb"); // "rb" for binary read
+        if (compressed_file == NULL) {
+            perror("Error opening compressed file for decoding");
+            goto cleanup;
+        }
+    }
+    if (write_to_stdout) {
+        output_file = stdout;
+    } else {
+        output_file = fopen(decompressed_filename, "wb"); // Binary, the compressor reads its input as raw bytes too
+        if (output_file == NULL) {
+            perror("Error opening output file for decompressed data");
+            goto cleanup;
+        }
+    }
 
     // --- DECODING PROCESS ---
-    // 1. Read the map file and build the decoding tree
-    HuffmanNode* decoding_tree_root = build_decoding_tree_from_map_file(map_filename);
-    if (decoding_tree_root == NULL) {
-        fprintf(stderr, "Error: Failed to build decoding tree from map file.\n");
-        return 1;
+    HuffmanOptions options;
+    huffman_default_options(&options);
+    options.thread_count = thread_count;
+    options.async_io = async_io;
+    ctx = huffman_create_context(&options);
+    if (ctx == NULL) {
+        if (huffman_check_options(&options) != HUFFMAN_OK) {
+            fprintf(stderr, "Error: Invalid decompression options.\n");
+        } else {
+            fprintf(stderr, "Error: Can't set up decompression (%s).\n", huffman_status_string(HUFFMAN_ERROR_NO_MEMORY));
+        }
+        goto cleanup;
+    }
+    // Loaded once into the context; blocks name the table they need by id
+    for (int i = 0; i < table_count; i++) {
+        uint32_t table_id;
+        HuffmanStatus table_status = huffman_load_shared_table(ctx, tables[i], &table_id);
+        if (table_status != HUFFMAN_OK) {
+            fprintf(stderr, "Error: Can't load shared table %s: %s.\n", tables[i], huffman_status_string(table_status));
+            goto cleanup;
+        }
     }
 
-    // 2. Read compressed bits and decode
-    decode_and_write_file(compressed_filename, decompressed_filename, decoding_tree_root);
+    unsigned long long decompressed_size;
+    HuffmanStatus status;
+    if (message) {
+        status = read_message(ctx, &compressed, output_file, &decompressed_size);
+    } else if (use_index) {
+        // The index in the file's footer says where every block starts, so only the blocks
+        // in the requested range are decoded, several at a time with -T
+        status = huffman_decompress_range(ctx, compressed.data, compressed.size, range_start, range_length,
+                                          output_file, &decompressed_size);
+    } else {
+        status = huffman_decompress_stream(ctx, compressed_file, output_file, &decompressed_size);
+    }
 
-    // 3. Cleanup
-    free_huffman_tree(decoding_tree_root); // Assuming free_huffman_tree works on any HuffmanNode*
+    if (!write_to_stdout && fclose(output_file) != 0 && status == HUFFMAN_OK) {
+        status = HUFFMAN_ERROR_IO;
+    }
+    output_file = NULL;
+    if (status != HUFFMAN_OK) {
+        print_decompress_error(status, message ? "message" : use_index ? "file with a valid block index" : "stream");
+        goto cleanup;
+    }
+
+    if (stats_json) {
+        print_stats_json(info, huffman_last_decode_stats(ctx), thread_count);
+    }
+    if (verbosity >= 1) {
+        fprintf(info, "Decompression complete (%llu bytes).\n", decompressed_size);
+    }
+    result = 0;
 
-    printf("Decompression complete.\n");
-    return 0;
-}
\ No newline at end of file
+cleanup:
+    huffman_free_context(ctx);
+    if (output_file != NULL && output_file != stdout) {
+        fclose(output_file); // Only left open on an error
+    }
+    if (compressed_file != NULL && compressed_file != stdin) {
+        fclose(compressed_file);
+    }
+    unmap_input_file(&compressed);
+    return result;
+}
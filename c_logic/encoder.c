@@ -1,182 +1,672 @@
 #include "encoder.h" // Includes function prototypes and huffman_node.h
+#include "canonical_codes.h" // Canonical code assignment and the code length table
+#include "package_merge.h"   // Length-limited code lengths
+#include "huffman_format.h"  // Stream and block layout
+#include "instrument.h"      // Timing fwrite for the statistics
 #include <stdio.h>         // For printf, fprintf
 
-void write_huffman_map_to_file(const char* map_filename) {
+// Renders a packed code as a '0'/'1' string (buffer must hold MAX_CODE_LENGTH + 1 chars)
+static void code_to_string(HuffmanCode code, char* out) {
+    for (int i = 0; i < code.length; i++) {
+        out[i] = ((code.bits >> (code.length - 1 - i)) & 1) ? '1' : '0';
+    }
+    out[code.length] = '\0';
+}
+
+int write_huffman_map_to_file(const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], const char* map_filename) {
     FILE* map_file = fopen(map_filename, "w"); // "w" for text write
     if (map_file == NULL) {
-        perror("Error opening map file for writing");
-        return;
+        return -1;
     }
 
-    printf("\nWriting Huffman map to %s...\n", map_filename);
-    for (int i = 0; i < 128; i++) {
-        if (huffman_codes[i][0] != '\0') { // If a code exists for this character
-            fprintf(map_file, "%d %s\n", i, huffman_codes[i]);
+    char code_str[MAX_CODE_LENGTH + 1];
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (codes[i].length != 0) { // If a code exists for this character
+            code_to_string(codes[i], code_str);
+            fprintf(map_file, "%d %s\n", i, code_str);
         }
     }
-    fclose(map_file);
-    printf("Huffman map written successfully.\n");
+    if (fclose(map_file) != 0) {
+        return -1;
+    }
+    return 0;
 }
 
-// Define the global array for Huffman codes
-char huffman_codes[128][MAX_CODE_LENGTH];
-
-void init_huffman_codes_array() {
-    for (int i = 0; i < 128; i++) {
-        huffman_codes[i][0] = '\0'; // Initialize all codes to empty strings
+void init_huffman_codes_array(HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]) {
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        codes[i].bits = 0;
+        codes[i].length = 0; // Initialize all codes to empty
     }
 }
 
-// Recursive DFS function to generate codes
-static void generate_codes_dfs(HuffmanNode* root, char* current_code, int top) {
+// Recursive DFS function to collect the code length (leaf depth) and frequency of every character
+static void collect_code_lengths_dfs(const HuffmanTree* tree, int index, int depth, unsigned char lengths[HUFFMAN_ALPHABET_SIZE], uint64_t frequencies[HUFFMAN_ALPHABET_SIZE]) {
+    const HuffmanNode* root = &tree->nodes[index];
     // Base Case: Leaf Node
-    if (root->left == NULL && root->right == NULL) {
-        current_code[top] = '\0'; // Null-terminate the current code string
-        if (root->ch >= 0 && root->ch < 128) {
-            strcpy(huffman_codes[root->ch], current_code);
-        } else {
-            fprintf(stderr, "Error: Invalid character ASCII value in leaf node: %d\n", root->ch);
+    if (is_huffman_leaf(root)) {
+        // Leaves are built from byte counts, so their characters are always in range
+        if (root->ch >= 0 && root->ch < HUFFMAN_ALPHABET_SIZE) {
+            // Anything deeper than MAX_CODE_LENGTH is marked as too long and forces package-merge
+            lengths[root->ch] = (unsigned char)(depth <= MAX_CODE_LENGTH ? depth : MAX_CODE_LENGTH + 1);
+            frequencies[root->ch] = root->frequency;
         }
         return;
     }
 
-    // Recursive Step: Internal Node
-    if (root->left) {
-        current_code[top] = '0';
-        generate_codes_dfs(root->left, current_code, top + 1);
+    // Recursive Step: Internal Node (always has both children)
+    collect_code_lengths_dfs(tree, root->left, depth + 1, lengths, frequencies);
+    collect_code_lengths_dfs(tree, root->right, depth + 1, lengths, frequencies);
+}
+
+static unsigned long long encoded_size_in_bits(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE]) {
+    unsigned long long bits = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        bits += (unsigned long long)lengths[i] * (unsigned long long)frequencies[i];
     }
-    if (root->right) {
-        current_code[top] = '1';
-        generate_codes_dfs(root->right, current_code, top + 1);
+    return bits;
+}
+
+static int longest_length(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]) {
+    int longest = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] > longest) longest = lengths[i];
     }
+    return longest;
 }
 
-void build_huffman_codes(HuffmanNode* root) {
-    char current_code_buffer[MAX_CODE_LENGTH];
+// Only the code lengths are taken from the tree; the codes themselves are canonical,
+// so the decoder can rebuild them from the lengths stored in the file header.
+int build_huffman_codes(const HuffmanTree* tree, int max_code_length, HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], CodeBuildStats* stats) {
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE] = {0};
+    uint64_t frequencies[HUFFMAN_ALPHABET_SIZE] = {0};
 
-    init_huffman_codes_array(); // Always initialize before building
+    init_huffman_codes_array(codes); // Always initialize before building
 
-    if (root == NULL) {
-        printf("Error: Huffman tree is empty, cannot generate codes.\n");
-        return;
+    if (tree->root < 0) {
+        return -1; // Empty tree: no codes to generate
     }
 
     // Special case: only one unique character in the text
-    if (root->left == NULL && root->right == NULL) {
-        if (root->ch >= 0 && root->ch < 128) {
-            strcpy(huffman_codes[root->ch], "0"); // Assign '0' as its code
-            printf("Special case: Only one unique character '%c' (ASCII %d), assigned code '0'.\n", root->ch, root->ch);
-        } else {
-             fprintf(stderr, "Error: Single node tree has invalid character: %d\n", root->ch);
+    const HuffmanNode* root = &tree->nodes[tree->root];
+    if (is_huffman_leaf(root)) {
+        if (root->ch < 0 || root->ch >= HUFFMAN_ALPHABET_SIZE) {
+            return -1;
         }
-        return;
+        lengths[root->ch] = 1; // Gets code '0'
+        frequencies[root->ch] = root->frequency;
+    } else {
+        collect_code_lengths_dfs(tree, tree->root, 0, lengths, frequencies);
     }
 
-    generate_codes_dfs(root, current_code_buffer, 0);
+    int optimal_max_length = longest_length(lengths);
+    unsigned long long optimal_bits = encoded_size_in_bits(lengths, frequencies);
+
+    // Too deep for the limit: package-merge finds the best lengths that fit under it
+    if (optimal_max_length > max_code_length) {
+        if (package_merge_code_lengths(frequencies, max_code_length, lengths) != 0) {
+            return -1; // 2^max_code_length codes are too few for this many characters
+        }
+    }
+
+    assign_canonical_codes(lengths, codes);
+
+    if (stats != NULL) {
+        stats->optimal_max_length = optimal_max_length;
+        stats->max_length = longest_length(lengths);
+        stats->optimal_bits = optimal_bits;
+        stats->encoded_bits = encoded_size_in_bits(lengths, frequencies);
+    }
+    return 0;
 }
 
-void print_huffman_codes() {
-    printf("\n--- Huffman Codes Generated ---\n");
-    printf("Char\tASCII\tCode\n");
-    printf("----\t-----\t----\n");
-    for (int i = 0; i < 128; i++) {
-        if (huffman_codes[i][0] != '\0') {
+void print_huffman_codes(const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], FILE* out) {
+    char code_str[MAX_CODE_LENGTH + 1];
+
+    fprintf(out, "\n--- Huffman Codes Generated ---\n");
+    fprintf(out, "Char\tByte\tCode\n");
+    fprintf(out, "----\t----\t----\n");
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (codes[i].length != 0) {
+            code_to_string(codes[i], code_str);
             if (i >= 32 && i <= 126) { // Printable ASCII
-                printf("'%c'\t%d\t%s\n", (char)i, i, huffman_codes[i]);
+                fprintf(out, "'%c'\t%d\t%s\n", (char)i, i, code_str);
             } else { // Non-printable
-                if (i == 10) printf("'\\n'\t%d\t%s\n", i, huffman_codes[i]);
-                else if (i == 32) printf("' '\t%d\t%s\n", i, huffman_codes[i]);
-                else if (i == 9) printf("'\\t'\t%d\t%s\n", i, huffman_codes[i]);
-                else if (i == 0) printf("'\\0'\t%d\t%s\n", i, huffman_codes[i]); // Null char
-                else printf("0x%02X\t%d\t%s\n", i, i, huffman_codes[i]);
+                if (i == 10) fprintf(out, "'\\n'\t%d\t%s\n", i, code_str);
+                else if (i == 32) fprintf(out, "' '\t%d\t%s\n", i, code_str);
+                else if (i == 9) fprintf(out, "'\\t'\t%d\t%s\n", i, code_str);
+                else if (i == 0) fprintf(out, "'\\0'\t%d\t%s\n", i, code_str); // Null char
+                else fprintf(out, "0x%02X\t%d\t%s\n", i, i, code_str);
             }
         }
     }
-    printf("-------------------------------\n");
+    fprintf(out, "-------------------------------\n");
 }
 
-// Definition for freeing the Huffman tree
-void free_huffman_tree(HuffmanNode* node) {
-    if (node == NULL) return;
-    free_huffman_tree(node->left);
-    free_huffman_tree(node->right);
-    free(node);
-}
+// --- Bit-level output ---
 
-// Add this function, perhaps in huffman_codes.c or a new compression.c
-#include <stdio.h> // For FILE operations
-#include <string.h> // For strlen
+// Makes room for 'extra' more bytes in a memory writer. Returns -1 if a fixed buffer is full
+// or a growing one can't grow.
+static int reserve_memory(BitWriter* writer, size_t extra) {
+    size_t needed = (size_t)writer->bytes_written + extra;
+    if (needed <= writer->memory_capacity) {
+        return 0;
+    }
+    if (writer->fixed_memory) {
+        writer->write_error = 1;
+        return -1;
+    }
+    size_t capacity = writer->memory_capacity > 0 ? writer->memory_capacity : ENCODE_IO_BUFFER_SIZE;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    unsigned char* memory = (unsigned char*)realloc(writer->memory, capacity);
+    if (memory == NULL) {
+        writer->write_error = 1;
+        writer->out_of_memory = 1;
+        return -1;
+    }
+    writer->memory = memory;
+    writer->memory_capacity = capacity;
+    return 0;
+}
 
-// Function to write a bit to the output file
-// This is a lower-level helper for bit-packing
-static void write_bit(FILE *outfile, int bit, unsigned char *buffer, int *buffer_pos) {
-    if (*buffer_pos == 0) {
-        *buffer = 0; // Initialize buffer to all zeros when starting a new byte
+// Hands bytes to the file, or to the thread writing it
+static void write_to_file(BitWriter* writer, const unsigned char* data, size_t size) {
+    uint64_t start = instrument_now_ns();
+    if (writer->behind != NULL) {
+        if (async_write(writer->behind, data, size) != 0) {
+            writer->write_error = 1;
+        }
+    } else if (fwrite(data, 1, size, writer->file) != size) {
+        writer->write_error = 1;
     }
+    writer->write_ns += instrument_now_ns() - start;
+}
 
-    // Set the bit at the current position in the buffer
-    if (bit == 1) {
-        *buffer |= (1 << (7 - *buffer_pos)); // Set the bit. (7 - buffer_pos) for MSB first
+static void flush_buffer(BitWriter* writer) {
+    if (writer->file == NULL) {
+        if (reserve_memory(writer, writer->pos) == 0) {
+            memcpy(writer->memory + writer->bytes_written, writer->buffer, writer->pos);
+        }
+    } else if (writer->pos > 0) {
+        write_to_file(writer, writer->buffer, writer->pos);
     }
+    writer->bytes_written += writer->pos;
+    writer->pos = 0;
+}
 
-    (*buffer_pos)++; // Move to the next bit position
+void init_bit_writer(BitWriter* writer, FILE* file) {
+    writer->file = file;
+    writer->behind = NULL;
+    writer->memory = NULL;
+    writer->memory_capacity = 0;
+    writer->fixed_memory = 0;
+    writer->pos = 0;
+    writer->bytes_written = 0;
+    writer->write_error = 0;
+    writer->out_of_memory = 0;
+    writer->write_ns = 0;
+    writer->acc = 0;
+    writer->count = 0;
+}
 
-    // If the buffer is full (8 bits), write the byte to the file
-    if (*buffer_pos == 8) {
-        fputc(*buffer, outfile);
-        *buffer_pos = 0; // Reset for the next byte
-        *buffer = 0;     // Clear buffer
-    }
+void init_bit_writer_fixed(BitWriter* writer, unsigned char* out, size_t capacity) {
+    init_bit_writer(writer, NULL);
+    writer->memory = out;
+    writer->memory_capacity = capacity;
+    writer->fixed_memory = 1;
 }
 
-// Function to write the encoded data to the output file
-void encode_and_write_file(const char *input_filename, const char *output_filename) {
-    FILE *infile = fopen(input_filename, "r");
-    if (infile == NULL) {
-        perror("Error opening input file for encoding");
+void reset_bit_writer(BitWriter* writer) {
+    writer->pos = 0;
+    writer->bytes_written = 0;
+    writer->write_error = 0;
+    writer->out_of_memory = 0;
+    writer->acc = 0;
+    writer->count = 0;
+}
+
+void free_bit_writer_memory(BitWriter* writer) {
+    if (writer->fixed_memory) {
         return;
     }
+    free(writer->memory);
+    writer->memory = NULL;
+    writer->memory_capacity = 0;
+}
+
+void write_bytes(BitWriter* writer, const unsigned char* data, size_t size) {
+    // Large runs go straight to the file instead of through the 64 KB buffer
+    flush_buffer(writer);
+    if (writer->file == NULL) {
+        if (size > 0 && reserve_memory(writer, size) == 0) {
+            memcpy(writer->memory + writer->bytes_written, data, size);
+        }
+    } else if (size > 0) {
+        write_to_file(writer, data, size);
+    }
+    writer->bytes_written += size;
+}
 
-    // Open the output file in binary write mode
-    FILE *outfile = fopen(output_filename, "wb"); // "wb" for binary write
-    if (outfile == NULL) {
-        perror("Error opening output file for writing compressed data");
-        fclose(infile);
+void append_bit_writer(BitWriter* writer, BitWriter* block) {
+    flush_buffer(block);
+    if (block->write_error) {
+        // Some of the block's bytes are missing: the copy fails the same way
+        writer->write_error = 1;
+        writer->out_of_memory |= block->out_of_memory;
         return;
     }
+    write_bytes(writer, block->memory, (size_t)block->bytes_written);
+}
 
-    unsigned char byte_buffer = 0; // Buffer to accumulate bits (1 byte = 8 bits)
-    int bit_position = 0;         // Current bit position within the byte_buffer (0-7)
+// Appends up to 32 bits to the stream
+static void put_bits(BitWriter* writer, uint64_t bits, int length) {
+    writer->acc = (writer->acc << length) | bits;
+    writer->count += length;
+    if (writer->count >= 32) {
+        writer->count -= 32;
+        uint32_t word = (uint32_t)(writer->acc >> writer->count);
+        unsigned char* out = writer->buffer + writer->pos;
+        out[0] = (unsigned char)(word >> 24);
+        out[1] = (unsigned char)(word >> 16);
+        out[2] = (unsigned char)(word >> 8);
+        out[3] = (unsigned char)word;
+        writer->pos += 4;
+        if (writer->pos > ENCODE_IO_BUFFER_SIZE - 4) {
+            flush_buffer(writer);
+        }
+    }
+}
 
-    int character;
-    printf("\nEncoding and writing compressed data...\n");
-    while ((character = fgetc(infile)) != EOF) {
-        if (character >= 0 && character < 128) {
-            const char *code = huffman_codes[character]; // Get the Huffman code for the character
-            if (code[0] == '\0') { // Character not found in codes (shouldn't happen if frequency table is correct)
-                fprintf(stderr, "Warning: No Huffman code found for character '%c' (ASCII %d)\n", (char)character, character);
-                continue;
-            }
+static void put_code(BitWriter* writer, HuffmanCode code) {
+    if (code.length <= 32) {
+        put_bits(writer, code.bits, code.length);
+    } else {
+        put_bits(writer, code.bits >> 32, code.length - 32);
+        put_bits(writer, code.bits & 0xFFFFFFFFu, 32);
+    }
+}
 
-            // Write each bit of the code to the output file
-            for (int i = 0; code[i] != '\0'; i++) {
-                int bit = code[i] - '0'; // Convert '0' or '1' char to integer 0 or 1
-                write_bit(outfile, bit, &byte_buffer, &bit_position);
-            }
+// Writes out the pending bits, padding the last byte with zero bits
+static void align_to_byte(BitWriter* writer) {
+    while (writer->count > 0) {
+        int shift = writer->count - 8;
+        unsigned char byte = (unsigned char)(shift >= 0 ? writer->acc >> shift : writer->acc << -shift);
+        writer->buffer[writer->pos++] = byte;
+        writer->count = shift > 0 ? shift : 0;
+    }
+    if (writer->pos > ENCODE_IO_BUFFER_SIZE - 4) {
+        flush_buffer(writer);
+    }
+}
+
+// Byte-level output for headers; only valid while the writer is byte aligned
+static void put_byte(BitWriter* writer, unsigned char byte) {
+    writer->buffer[writer->pos++] = byte;
+    if (writer->pos > ENCODE_IO_BUFFER_SIZE - 4) {
+        flush_buffer(writer);
+    }
+}
+
+static void put_varint(BitWriter* writer, unsigned long long value) {
+    while (value >= 0x80) {
+        put_byte(writer, (unsigned char)(value | 0x80));
+        value >>= 7;
+    }
+    put_byte(writer, (unsigned char)value);
+}
+
+void write_stream_header(BitWriter* writer) {
+    for (int i = 0; i < HUFFMAN_MAGIC_SIZE; i++) {
+        put_byte(writer, (unsigned char)HUFFMAN_MAGIC[i]);
+    }
+    put_byte(writer, HUFFMAN_FORMAT_VERSION);
+}
+
+unsigned long long encoded_bit_count(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]) {
+    unsigned long long bit_count = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        bit_count += (unsigned long long)frequencies[i] * codes[i].length;
+    }
+    return bit_count;
+}
+
+// Block header with the symbol and bit counts given rather than taken from the frequencies.
+// table_id is NULL to store the code lengths, or the id of the shared table the codes came from.
+static void put_block_header(BitWriter* writer, unsigned long long symbol_count, unsigned long long bit_count,
+                             const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], const unsigned long long* stream_bits,
+                             const uint32_t* table_id) {
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        lengths[i] = codes[i].length;
+    }
+
+    int block_type = HUFFMAN_BLOCK_HUFFMAN;
+    if (stream_bits != NULL) block_type |= HUFFMAN_BLOCK_FLAG_4_STREAMS;
+    if (table_id != NULL) block_type |= HUFFMAN_BLOCK_FLAG_SHARED_TABLE;
+    put_byte(writer, (unsigned char)block_type);
+    put_varint(writer, symbol_count);
+    put_varint(writer, bit_count);
+
+    if (table_id != NULL) {
+        // The decoder already has the table; the id is enough to find it
+        for (int i = 0; i < 4; i++) {
+            put_byte(writer, (unsigned char)(*table_id >> (8 * i)));
+        }
+    } else {
+        // The code lengths are all the decoder needs to rebuild the canonical codes
+        unsigned char table[CODE_LENGTHS_MAX_BYTES];
+        size_t table_size = write_code_lengths(lengths, table);
+        for (size_t i = 0; i < table_size; i++) {
+            put_byte(writer, table[i]);
+        }
+    }
+
+    // Jump table: where substreams 1-3 start follows from the sizes of the ones before them
+    if (stream_bits != NULL) {
+        for (int i = 0; i < HUFFMAN_STREAM_COUNT - 1; i++) {
+            put_varint(writer, stream_bits[i]);
+        }
+    }
+}
+
+int write_block_header(BitWriter* writer, const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                       const unsigned long long* stream_bits) {
+    unsigned long long symbol_count = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        symbol_count += (unsigned long long)frequencies[i];
+    }
+    if (symbol_count == 0) {
+        return -1; // Nothing encodable in this block
+    }
+    put_block_header(writer, symbol_count, encoded_bit_count(frequencies, codes), codes, stream_bits, NULL);
+    return 0;
+}
+
+static void encode_symbols(BitWriter* writer, const unsigned char* data, size_t size, const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]) {
+    for (size_t i = 0; i < size; i++) {
+        put_code(writer, codes[data[i]]); // Every byte of the block was counted (or escaped), so it has a code
+    }
+}
+
+int varint_size(unsigned long long value) {
+    int size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+// huffman_block_size with the symbol and bit counts given; table_id as for put_block_header
+static unsigned long long block_size_from_counts(unsigned long long symbol_count, unsigned long long bit_count,
+                                                 const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], const unsigned long long* stream_bits,
+                                                 const uint32_t* table_id) {
+    unsigned long long size = 1 + varint_size(symbol_count) + varint_size(bit_count);
+    if (table_id != NULL) {
+        size += 4;
+    } else {
+        unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+        for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+            lengths[i] = codes[i].length;
+        }
+        unsigned char table[CODE_LENGTHS_MAX_BYTES];
+        size += write_code_lengths(lengths, table);
+    }
+    if (stream_bits == NULL) {
+        return size + (bit_count + 7) / 8;
+    }
+    for (int i = 0; i < HUFFMAN_STREAM_COUNT; i++) {
+        if (i < HUFFMAN_STREAM_COUNT - 1) size += varint_size(stream_bits[i]);
+        size += (stream_bits[i] + 7) / 8;
+    }
+    return size;
+}
+
+unsigned long long huffman_block_size(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                                      const unsigned long long* stream_bits) {
+    unsigned long long symbol_count = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        symbol_count += (unsigned long long)frequencies[i];
+    }
+    return block_size_from_counts(symbol_count, encoded_bit_count(frequencies, codes), codes, stream_bits, NULL);
+}
+
+unsigned long long raw_block_size(size_t size) {
+    return 1 + varint_size(size) + (unsigned long long)size;
+}
+
+void write_raw_block(BitWriter* writer, const unsigned char* data, size_t size) {
+    put_byte(writer, HUFFMAN_BLOCK_RAW);
+    put_varint(writer, size);
+    write_bytes(writer, data, size);
+}
+
+// Function to encode one block: header with the exact bit count and code lengths (or shared
+// table id), then the bits
+static int encode_block(BitWriter* writer, const unsigned char* data, size_t size,
+                        const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                        const unsigned long long* stream_bits, const uint32_t* table_id) {
+    // The sizes are exact, so incompressible data costs a histogram and a copy, not an encode
+    unsigned long long bit_count = encoded_bit_count(frequencies, codes);
+    if (size == 0 || block_size_from_counts(size, bit_count, codes, stream_bits, table_id) >= raw_block_size(size)) {
+        write_raw_block(writer, data, size);
+        return 1;
+    }
+    put_block_header(writer, size, bit_count, codes, stream_bits, table_id);
+
+    if (stream_bits == NULL) {
+        encode_symbols(writer, data, size, codes);
+        // Pad the last byte with zero bits; the decoder knows the exact bit count from the header
+        align_to_byte(writer);
+        return 0;
+    }
+
+    // Every substream starts on a byte of its own, where the jump table says it does
+    size_t segment = HUFFMAN_STREAM_SEGMENT(size);
+    for (int i = 0; i < HUFFMAN_STREAM_COUNT; i++) {
+        size_t start = segment * i < size ? segment * i : size;
+        size_t end = size - start > segment ? start + segment : size;
+        encode_symbols(writer, data + start, end - start, codes);
+        align_to_byte(writer);
+    }
+    return 0;
+}
+
+int encode_and_write_block(BitWriter* writer, const unsigned char* data, size_t size,
+                           const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                           const unsigned long long* stream_bits) {
+    return encode_block(writer, data, size, frequencies, codes, stream_bits, NULL);
+}
+
+int encode_and_write_block_shared(BitWriter* writer, const unsigned char* data, size_t size,
+                                  const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                                  const unsigned long long* stream_bits, uint32_t table_id) {
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (frequencies[i] > 0 && codes[i].length == 0) {
+            write_raw_block(writer, data, size);
+            return 1;
+        }
+    }
+    return encode_block(writer, data, size, frequencies, codes, stream_bits, &table_id);
+}
+
+// Bits written to a writer so far, including the ones still pending in its accumulator
+static unsigned long long bit_position(const BitWriter* writer) {
+    return (writer->bytes_written + writer->pos) * 8 + (unsigned long long)writer->count;
+}
+
+int encode_and_write_block_unsized(BitWriter* writer, BitWriter* scratch, const unsigned char* data, size_t size,
+                                   const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], int four_streams,
+                                   unsigned long long* bit_count) {
+    // The codes didn't come from this block's counts, so the bit counts are only known once
+    // the bits exist: encode into scratch first, then write the header and copy the bits
+    unsigned long long stream_bits[HUFFMAN_STREAM_COUNT];
+    int stream_count = four_streams && size >= FOUR_STREAMS_MIN_SYMBOLS ? HUFFMAN_STREAM_COUNT : 1;
+    size_t segment = stream_count > 1 ? HUFFMAN_STREAM_SEGMENT(size) : size;
+    reset_bit_writer(scratch);
+    *bit_count = 0;
+    for (int i = 0; i < stream_count; i++) {
+        size_t start = segment * i < size ? segment * i : size;
+        size_t end = size - start > segment ? start + segment : size;
+        unsigned long long before = bit_position(scratch);
+        encode_symbols(scratch, data + start, end - start, codes);
+        stream_bits[i] = bit_position(scratch) - before;
+        *bit_count += stream_bits[i];
+        align_to_byte(scratch);
+    }
+
+    const unsigned long long* jump_table = stream_count > 1 ? stream_bits : NULL;
+    if (size == 0 || block_size_from_counts(size, *bit_count, codes, jump_table, NULL) >= raw_block_size(size)) {
+        write_raw_block(writer, data, size);
+        return 1;
+    }
+    put_block_header(writer, size, *bit_count, codes, jump_table, NULL);
+    append_bit_writer(writer, scratch);
+    return 0;
+}
+
+// --- Slices of one bitstream encoded in parallel ---
+
+// Writes a slice's bytes into the shared buffer. Bytes that the slice shares with its
+// neighbours are collected in the slice instead, so no two threads ever write the same byte.
+typedef struct SliceWriter {
+    unsigned char* out;
+    size_t pos;             // Index in out of the next byte
+    size_t first;           // Index of the slice's first byte
+    size_t last;            // Index of the slice's last byte
+    int shared_first;       // The first byte also holds bits of the previous slice
+    int shared_last;        // The last byte also holds bits of the next slice
+    EncodedSlice* slice;
+    uint64_t acc;           // Pending bits, right-aligned
+    int count;              // Number of pending bits in acc (always < 32 between calls)
+} SliceWriter;
+
+static void slice_store_byte(SliceWriter* writer, unsigned char byte) {
+    size_t pos = writer->pos++;
+    if (pos == writer->first && writer->shared_first) {
+        writer->slice->first_byte = byte;
+    } else if (pos == writer->last && writer->shared_last) {
+        writer->slice->last_byte = byte;
+    } else {
+        writer->out[pos] = byte;
+    }
+}
+
+static void slice_put_bits(SliceWriter* writer, uint64_t bits, int length) {
+    writer->acc = (writer->acc << length) | bits;
+    writer->count += length;
+    if (writer->count >= 32) {
+        writer->count -= 32;
+        uint32_t word = (uint32_t)(writer->acc >> writer->count);
+        if (writer->pos > writer->first && writer->pos + 3 < writer->last) {
+            // Interior of the slice: nobody else touches these bytes
+            unsigned char* out = writer->out + writer->pos;
+            out[0] = (unsigned char)(word >> 24);
+            out[1] = (unsigned char)(word >> 16);
+            out[2] = (unsigned char)(word >> 8);
+            out[3] = (unsigned char)word;
+            writer->pos += 4;
         } else {
-            fprintf(stderr, "Warning: Non-ASCII character (value %d) encountered, skipping.\n", character);
+            slice_store_byte(writer, (unsigned char)(word >> 24));
+            slice_store_byte(writer, (unsigned char)(word >> 16));
+            slice_store_byte(writer, (unsigned char)(word >> 8));
+            slice_store_byte(writer, (unsigned char)word);
         }
     }
+}
 
-    // After writing all characters, flush any remaining bits in the buffer
-    // This is crucial if the total number of bits is not a multiple of 8.
-    if (bit_position > 0) {
-        fputc(byte_buffer, outfile);
-        // You might need to store the number of valid bits in this last byte
-        // in the header of the compressed file for decompression.
+void encode_slice(const unsigned char* data, size_t size, const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                  unsigned char* out, EncodedSlice* slice) {
+    slice->first_byte = 0;
+    slice->last_byte = 0;
+    if (slice->bit_count == 0) {
+        return;
+    }
+
+    unsigned long long end = slice->bit_offset + slice->bit_count;
+    SliceWriter writer;
+    writer.out = out;
+    writer.first = (size_t)(slice->bit_offset / 8);
+    writer.last = (size_t)((end - 1) / 8);
+    writer.pos = writer.first;
+    writer.shared_first = slice->bit_offset % 8 != 0;
+    writer.shared_last = end % 8 != 0;
+    writer.slice = slice;
+    // Start with as many zero bits as the previous slice owns of the first byte, so every
+    // byte comes out at its final position and only needs OR-ing with its neighbour
+    writer.acc = 0;
+    writer.count = (int)(slice->bit_offset % 8);
+
+    for (size_t i = 0; i < size; i++) {
+        HuffmanCode code = codes[data[i]];
+        if (code.length <= 32) {
+            slice_put_bits(&writer, code.bits, code.length);
+        } else {
+            slice_put_bits(&writer, code.bits >> 32, code.length - 32);
+            slice_put_bits(&writer, code.bits & 0xFFFFFFFFu, 32);
+        }
     }
 
-    fclose(infile);
-    fclose(outfile);
-    printf("Compression complete. Compressed data written to %s\n", output_filename);
+    // Last partial word, padded with zero bits (the next slice fills them in)
+    while (writer.count > 0) {
+        int shift = writer.count - 8;
+        slice_store_byte(&writer, (unsigned char)(shift >= 0 ? writer.acc >> shift : writer.acc << -shift));
+        writer.count = shift > 0 ? shift : 0;
+    }
+}
+
+void merge_slice_edges(unsigned char* out, const EncodedSlice* slices, int slice_count) {
+    // Shared bytes were never written by the slices, so clear them before combining
+    for (int i = 0; i < slice_count; i++) {
+        if (slices[i].bit_count == 0) continue;
+        unsigned long long end = slices[i].bit_offset + slices[i].bit_count;
+        if (slices[i].bit_offset % 8 != 0) out[slices[i].bit_offset / 8] = 0;
+        if (end % 8 != 0) out[(end - 1) / 8] = 0;
+    }
+    for (int i = 0; i < slice_count; i++) {
+        if (slices[i].bit_count == 0) continue;
+        unsigned long long end = slices[i].bit_offset + slices[i].bit_count;
+        if (slices[i].bit_offset % 8 != 0) out[slices[i].bit_offset / 8] |= slices[i].first_byte;
+        if (end % 8 != 0) out[(end - 1) / 8] |= slices[i].last_byte;
+    }
+}
+
+long long finish_message(BitWriter* writer) {
+    flush_buffer(writer);
+    if ((writer->file != NULL && fflush(writer->file) != 0) || writer->write_error) {
+        return -1;
+    }
+    return (long long)writer->bytes_written;
+}
+
+long long finish_stream(BitWriter* writer, const BlockIndex* index) {
+    put_byte(writer, HUFFMAN_BLOCK_END);
+
+    // Block index and footer, so readers of the whole file can find every block
+    unsigned long long index_offset = writer->bytes_written + writer->pos;
+    put_varint(writer, index->count);
+    for (size_t i = 0; i < index->count; i++) {
+        put_varint(writer, index->entries[i].uncompressed_size);
+        put_varint(writer, index->entries[i].compressed_size);
+    }
+    for (int i = 0; i < 8; i++) {
+        put_byte(writer, (unsigned char)(index_offset >> (8 * i)));
+    }
+    for (int i = 0; i < HUFFMAN_INDEX_MAGIC_SIZE; i++) {
+        put_byte(writer, (unsigned char)HUFFMAN_INDEX_MAGIC[i]);
+    }
+
+    flush_buffer(writer);
+    if (writer->behind != NULL) {
+        uint64_t start = instrument_now_ns(); // Waiting for the thread to catch up
+        if (async_flush(writer->behind) != 0) {
+            writer->write_error = 1;
+        }
+        writer->write_ns += instrument_now_ns() - start;
+    }
+    if ((writer->file != NULL && fflush(writer->file) != 0) || writer->write_error) {
+        return -1;
+    }
+    return (long long)writer->bytes_written;
 }
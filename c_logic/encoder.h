@@ -4,23 +4,156 @@
 // Add this at the top of your file, or in a new header like huffman_codes.h
 #include <stdio.h>
 #include <stdlib.h> // For memory allocation, file handling, etc>
-#include "huffman_node.h" // Include your HuffmanNode definitions
+#include "huffman_node.h" // Include your HuffmanNode and HuffmanTree definitions
 #include <string.h> // Required for strcpy
 
-#define MAX_CODE_LENGTH 256 // Max possible code length (for robustness, n-1 for n characters, so 128-1=127, but keep some buffer)
+#include <stdint.h> // For uint64_t code words
+#include "huffman_tables.h" // HuffmanCode, MAX_CODE_LENGTH and DEFAULT_MAX_CODE_LENGTH
+#include "block_index.h" // Block positions written at the end of the stream
+#include "async_io.h"    // Writing the stream behind the encoder
 
-// Declare the global array for codes (defined in huffman_codes.c)
-extern char huffman_codes[128][MAX_CODE_LENGTH];
+// Code tables are HuffmanCode[HUFFMAN_ALPHABET_SIZE] arrays indexed by byte value, owned by the
+// caller, so several blocks can be coded at once on different threads. 256 * 16 bytes = 4 KB, fits in L1.
+
+// What build_huffman_codes had to do to respect the length limit
+typedef struct CodeBuildStats {
+    int optimal_max_length;             // Depth of the unrestricted Huffman tree
+    int max_length;                     // Longest code actually assigned
+    unsigned long long optimal_bits;    // Encoded size with the unrestricted tree's code lengths
+    unsigned long long encoded_bits;    // Encoded size with the assigned code lengths
+} CodeBuildStats;
 
 // Declare functions for code generation
-void init_huffman_codes_array();
-void build_huffman_codes(HuffmanNode* root);
-void print_huffman_codes();
-// Function to free the Huffman tree (declaration here, definition in main.c or a separate file)
-void free_huffman_tree(HuffmanNode* node);
-void encode_and_write_file(const char *input_filename, const char *output_filename);
-void write_huffman_map_to_file(const char* map_filename);
+void init_huffman_codes_array(HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]);
+// Builds canonical codes into codes[] from the tree's leaf depths. If the tree is deeper than
+// max_code_length, the lengths are recomputed with package-merge from the leaf frequencies.
+// stats may be NULL. Returns 0 on success, -1 if max_code_length is too small for the number
+// of characters.
+int build_huffman_codes(const HuffmanTree* tree, int max_code_length, HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], CodeBuildStats* stats);
+// Prints a code table to the given stream (stdout, or stderr when stdout carries data)
+void print_huffman_codes(const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], FILE* out);
+// Writes a code table as "ascii code-string" lines. Returns 0 on success, -1 on error (errno says why).
+int write_huffman_map_to_file(const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], const char* map_filename);
+
+#define ENCODE_IO_BUFFER_SIZE (64 * 1024)
+
+// Packs codes into a 64-bit accumulator and flushes it to a large output buffer
+// 32 bits at a time. Bits are written MSB first, so the layout is the same as writing
+// each code bit by bit. The buffer is handed to fwrite whenever it fills up, or, for a writer
+// without a file, appended to a growing memory buffer (used to encode blocks on worker threads)
+// or to a fixed buffer supplied by the caller (library output straight into the caller's memory).
+typedef struct BitWriter {
+    FILE* file;                 // NULL = write into 'memory'
+    AsyncFile* behind;          // Set to hand the flushed bytes to its thread instead of calling fwrite
+    unsigned char* memory;      // Flushed bytes of a memory writer (malloc'd, grows as needed)
+    size_t memory_capacity;
+    int fixed_memory;           // 'memory' belongs to the caller: never grown or freed, overflow sets write_error
+    unsigned char buffer[ENCODE_IO_BUFFER_SIZE];
+    size_t pos;
+    unsigned long long bytes_written; // Bytes handed to fwrite so far
+    int write_error;                  // Set if fwrite ever came up short
+    int out_of_memory;                // Set (with write_error) if 'memory' couldn't grow
+    unsigned long long write_ns;      // Time spent in fwrite, or waiting on 'behind' (see instrument.h)
+    uint64_t acc;   // Pending bits, right-aligned
+    int count;      // Number of pending bits in acc (always < 32 between calls)
+} BitWriter;
+
+// file may be NULL to collect the output in memory; free it with free_bit_writer_memory.
+// To write the file behind the encoder, set 'behind' to an AsyncFile started on it.
+void init_bit_writer(BitWriter* writer, FILE* file);
+// Writes into out[0..capacity); anything past the end is dropped and sets write_error
+void init_bit_writer_fixed(BitWriter* writer, unsigned char* out, size_t capacity);
+// Empties a memory writer but keeps its buffer, so the next block doesn't allocate again
+void reset_bit_writer(BitWriter* writer);
+void free_bit_writer_memory(BitWriter* writer);
+
+// Copies raw bytes into the stream; only valid while the writer is byte aligned
+void write_bytes(BitWriter* writer, const unsigned char* data, size_t size);
+
+// Copies everything a memory writer has produced (whole blocks, so it is byte aligned) into
+// writer. A block that failed to write fails writer too.
+void append_bit_writer(BitWriter* writer, BitWriter* block);
+
+// Writes the magic and format version that start every compressed stream
+void write_stream_header(BitWriter* writer);
+
+// Exact size in bits of a bitstream with these character counts and codes
+unsigned long long encoded_bit_count(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]);
+
+// Blocks with fewer characters are always written as one stream: the jump table and the
+// padding of four substreams would cost more than the faster decoding is worth
+#define FOUR_STREAMS_MIN_SYMBOLS 1024
+
+// Writes a block's type byte, symbol and bit counts and code length table. The block's
+// bitstream must follow. stream_bits is NULL for a one-stream block, or the exact bit counts
+// of the HUFFMAN_STREAM_COUNT substreams of a 4-stream block (written as its jump table).
+// Returns -1 (and writes nothing) if no character has a code.
+int write_block_header(BitWriter* writer, const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                       const unsigned long long* stream_bits);
+
+// Number of bytes put_varint writes for value
+int varint_size(unsigned long long value);
+
+// Exact size in bytes of a Huffman block (header and bitstreams) with these counts and codes;
+// stream_bits as for write_block_header
+unsigned long long huffman_block_size(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                                      const unsigned long long* stream_bits);
+// Size in bytes of data stored as a raw block
+unsigned long long raw_block_size(size_t size);
+// Stores data[0..size) as a raw block: type byte, varint size, the bytes unchanged
+void write_raw_block(BitWriter* writer, const unsigned char* data, size_t size);
+
+// Encodes data[0..size) as one block with the given codes. frequencies must be the block's
+// own character counts; they give the exact bit count stored in the block header.
+// With stream_bits (the bit counts of data's HUFFMAN_STREAM_SEGMENT-sized segments, see
+// write_block_header) the block is written as 4 substreams.
+// If the Huffman block would not be smaller than the data, the data is stored as a raw block
+// instead. Returns 0 for a Huffman block, 1 for a raw block.
+int encode_and_write_block(BitWriter* writer, const unsigned char* data, size_t size,
+                           const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                           const unsigned long long* stream_bits);
+
+// encode_and_write_block with the codes of a shared table (see shared_table.h): the block
+// header holds table_id instead of the code lengths. A block with a byte the table has no
+// code for is stored raw.
+int encode_and_write_block_shared(BitWriter* writer, const unsigned char* data, size_t size,
+                                  const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                                  const unsigned long long* stream_bits, uint32_t table_id);
+
+// Encodes data[0..size) as one block with codes that were not built from its own counts (e.g.
+// from a sample), so every byte of data must have a code. The bitstream is encoded into
+// scratch (a memory writer) first, which gives the exact bit counts for the header, and then
+// copied after the header into writer; or the data is stored raw if that is smaller.
+// four_streams as for the blocks of encode_and_write_block. Sets *bit_count to the encoded
+// bits. Returns 0 for a Huffman block, 1 for a raw block.
+int encode_and_write_block_unsized(BitWriter* writer, BitWriter* scratch, const unsigned char* data, size_t size,
+                                   const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], int four_streams,
+                                   unsigned long long* bit_count);
+
+// One piece of a block's bitstream, encoded by its own thread straight into the block's
+// output buffer. bit_offset and bit_count are set by the caller (the prefix sum of the
+// previous slices' bit counts); encode_slice fills in the edge bytes.
+typedef struct EncodedSlice {
+    unsigned long long bit_offset;  // Where the slice starts in the bitstream
+    unsigned long long bit_count;   // Exact number of bits the slice encodes to
+    unsigned char first_byte;       // Bits of out[bit_offset / 8] if that byte is shared
+    unsigned char last_byte;        // Bits of the slice's last byte if that byte is shared
+} EncodedSlice;
+
+// Encodes data[0..size) into out at slice->bit_offset. Bytes the slice has entirely to itself
+// are written to out; the (at most two) bytes it shares with its neighbours are kept in the
+// slice, so slices can be encoded concurrently. Call merge_slice_edges once all are done.
+void encode_slice(const unsigned char* data, size_t size, const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                  unsigned char* out, EncodedSlice* slice);
+void merge_slice_edges(unsigned char* out, const EncodedSlice* slices, int slice_count);
 
+// Flushes a writer holding a lone block, without a stream around it (see
+// huffman_compress_message). Returns the bytes written, or -1 as finish_stream.
+long long finish_message(BitWriter* writer);
 
+// Writes the end-of-stream marker, the block index and the footer, and flushes everything
+// to the file or memory. Returns the total number of bytes written, or -1 if a write failed
+// (or a fixed buffer was too small).
+long long finish_stream(BitWriter* writer, const BlockIndex* index);
 
-#endif // ENCODER_H
\ No newline at end of file
+#endif // ENCODER_H
@@ -0,0 +1,104 @@
+#include "file_mapping.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Fallback: read the whole stream into a growing heap buffer
+int read_whole_file(FILE* in, MappedFile* file) {
+    size_t capacity = 1 << 20;
+    size_t size = 0;
+    unsigned char* data = (unsigned char*)malloc(capacity);
+    if (data == NULL) {
+        perror("Failed to allocate input buffer");
+        return -1;
+    }
+
+    size_t bytes_read;
+    while ((bytes_read = fread(data + size, 1, capacity - size, in)) > 0) {
+        size += bytes_read;
+        if (size == capacity) {
+            capacity *= 2;
+            unsigned char* grown = (unsigned char*)realloc(data, capacity);
+            if (grown == NULL) {
+                perror("Failed to grow input buffer");
+                free(data);
+                return -1;
+            }
+            data = grown;
+        }
+    }
+    if (ferror(in)) {
+        perror("Error reading input file");
+        free(data);
+        return -1;
+    }
+
+    file->data = data;
+    file->size = size;
+    file->is_mapped = 0;
+    return 0;
+}
+
+int map_input_file(const char* filename, MappedFile* file) {
+    file->data = NULL;
+    file->size = 0;
+    file->is_mapped = 0;
+
+#ifndef _WIN32
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening input file");
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return 0;
+        }
+        void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            // Histogram and encoding both walk the data front to back
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            file->data = (const unsigned char*)data;
+            file->size = (size_t)st.st_size;
+            file->is_mapped = 1;
+            return 0;
+        }
+    }
+    close(fd);
+#endif
+
+    FILE* in = fopen(filename, "rb");
+    if (in == NULL) {
+        perror("Error opening input file");
+        return -1;
+    }
+    int status = read_whole_file(in, file);
+    fclose(in);
+    return status;
+}
+
+void unmap_input_file(MappedFile* file) {
+    if (file->data != NULL) {
+#ifndef _WIN32
+        if (file->is_mapped) {
+            munmap((void*)file->data, file->size);
+        } else
+#endif
+        {
+            free((void*)file->data);
+        }
+    }
+    file->data = NULL;
+    file->size = 0;
+    file->is_mapped = 0;
+}
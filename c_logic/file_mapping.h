@@ -0,0 +1,21 @@
+#ifndef FILE_MAPPING_H
+#define FILE_MAPPING_H
+
+#include <stddef.h>
+#include <stdio.h> // For FILE
+
+// Read-only view of a whole input file. Regular files are memory-mapped; anything that can't
+// be mapped (pipes, platforms without mmap) is read once into a heap buffer instead.
+typedef struct MappedFile {
+    const unsigned char* data;  // NULL for an empty file
+    size_t size;
+    int is_mapped;              // 1 = mmap'd, 0 = heap buffer
+} MappedFile;
+
+// Returns 0 on success, -1 on error (after printing the reason)
+int map_input_file(const char* filename, MappedFile* file);
+void unmap_input_file(MappedFile* file);
+// Reads all of an open stream (e.g. stdin) into a heap buffer; returns as map_input_file
+int read_whole_file(FILE* in, MappedFile* file);
+
+#endif // FILE_MAPPING_H
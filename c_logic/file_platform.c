@@ -0,0 +1,45 @@
+#ifndef _WIN32
+#ifndef _FILE_OFFSET_BITS
+#define _FILE_OFFSET_BITS 64 // 64-bit off_t for files over 2 GB on 32-bit systems
+#endif
+#define _POSIX_C_SOURCE 200809L // For fseeko, ftello, fileno and ftruncate
+#endif
+
+#include "file_platform.h"
+
+#ifdef _WIN32
+#include <io.h> // For _chsize_s and _fileno
+#else
+#include <sys/types.h> // For off_t
+#include <unistd.h>    // For ftruncate
+#endif
+
+#ifdef _WIN32
+
+int file_seek(FILE* file, long long offset, int whence) {
+    return _fseeki64(file, offset, whence) == 0 ? 0 : -1;
+}
+
+long long file_tell(FILE* file) {
+    return _ftelli64(file);
+}
+
+int file_truncate(FILE* file, unsigned long long size) {
+    return _chsize_s(_fileno(file), (long long)size) == 0 ? 0 : -1;
+}
+
+#else
+
+int file_seek(FILE* file, long long offset, int whence) {
+    return fseeko(file, (off_t)offset, whence) == 0 ? 0 : -1;
+}
+
+long long file_tell(FILE* file) {
+    return (long long)ftello(file);
+}
+
+int file_truncate(FILE* file, unsigned long long size) {
+    return ftruncate(fileno(file), (off_t)size) == 0 ? 0 : -1;
+}
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef FILE_PLATFORM_H
+#define FILE_PLATFORM_H
+
+#include <stdio.h> // For FILE
+
+// 64-bit seeking and truncation of a FILE, which the C library doesn't have: fseeko, ftello and
+// ftruncate on POSIX, _fseeki64, _ftelli64 and _chsize_s on Windows. Used to append to a stream.
+
+// Moves to offset from whence (SEEK_SET, SEEK_CUR, SEEK_END); returns 0 on success, -1 on error
+int file_seek(FILE* file, long long offset, int whence);
+// Current position in file, or -1 on error
+long long file_tell(FILE* file);
+// Cuts file off after its first size bytes; flush it first. Returns 0 on success, -1 on error
+int file_truncate(FILE* file, unsigned long long size);
+
+#endif // FILE_PLATFORM_H
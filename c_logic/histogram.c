@@ -0,0 +1,64 @@
+#include "histogram.h"
+#include <string.h> // For memcpy, memset
+
+void count_bytes(const unsigned char* data, size_t size, uint64_t counts[256]) {
+    uint32_t tables[HISTOGRAM_TABLES][256];
+
+    while (size > 0) {
+        size_t chunk = size < HISTOGRAM_CHUNK_SIZE ? size : HISTOGRAM_CHUNK_SIZE;
+        memset(tables, 0, sizeof(tables));
+
+        // 16 bytes per iteration: two 64-bit loads, each byte pulled out with a shift.
+        // The byte order of the loads doesn't matter, every byte is counted once either way.
+        size_t i = 0;
+        for (; i + 16 <= chunk; i += 16) {
+            uint64_t a, b;
+            memcpy(&a, data + i, 8);
+            memcpy(&b, data + i + 8, 8);
+            tables[0][(uint8_t)a]++;
+            tables[1][(uint8_t)(a >> 8)]++;
+            tables[2][(uint8_t)(a >> 16)]++;
+            tables[3][(uint8_t)(a >> 24)]++;
+            tables[0][(uint8_t)(a >> 32)]++;
+            tables[1][(uint8_t)(a >> 40)]++;
+            tables[2][(uint8_t)(a >> 48)]++;
+            tables[3][(uint8_t)(a >> 56)]++;
+            tables[0][(uint8_t)b]++;
+            tables[1][(uint8_t)(b >> 8)]++;
+            tables[2][(uint8_t)(b >> 16)]++;
+            tables[3][(uint8_t)(b >> 24)]++;
+            tables[0][(uint8_t)(b >> 32)]++;
+            tables[1][(uint8_t)(b >> 40)]++;
+            tables[2][(uint8_t)(b >> 48)]++;
+            tables[3][(uint8_t)(b >> 56)]++;
+        }
+        for (; i < chunk; i++) {
+            tables[0][data[i]]++;
+        }
+
+        for (int c = 0; c < 256; c++) {
+            uint64_t total = 0;
+            for (int t = 0; t < HISTOGRAM_TABLES; t++) {
+                total += tables[t][c];
+            }
+            counts[c] += total;
+        }
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+void sample_bytes(const unsigned char* data, size_t size, size_t sample_size, uint64_t counts[256]) {
+    if (size <= sample_size) {
+        count_bytes(data, size, counts);
+        return;
+    }
+    size_t prefix = sample_size / 2;
+    count_bytes(data, prefix, counts);
+
+    size_t chunk = (sample_size - prefix) / HISTOGRAM_SAMPLE_CHUNKS;
+    size_t stride = (size - prefix) / HISTOGRAM_SAMPLE_CHUNKS; // At least chunk, since size > sample_size
+    for (int i = 0; i < HISTOGRAM_SAMPLE_CHUNKS; i++) {
+        count_bytes(data + prefix + stride * i + (stride - chunk), chunk, counts);
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of interleaved count tables. Consecutive bytes go to different tables, so a run of
+// the same byte doesn't make every increment wait for the previous store to the same counter.
+#define HISTOGRAM_TABLES 4
+
+// The tables use 32-bit counters (half the cache footprint of 64-bit ones) and are folded
+// into the 64-bit totals after at most this many bytes, before a counter could overflow
+#define HISTOGRAM_CHUNK_SIZE ((size_t)1 << 30)
+
+// Adds the number of times each byte value occurs in data[0..size) to counts
+void count_bytes(const unsigned char* data, size_t size, uint64_t counts[256]);
+
+// Number of evenly spaced chunks sample_bytes takes after the prefix
+#define HISTOGRAM_SAMPLE_CHUNKS 16
+
+// Adds the counts of about sample_size bytes of data[0..size) to counts: the first half of
+// the sample is the start of the data (what an encoder sees first), the other half is
+// HISTOGRAM_SAMPLE_CHUNKS chunks spread evenly over the rest, so a change of content later
+// in the data still shows up. Counts all of data if it is not larger than sample_size.
+void sample_bytes(const unsigned char* data, size_t size, size_t sample_size, uint64_t counts[256]);
+
+#endif // HISTOGRAM_H
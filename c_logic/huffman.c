@@ -0,0 +1,1275 @@
+#include "huffman.h"
+#include "huffman_node.h"     // HuffmanTree and tree construction
+#include "encoder.h"          // Code generation and block encoding functions
+#include "decoder.h"          // Block decoding
+#include "huffman_format.h"   // Block size limits and stream layout
+#include "block_index.h"      // Block positions after the last block
+#include "canonical_codes.h"  // Size of a block's code length table
+#include "thread_pool.h"      // Worker threads of a context
+#include "parallel_encoder.h" // One table, many threads for single_table
+#include "histogram.h"        // Frequency counting kernel
+#include "block_split.h"      // Adaptive block boundaries
+#include "shared_table.h"     // Pretrained code tables
+#include "instrument.h"       // Stage timers
+#include "async_io.h"         // Reading ahead and writing behind the coder
+#include "file_platform.h"    // Seeking and truncating a stream to append to it
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h> // For SIZE_MAX
+
+// One block of input and everything a worker produces for it. Blocks are independent, so a
+// job needs nothing from any other block; only writing the results happens in block order.
+typedef struct BlockJob {
+    const unsigned char* data;      // The block's input (points into the caller's buffer or input_buffer)
+    size_t size;
+    unsigned char* input_buffer;    // Reused buffer the block is read into from a FILE
+    int max_code_length;
+    int four_streams;               // Write the block as 4 substreams when it qualifies
+    size_t sample_size;             // Build the table from a sample of a block larger than this (0 = never)
+    int exact_stats;                // Also count a sampled block exactly, for the statistics only
+    BitWriter* scratch;             // Bitstream of a sampled block, before its header is written
+    const SharedTable* shared_table; // Code every block with this pretrained table (NULL = own tables)
+
+    int status;                     // 0 = Huffman block, 1 = stored as a raw block, -1 = codes too long, -2 = no memory
+    int sampled;                    // The codes came from a sample, not from frequency_table
+    int counted;                    // frequency_table already holds the block's counts (adaptive blocks)
+    uint64_t frequency_table[HUFFMAN_ALPHABET_SIZE];
+    uint64_t segment_frequencies[HUFFMAN_STREAM_COUNT][HUFFMAN_ALPHABET_SIZE]; // Counts of the substreams' segments
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    CodeBuildStats code_stats;
+    BitWriter* output;              // Memory writer holding the encoded block
+    unsigned long long compressed_size; // Bytes the block takes in the compressed stream
+    unsigned long long exact_size;      // A sampled block's size with a table from its exact counts (exact_stats)
+    unsigned long long histogram_ns;    // Time spent on the block's stages (see HuffmanTimings)
+    unsigned long long table_ns;
+    unsigned long long coding_ns;
+
+    // Set when blocks are compressed one at a time: the block goes straight into the stream
+    BitWriter* direct_output;
+    // single_table: the block is split over all threads of slice_pool
+    int single_table;
+    ThreadPool* slice_pool;
+    int slice_threads;
+
+    int done;                       // Set under *lock once the results above are ready
+    pthread_mutex_t* lock;
+    pthread_cond_t* finished;
+} BlockJob;
+
+// One block decoded by huffman_decompress, straight into its place in the caller's buffer
+typedef struct DecodeBlockJob {
+    const unsigned char* block;
+    size_t block_size;
+    unsigned char* out;
+    size_t out_size;
+    long long result;               // Decoded bytes, or an error as from decode_block_to_memory
+    DecodeStats stats;              // This block's counters and times
+    HuffmanContext* ctx;
+} DecodeBlockJob;
+
+struct HuffmanContext {
+    HuffmanOptions options;         // thread_count resolved (never 0)
+    ThreadPool* pool;               // NULL with one thread
+
+    // Up to two blocks per thread are in flight: one being compressed, one queued behind it,
+    // so no worker waits while the finished blocks are written out in order. With a single
+    // thread, or with single_table where all threads work on one block, the window is 1.
+    int window;
+    BlockJob* jobs;
+    size_t input_buffer_size;       // Size of the jobs' input buffers (0 until a FILE is compressed)
+    pthread_mutex_t job_lock;
+    pthread_cond_t job_finished;
+
+    BitWriter* writer;              // The stream being written (64 KB buffer, kept between calls)
+    BlockIndex index;               // Blocks of the stream being written or read
+    HuffmanStats stats;
+    HuffmanDecodeStats decode_stats;
+
+    DecodeBlockJob* decode_jobs;    // One per block of the stream being decompressed
+    size_t decode_job_capacity;
+    size_t decode_remaining;        // Blocks not yet decoded, under job_lock
+
+    SharedTables shared_tables;     // Tables added to this context, kept for all later calls
+
+    // I/O threads of FILE calls with async_io, started on first use and kept for later calls
+    AsyncFile* input_ahead;
+    AsyncFile* output_behind;
+};
+
+void huffman_default_options(HuffmanOptions* options) {
+    options->max_code_length = DEFAULT_MAX_CODE_LENGTH;
+    options->block_size = 0;
+    options->thread_count = 1;
+    options->single_table = 0;
+    options->four_streams = 0;
+    options->sample_size = 0;
+    options->adaptive_blocks = 0;
+    options->async_io = 1;
+    options->exact_sample_stats = 0;
+}
+
+// options with the defaults filled in and thread_count resolved
+static HuffmanOptions resolve_options(const HuffmanOptions* options) {
+    HuffmanOptions resolved;
+    if (options != NULL) {
+        resolved = *options;
+    } else {
+        huffman_default_options(&resolved);
+    }
+    if (resolved.thread_count == 0) {
+        resolved.thread_count = online_cpu_count();
+    }
+    return resolved;
+}
+
+HuffmanStatus huffman_check_options(const HuffmanOptions* options) {
+    HuffmanOptions resolved = resolve_options(options);
+    if (resolved.max_code_length < 1 || resolved.max_code_length > MAX_CODE_LENGTH
+        || resolved.block_size > HUFFMAN_MAX_BLOCK_SIZE
+        || resolved.thread_count < 1 || resolved.thread_count > 1024
+        || (resolved.sample_size > 0 && (resolved.max_code_length < 8 || resolved.single_table))
+        || (resolved.adaptive_blocks && (resolved.single_table || resolved.sample_size > 0))) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    return HUFFMAN_OK;
+}
+
+HuffmanContext* huffman_create_context(const HuffmanOptions* options) {
+    if (huffman_check_options(options) != HUFFMAN_OK) {
+        return NULL;
+    }
+    HuffmanOptions resolved = resolve_options(options);
+
+    HuffmanContext* ctx = (HuffmanContext*)calloc(1, sizeof(HuffmanContext));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->options = resolved;
+    ctx->window = resolved.thread_count > 1 && !resolved.single_table ? 2 * resolved.thread_count : 1;
+    pthread_mutex_init(&ctx->job_lock, NULL);
+    pthread_cond_init(&ctx->job_finished, NULL);
+    init_block_index(&ctx->index);
+    init_shared_tables(&ctx->shared_tables);
+
+    // Everything a context needs is allocated here; if any of it fails, so does the context
+    int failed = 0;
+    if (resolved.thread_count > 1) {
+        ctx->pool = create_thread_pool(resolved.thread_count);
+        failed |= ctx->pool == NULL;
+    }
+    ctx->writer = (BitWriter*)malloc(sizeof(BitWriter));
+    ctx->jobs = (BlockJob*)calloc((size_t)ctx->window, sizeof(BlockJob));
+    if (failed || ctx->writer == NULL || ctx->jobs == NULL) {
+        huffman_free_context(ctx);
+        return NULL;
+    }
+    init_bit_writer(ctx->writer, NULL);
+    for (int i = 0; i < ctx->window; i++) {
+        BlockJob* job = &ctx->jobs[i];
+        job->output = (BitWriter*)malloc(sizeof(BitWriter));
+        failed |= job->output == NULL;
+        if (job->output != NULL) {
+            init_bit_writer(job->output, NULL);
+        }
+        if (resolved.sample_size > 0) {
+            job->scratch = (BitWriter*)malloc(sizeof(BitWriter));
+            failed |= job->scratch == NULL;
+            if (job->scratch != NULL) {
+                init_bit_writer(job->scratch, NULL);
+            }
+        }
+        job->sample_size = resolved.sample_size;
+        job->exact_stats = resolved.exact_sample_stats;
+        job->max_code_length = resolved.max_code_length;
+        job->four_streams = resolved.four_streams;
+        job->single_table = resolved.single_table;
+        job->slice_pool = ctx->pool;
+        job->slice_threads = resolved.thread_count;
+        job->lock = &ctx->job_lock;
+        job->finished = &ctx->job_finished;
+    }
+    if (failed) {
+        huffman_free_context(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void huffman_free_context(HuffmanContext* ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    free_thread_pool(ctx->pool);
+    free_async_file(ctx->input_ahead);
+    free_async_file(ctx->output_behind);
+    for (int i = 0; ctx->jobs != NULL && i < ctx->window; i++) {
+        if (ctx->jobs[i].output != NULL) {
+            free_bit_writer_memory(ctx->jobs[i].output);
+            free(ctx->jobs[i].output);
+        }
+        if (ctx->jobs[i].scratch != NULL) {
+            free_bit_writer_memory(ctx->jobs[i].scratch);
+            free(ctx->jobs[i].scratch);
+        }
+        free(ctx->jobs[i].input_buffer);
+    }
+    free(ctx->jobs);
+    pthread_cond_destroy(&ctx->job_finished);
+    pthread_mutex_destroy(&ctx->job_lock);
+    free(ctx->writer);
+    free_block_index(&ctx->index);
+    free(ctx->decode_jobs);
+    free_shared_tables(&ctx->shared_tables);
+    free(ctx);
+}
+
+const HuffmanStats* huffman_last_stats(const HuffmanContext* ctx) {
+    return &ctx->stats;
+}
+
+const HuffmanDecodeStats* huffman_last_decode_stats(const HuffmanContext* ctx) {
+    return &ctx->decode_stats;
+}
+
+const char* huffman_status_string(HuffmanStatus status) {
+    switch (status) {
+        case HUFFMAN_OK: return "success";
+        case HUFFMAN_ERROR_INVALID_ARGUMENT: return "invalid argument";
+        case HUFFMAN_ERROR_DST_TOO_SMALL: return "output buffer too small";
+        case HUFFMAN_ERROR_CORRUPT_INPUT: return "corrupt or unsupported compressed data";
+        case HUFFMAN_ERROR_CODE_LENGTH: return "maximum code length too small for the input";
+        case HUFFMAN_ERROR_IO: return "read or write error";
+        case HUFFMAN_ERROR_UNKNOWN_TABLE: return "shared code table not loaded";
+        case HUFFMAN_ERROR_NO_MEMORY: return "out of memory";
+    }
+    return "unknown error";
+}
+
+// --- Compression ---
+
+// Input bytes per block. A FILE is read a block at a time, so it never gets one unbounded block.
+static size_t block_size_for(const HuffmanContext* ctx, int from_file) {
+    if (ctx->options.block_size != 0) {
+        return ctx->options.block_size;
+    }
+    if (ctx->options.adaptive_blocks) {
+        return HUFFMAN_DEFAULT_ADAPTIVE_BLOCK_SIZE;
+    }
+    return ctx->options.single_table && !from_file ? SIZE_MAX : HUFFMAN_DEFAULT_BLOCK_SIZE;
+}
+
+size_t huffman_compress_bound(const HuffmanContext* ctx, size_t src_size) {
+    size_t block_size = block_size_for(ctx, 0);
+    size_t blocks = src_size / block_size + (src_size % block_size != 0);
+    if (ctx->options.adaptive_blocks) {
+        blocks = src_size / BLOCK_SPLIT_CHUNK + 1; // Only the last block can be shorter than a chunk
+    }
+    // A Huffman block is only written when it is smaller than the raw block, so no block
+    // takes more than its type byte and size varint on top of its input
+    size_t block_overhead = 1 + HUFFMAN_MAX_VARINT_BYTES
+                            + 2 * HUFFMAN_MAX_VARINT_BYTES; // Index entry
+    return HUFFMAN_STREAM_HEADER_SIZE + src_size + blocks * block_overhead
+           + 1 + HUFFMAN_MAX_VARINT_BYTES + HUFFMAN_FOOTER_SIZE;
+}
+
+// Counts the bytes of one block into frequencies. A block that may become 4 substreams is
+// counted segment by segment: the segments' counts add up to the block's, and they give each
+// substream's exact bit count. Returns 1 if the block is written as 4 substreams.
+static int count_block(const unsigned char* data, size_t size, int four_streams,
+                       uint64_t frequencies[HUFFMAN_ALPHABET_SIZE],
+                       uint64_t segment_frequencies[HUFFMAN_STREAM_COUNT][HUFFMAN_ALPHABET_SIZE]) {
+    memset(frequencies, 0, sizeof(uint64_t) * HUFFMAN_ALPHABET_SIZE);
+    if (!four_streams || size < FOUR_STREAMS_MIN_SYMBOLS) {
+        count_bytes(data, size, frequencies);
+        return 0;
+    }
+    size_t segment = HUFFMAN_STREAM_SEGMENT(size);
+    for (int i = 0; i < HUFFMAN_STREAM_COUNT; i++) {
+        size_t start = segment * i < size ? segment * i : size;
+        size_t end = size - start > segment ? start + segment : size;
+        memset(segment_frequencies[i], 0, sizeof(uint64_t) * HUFFMAN_ALPHABET_SIZE);
+        count_bytes(data + start, end - start, segment_frequencies[i]);
+        for (int c = 0; c < HUFFMAN_ALPHABET_SIZE; c++) {
+            frequencies[c] += segment_frequencies[i][c];
+        }
+    }
+    return 1;
+}
+
+// Adds one block with these counts to estimate and sets *written to the bytes it would take.
+// segment_frequencies is NULL for a one-stream block, as for count_block. code_stats may be NULL.
+static HuffmanStatus estimate_counts(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE],
+                                     uint64_t (*segment_frequencies)[HUFFMAN_ALPHABET_SIZE],
+                                     int max_code_length, HuffmanEstimate* estimate, unsigned long long* written,
+                                     CodeBuildStats* code_stats) {
+    unsigned long long symbol_count = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        symbol_count += (unsigned long long)frequencies[i];
+    }
+    estimate->block_count++;
+    estimate->sampled_size += symbol_count;
+    *written = raw_block_size((size_t)symbol_count);
+
+    // Same tree and codes as compress_block, so the sizes are the ones it would write
+    HuffmanTree tree;
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    if (build_huffman_tree(frequencies, &tree) != 0) {
+        estimate->raw_blocks++; // Nothing to code
+        estimate->block_bytes += *written;
+        return HUFFMAN_OK;
+    }
+    if (build_huffman_codes(&tree, max_code_length, codes, code_stats) != 0) {
+        return HUFFMAN_ERROR_CODE_LENGTH;
+    }
+
+    unsigned long long stream_bits[HUFFMAN_STREAM_COUNT];
+    unsigned long long bit_count = encoded_bit_count(frequencies, codes);
+    unsigned long long payload = (bit_count + 7) / 8;
+    if (segment_frequencies != NULL) {
+        payload = 0;
+        for (int i = 0; i < HUFFMAN_STREAM_COUNT; i++) {
+            stream_bits[i] = encoded_bit_count(segment_frequencies[i], codes);
+            payload += (stream_bits[i] + 7) / 8;
+        }
+    }
+    unsigned long long huffman_size = huffman_block_size(frequencies, codes, segment_frequencies != NULL ? stream_bits : NULL);
+    estimate->coded_bits += bit_count;
+    estimate->entropy_bits += entropy_bits(frequencies, symbol_count);
+    if (huffman_size >= *written) {
+        estimate->raw_blocks++;
+    } else {
+        estimate->header_bytes += huffman_size - payload;
+        *written = huffman_size;
+    }
+    estimate->block_bytes += *written;
+    return HUFFMAN_OK;
+}
+
+// Histogram, tree, codes and encoding of one block; runs on a worker thread (or inline)
+static void compress_block(void* arg) {
+    BlockJob* job = (BlockJob*)arg;
+    BitWriter* output = job->direct_output;
+    if (output == NULL) {
+        output = job->output;
+        reset_bit_writer(output); // Drop the previous block's output, keep its memory
+    }
+    unsigned long long before = output->bytes_written + output->pos;
+    unsigned long long write_before = output->write_ns; // A direct output writes to its FILE while encoding
+    uint64_t start = instrument_now_ns();
+    uint64_t counted = start; // End of counting
+    uint64_t tabled = start;  // End of the tree and codes
+    job->sampled = 0;
+
+    if (job->shared_table != NULL) {
+        // The codes are fixed: count only for the header's bit counts and the raw fallback
+        int four_streams = count_block(job->data, job->size, job->four_streams,
+                                       job->frequency_table, job->segment_frequencies);
+        counted = tabled = instrument_now_ns();
+        unsigned long long stream_bits[HUFFMAN_STREAM_COUNT];
+        for (int i = 0; four_streams && i < HUFFMAN_STREAM_COUNT; i++) {
+            stream_bits[i] = encoded_bit_count(job->segment_frequencies[i], job->shared_table->codes);
+        }
+        memcpy(job->codes, job->shared_table->codes, sizeof(job->codes));
+        memset(&job->code_stats, 0, sizeof(job->code_stats));
+        job->status = encode_and_write_block_shared(output, job->data, job->size, job->frequency_table, job->codes,
+                                                    four_streams ? stream_bits : NULL, job->shared_table->id);
+    } else if (job->single_table) {
+        // Counting, tree and encoding all happen in parallel slices of this one block
+        job->status = encode_block_parallel(output, job->slice_pool, job->slice_threads,
+                                            job->data, job->size, job->max_code_length, job->four_streams,
+                                            job->frequency_table, job->codes, &job->code_stats);
+    } else if (job->sample_size > 0 && job->size > job->sample_size) {
+        // One pass over the block: the table comes from a sample, and every byte value gets
+        // one extra count so the bytes the sample missed still have a (long) code
+        job->sampled = 1;
+        memset(job->frequency_table, 0, sizeof(job->frequency_table));
+        sample_bytes(job->data, job->size, job->sample_size, job->frequency_table);
+        for (int c = 0; c < HUFFMAN_ALPHABET_SIZE; c++) {
+            job->frequency_table[c]++;
+        }
+        counted = instrument_now_ns();
+        HuffmanTree huffman_tree;
+        unsigned long long bit_count;
+        if (build_huffman_tree(job->frequency_table, &huffman_tree) != 0
+            || build_huffman_codes(&huffman_tree, job->max_code_length, job->codes, NULL) != 0) {
+            job->status = -1;
+        } else {
+            tabled = instrument_now_ns();
+            job->status = encode_and_write_block_unsized(output, job->scratch, job->data, job->size, job->codes,
+                                                         job->four_streams, &bit_count);
+        }
+    } else {
+        // --- Frequency count for this block (adaptive blocks were counted when they were cut,
+        // but a 4-stream block still needs its segments' counts) ---
+        int four_streams = job->four_streams && job->size >= FOUR_STREAMS_MIN_SYMBOLS;
+        if (!job->counted || four_streams) {
+            four_streams = count_block(job->data, job->size, job->four_streams,
+                                       job->frequency_table, job->segment_frequencies);
+        }
+        counted = instrument_now_ns();
+
+        // --- Huffman Tree Building and code generation ---
+        HuffmanTree huffman_tree; // ~8 KB on the stack, no allocation per node
+        if (build_huffman_tree(job->frequency_table, &huffman_tree) != 0
+            || build_huffman_codes(&huffman_tree, job->max_code_length, job->codes, &job->code_stats) != 0) {
+            job->status = -1;
+        } else {
+            unsigned long long stream_bits[HUFFMAN_STREAM_COUNT];
+            for (int i = 0; four_streams && i < HUFFMAN_STREAM_COUNT; i++) {
+                stream_bits[i] = encoded_bit_count(job->segment_frequencies[i], job->codes);
+            }
+            tabled = instrument_now_ns();
+
+            // --- Encode the block: header with its code lengths, then its bits (or raw bytes) ---
+            job->status = encode_and_write_block(output, job->data, job->size, job->frequency_table, job->codes,
+                                                 four_streams ? stream_bits : NULL);
+        }
+    }
+    job->compressed_size = output->bytes_written + output->pos - before;
+    // A failed tree leaves tabled at the start; single_table counts everything as coding
+    if (tabled < counted) tabled = counted;
+    uint64_t end = instrument_now_ns();
+    job->histogram_ns = counted - start;
+    job->table_ns = tabled - counted;
+    job->coding_ns = end - tabled - (output->write_ns - write_before);
+
+    if (job->sampled && job->exact_stats && job->status >= 0) {
+        // Only for the statistics, after the block is encoded: what would the two-pass table
+        // have given? This is the counting pass sampling saves, so it is opt-in.
+        HuffmanEstimate exact;
+        memset(&exact, 0, sizeof(exact));
+        int four_streams = count_block(job->data, job->size, job->four_streams,
+                                       job->frequency_table, job->segment_frequencies);
+        estimate_counts(job->frequency_table, four_streams ? job->segment_frequencies : NULL,
+                        job->max_code_length, &exact, &job->exact_size, &job->code_stats);
+        job->histogram_ns += instrument_now_ns() - end;
+    }
+
+    pthread_mutex_lock(job->lock);
+    job->done = 1;
+    pthread_cond_broadcast(job->finished);
+    pthread_mutex_unlock(job->lock);
+}
+
+// The I/O thread in *slot, started on first use, or NULL without async_io. If the thread
+// can't be started it is NULL too, and the caller reads or writes the FILE itself.
+static AsyncFile* io_thread(const HuffmanContext* ctx, AsyncFile** slot) {
+    if (!ctx->options.async_io) {
+        return NULL;
+    }
+    if (*slot == NULL) {
+        *slot = create_async_file();
+    }
+    return *slot;
+}
+
+// Status for a writer that failed: a block's buffer couldn't grow, a fixed buffer ran out, or
+// a FILE write failed
+static HuffmanStatus write_failure(const BitWriter* writer) {
+    if (writer->out_of_memory) {
+        return HUFFMAN_ERROR_NO_MEMORY;
+    }
+    return writer->file == NULL ? HUFFMAN_ERROR_DST_TOO_SMALL : HUFFMAN_ERROR_IO;
+}
+
+// Status for a block whose worker failed (BlockJob.status < 0)
+static HuffmanStatus job_failure(const BlockJob* job) {
+    return job->status == -2 ? HUFFMAN_ERROR_NO_MEMORY : HUFFMAN_ERROR_CODE_LENGTH;
+}
+
+// Compresses data[0..size), or everything read from input when input isn't NULL (through
+// input_ahead's thread unless it is NULL), into writer as a whole stream, and fills in ctx->stats.
+// With append, ctx->index already lists the blocks of a stream and writer continues it at its
+// END byte (bytes_written is that byte's position) instead of starting a new one.
+static HuffmanStatus compress_blocks(HuffmanContext* ctx, const unsigned char* data, size_t size,
+                                     FILE* input, AsyncFile* input_ahead, BitWriter* writer, int append) {
+    size_t block_size = block_size_for(ctx, input != NULL);
+    int window = ctx->window;
+    HuffmanStats* stats = &ctx->stats;
+    HuffmanTimings* timings = &stats->timings;
+    memset(stats, 0, sizeof(*stats));
+
+    // A FILE is read one block at a time into reusable buffers, so memory use stays at a
+    // few blocks per thread no matter how long the stream is
+    if (input != NULL && ctx->input_buffer_size < block_size) {
+        ctx->input_buffer_size = block_size;
+        for (int i = 0; i < window; i++) {
+            free(ctx->jobs[i].input_buffer);
+            ctx->jobs[i].input_buffer = (unsigned char*)malloc(block_size);
+            if (ctx->jobs[i].input_buffer == NULL) {
+                ctx->input_buffer_size = 0; // The next call allocates them all again
+                return HUFFMAN_ERROR_NO_MEMORY;
+            }
+        }
+    }
+    for (int i = 0; i < window; i++) {
+        ctx->jobs[i].direct_output = window == 1 ? writer : NULL;
+    }
+
+    uint64_t start = instrument_now_ns();
+    unsigned long long write_before = writer->write_ns;
+    unsigned long long stream_before = writer->bytes_written; // Where this call's output starts
+    if (!append) {
+        clear_block_index(&ctx->index);
+        write_stream_header(writer);
+    }
+
+    HuffmanStatus status = HUFFMAN_OK;
+    size_t offset = 0;
+    int input_done = 0;
+    int input_eof = 0;
+    const unsigned char* carry = NULL; // Bytes read past an adaptive block's end, for the next block
+    size_t carry_size = 0;
+    BlockSplitCarry split_carry;        // Counts of the chunk an adaptive block ended before
+    split_carry.size = 0;
+    unsigned long long next_submit = 0; // Blocks handed out so far
+    unsigned long long next_write = 0;  // Blocks written so far
+    for (;;) {
+        // --- Hand out blocks until the window is full ---
+        while (!input_done && next_submit - next_write < (unsigned long long)window) {
+            BlockJob* job = &ctx->jobs[next_submit % window];
+            job->counted = ctx->options.adaptive_blocks;
+            if (input != NULL) {
+                // The carry is still in the previous block's buffer (the same one with a window of 1)
+                size_t filled = carry_size;
+                if (carry_size > 0) {
+                    memmove(job->input_buffer, carry, carry_size);
+                }
+                if (!input_eof) {
+                    uint64_t read_start = instrument_now_ns();
+                    size_t bytes_read = input_ahead != NULL
+                        ? async_read(input_ahead, job->input_buffer + filled, block_size - filled)
+                        : fread(job->input_buffer + filled, 1, block_size - filled, input);
+                    timings->read_ns += instrument_now_ns() - read_start;
+                    if (bytes_read < block_size - filled) {
+                        input_eof = 1; // Short read: end of input
+                        // The read-ahead thread is done with the file by now, so its session can end here
+                        if (input_ahead != NULL ? async_stop(input_ahead) != 0 : ferror(input)) {
+                            status = HUFFMAN_ERROR_IO;
+                            input_done = 1;
+                            break;
+                        }
+                    }
+                    filled += bytes_read;
+                }
+                job->data = job->input_buffer;
+                uint64_t cut_start = instrument_now_ns();
+                job->size = job->counted ? next_block_size(job->data, filled, block_size, job->frequency_table, &split_carry) : filled;
+                timings->histogram_ns += instrument_now_ns() - cut_start;
+                carry = job->data + job->size;
+                carry_size = filled - job->size;
+                input_done = input_eof && carry_size == 0;
+            } else {
+                job->size = size - offset < block_size ? size - offset : block_size;
+                if (job->counted) {
+                    uint64_t cut_start = instrument_now_ns();
+                    job->size = next_block_size(data + offset, size - offset, block_size, job->frequency_table, &split_carry);
+                    timings->histogram_ns += instrument_now_ns() - cut_start;
+                }
+                job->data = data + offset;
+                offset += job->size;
+                input_done = offset == size;
+            }
+            if (job->size == 0) {
+                break;
+            }
+            stats->uncompressed_size += job->size;
+
+            job->done = 0;
+            if (window > 1) {
+                thread_pool_submit(ctx->pool, compress_block, job);
+            } else {
+                compress_block(job);
+            }
+            next_submit++;
+        }
+        if (next_write == next_submit) {
+            break; // Everything handed out has been written
+        }
+
+        // --- Write the oldest block once its worker is done ---
+        BlockJob* job = &ctx->jobs[next_write % window];
+        uint64_t wait_start = instrument_now_ns();
+        pthread_mutex_lock(&ctx->job_lock);
+        while (!job->done) {
+            pthread_cond_wait(&ctx->job_finished, &ctx->job_lock);
+        }
+        pthread_mutex_unlock(&ctx->job_lock);
+        timings->wait_ns += instrument_now_ns() - wait_start;
+        timings->histogram_ns += job->histogram_ns;
+        timings->table_ns += job->table_ns;
+        timings->coding_ns += job->coding_ns;
+        next_write++;
+
+        if (status != HUFFMAN_OK) {
+            continue; // Only draining the blocks still in flight
+        }
+        if (job->status < 0) {
+            status = job_failure(job);
+            input_done = 1;
+            continue;
+        }
+
+        if (job->direct_output == NULL) {
+            append_bit_writer(writer, job->output);
+        }
+        if (writer->write_error) {
+            status = write_failure(writer);
+            input_done = 1;
+            continue;
+        }
+
+        if (add_block_index_entry(&ctx->index, job->size, job->compressed_size) != 0) {
+            status = HUFFMAN_ERROR_NO_MEMORY;
+            input_done = 1;
+            continue;
+        }
+        stats->block_count++;
+        // A sampled block's counts and length limit cost are only known with exact_stats
+        int counted_exactly = !job->sampled || job->exact_stats;
+        if (job->sampled) {
+            stats->sampled_blocks++;
+            stats->sampled_block_bytes += job->compressed_size;
+            if (job->exact_stats) stats->exact_block_bytes += job->exact_size;
+        }
+        for (int i = 0; counted_exactly && i < HUFFMAN_ALPHABET_SIZE; i++) {
+            stats->frequencies[i] += job->frequency_table[i];
+        }
+        if (job->status > 0) {
+            stats->raw_blocks++; // Stored as is: its codes were never used
+            continue;
+        }
+        if (stats->block_count - stats->raw_blocks == 1) {
+            for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+                stats->first_block_code_lengths[i] = job->codes[i].length;
+            }
+        }
+        int max_length = 0;
+        for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+            if (job->codes[i].length > max_length) max_length = job->codes[i].length;
+        }
+        if (max_length > stats->max_code_length) stats->max_code_length = max_length;
+        if (!counted_exactly) {
+            continue;
+        }
+        if (job->code_stats.optimal_max_length > stats->optimal_max_length) stats->optimal_max_length = job->code_stats.optimal_max_length;
+        stats->optimal_bits += job->code_stats.optimal_bits;
+        stats->encoded_bits += job->code_stats.encoded_bits;
+    }
+
+    // The stream is always finished, so even a failed run leaves a well-formed file behind
+    long long compressed_size = finish_stream(writer, &ctx->index);
+    if (compressed_size < 0) {
+        if (status == HUFFMAN_OK) status = write_failure(writer);
+        compressed_size = (long long)stream_before;
+    }
+    stats->compressed_size = (unsigned long long)compressed_size - stream_before;
+    timings->write_ns = writer->write_ns - write_before;
+    timings->total_ns = instrument_now_ns() - start;
+    return status;
+}
+
+HuffmanStatus huffman_compress(HuffmanContext* ctx, const void* src, size_t src_size,
+                               void* dst, size_t dst_capacity, size_t* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || (dst == NULL && dst_capacity > 0) || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    init_bit_writer_fixed(ctx->writer, (unsigned char*)dst, dst_capacity);
+    HuffmanStatus status = compress_blocks(ctx, (const unsigned char*)src, src_size, NULL, NULL, ctx->writer, 0);
+    *dst_size = status == HUFFMAN_OK ? (size_t)ctx->stats.compressed_size : 0;
+    return status;
+}
+
+HuffmanStatus huffman_compress_to_file(HuffmanContext* ctx, const void* src, size_t src_size,
+                                       FILE* output, unsigned long long* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || output == NULL || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    init_bit_writer(ctx->writer, output);
+    ctx->writer->behind = io_thread(ctx, &ctx->output_behind);
+    if (ctx->writer->behind != NULL) {
+        async_start(ctx->writer->behind, output, ASYNC_WRITE);
+    }
+    HuffmanStatus status = compress_blocks(ctx, (const unsigned char*)src, src_size, NULL, NULL, ctx->writer, 0);
+    if (ctx->writer->behind != NULL) {
+        async_stop(ctx->writer->behind); // finish_stream already waited for it and saw any error
+    }
+    *dst_size = ctx->stats.compressed_size;
+    return status;
+}
+
+HuffmanStatus huffman_compress_stream(HuffmanContext* ctx, FILE* input, FILE* output, unsigned long long* dst_size) {
+    if (ctx == NULL || input == NULL || output == NULL || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    // Three stages at once: the input is read ahead on one I/O thread while blocks are coded,
+    // and the finished stream is written behind on the other
+    AsyncFile* input_ahead = io_thread(ctx, &ctx->input_ahead);
+    init_bit_writer(ctx->writer, output);
+    ctx->writer->behind = io_thread(ctx, &ctx->output_behind);
+    if (input_ahead != NULL) {
+        async_start(input_ahead, input, ASYNC_READ);
+    }
+    if (ctx->writer->behind != NULL) {
+        async_start(ctx->writer->behind, output, ASYNC_WRITE);
+    }
+    HuffmanStatus status = compress_blocks(ctx, NULL, 0, input, input_ahead, ctx->writer, 0);
+    if (input_ahead != NULL) {
+        async_stop(input_ahead); // A read error was seen as a short read
+    }
+    if (ctx->writer->behind != NULL) {
+        async_stop(ctx->writer->behind);
+    }
+    *dst_size = ctx->stats.compressed_size;
+    return status;
+}
+
+// --- Appending ---
+
+// Reads the end of the stream in file (opened for reading and writing) into ctx->index: its
+// footer, then its END byte and index, which are kept in *tail (malloc'd, *tail_size bytes)
+// so a failed append can write them back. Nothing before them is read but the stream header.
+// Leaves file at the END byte, whose position is *append_at; an empty file has no stream yet
+// (*append_at = 0).
+static HuffmanStatus read_stream_end(HuffmanContext* ctx, FILE* file, unsigned long long* append_at,
+                                     unsigned char** tail, size_t* tail_size) {
+    *tail = NULL;
+    *tail_size = 0;
+    *append_at = 0;
+    clear_block_index(&ctx->index);
+    if (file_seek(file, 0, SEEK_END) != 0) {
+        return HUFFMAN_ERROR_IO;
+    }
+    long long size = file_tell(file);
+    if (size <= 0) {
+        return size < 0 ? HUFFMAN_ERROR_IO : HUFFMAN_OK;
+    }
+
+    unsigned char header[HUFFMAN_STREAM_HEADER_SIZE];
+    unsigned char footer[HUFFMAN_FOOTER_SIZE];
+    unsigned long long index_offset = 0;
+    int complete = size >= HUFFMAN_STREAM_HEADER_SIZE + 1 + HUFFMAN_FOOTER_SIZE
+        && file_seek(file, 0, SEEK_SET) == 0 && fread(header, 1, sizeof(header), file) == sizeof(header)
+        && file_seek(file, size - HUFFMAN_FOOTER_SIZE, SEEK_SET) == 0 && fread(footer, 1, sizeof(footer), file) == sizeof(footer);
+    if (ferror(file)) {
+        return HUFFMAN_ERROR_IO;
+    }
+    if (!complete || check_stream_header(header, sizeof(header)) != 0 || read_block_index_offset(footer, &index_offset) != 0
+        || index_offset <= HUFFMAN_STREAM_HEADER_SIZE || index_offset > (unsigned long long)size - HUFFMAN_FOOTER_SIZE) {
+        return HUFFMAN_ERROR_CORRUPT_INPUT; // Not a stream of this format version
+    }
+
+    *tail_size = (size_t)((unsigned long long)size - (index_offset - 1));
+    *tail = (unsigned char*)malloc(*tail_size);
+    if (*tail == NULL) {
+        return HUFFMAN_ERROR_NO_MEMORY;
+    }
+    if (file_seek(file, (long long)(index_offset - 1), SEEK_SET) != 0 || fread(*tail, 1, *tail_size, file) != *tail_size) {
+        return HUFFMAN_ERROR_IO;
+    }
+    int index_status = read_block_index_tail(*tail, *tail_size, (unsigned long long)size, &ctx->index);
+    if (index_status != 0) {
+        return index_status == -2 ? HUFFMAN_ERROR_NO_MEMORY : HUFFMAN_ERROR_CORRUPT_INPUT;
+    }
+    // Switching from reading to writing needs a seek anyway
+    if (file_seek(file, (long long)(index_offset - 1), SEEK_SET) != 0) {
+        return HUFFMAN_ERROR_IO;
+    }
+    *append_at = index_offset - 1;
+    return HUFFMAN_OK;
+}
+
+// Appends data[0..size), or what is read from input, to the stream in file. The new blocks go
+// where the END byte was and the index is written again after them, so the stream only grows:
+// the old entries take the same bytes as before and the new ones come on top. The format has
+// the blocks run up to the END byte, so they can't be written anywhere but over the old end:
+// until the new trailer is written, the file has none, and a crash then leaves it damaged.
+static HuffmanStatus append_blocks(HuffmanContext* ctx, const unsigned char* data, size_t size,
+                                   FILE* input, FILE* file, unsigned long long* dst_size) {
+    unsigned long long append_at;
+    unsigned char* tail;
+    size_t tail_size;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    HuffmanStatus status = read_stream_end(ctx, file, &append_at, &tail, &tail_size);
+    if (status != HUFFMAN_OK) {
+        free(tail);
+        *dst_size = 0;
+        return status;
+    }
+
+    AsyncFile* input_ahead = input != NULL ? io_thread(ctx, &ctx->input_ahead) : NULL;
+    init_bit_writer(ctx->writer, file);
+    ctx->writer->bytes_written = append_at; // The new blocks' offsets follow the old ones
+    ctx->writer->behind = io_thread(ctx, &ctx->output_behind);
+    if (input_ahead != NULL) {
+        async_start(input_ahead, input, ASYNC_READ);
+    }
+    if (ctx->writer->behind != NULL) {
+        async_start(ctx->writer->behind, file, ASYNC_WRITE);
+    }
+    status = compress_blocks(ctx, data, size, input, input_ahead, ctx->writer, append_at > 0);
+    if (input_ahead != NULL) {
+        async_stop(input_ahead);
+    }
+    if (ctx->writer->behind != NULL) {
+        async_stop(ctx->writer->behind);
+    }
+
+    *dst_size = append_at + ctx->stats.compressed_size;
+    if (status != HUFFMAN_OK) {
+        // A failed append is undone: the old END byte, index and footer go back where they
+        // were and whatever was written past them is cut off
+        if (file_seek(file, (long long)append_at, SEEK_SET) != 0 || fwrite(tail, 1, tail_size, file) != tail_size
+            || fflush(file) != 0 || file_truncate(file, append_at + tail_size) != 0) {
+            status = HUFFMAN_ERROR_IO; // The file may be left damaged
+        }
+        *dst_size = append_at + tail_size;
+    }
+    free(tail);
+    return status;
+}
+
+HuffmanStatus huffman_append_to_file(HuffmanContext* ctx, const void* src, size_t src_size,
+                                     FILE* stream, unsigned long long* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || stream == NULL || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    return append_blocks(ctx, (const unsigned char*)src, src_size, NULL, stream, dst_size);
+}
+
+HuffmanStatus huffman_append_stream(HuffmanContext* ctx, FILE* input, FILE* stream, unsigned long long* dst_size) {
+    if (ctx == NULL || input == NULL || stream == NULL || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    return append_blocks(ctx, NULL, 0, input, stream, dst_size);
+}
+
+// --- Shared tables ---
+
+HuffmanStatus huffman_train_table(const void* const* samples, const size_t* sample_sizes, size_t sample_count,
+                                  int max_code_length, void* dst, size_t dst_capacity, size_t* dst_size,
+                                  uint32_t* table_id) {
+    if ((samples == NULL && sample_count > 0) || (sample_sizes == NULL && sample_count > 0)
+        || dst == NULL || dst_size == NULL || table_id == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (max_code_length == 0) {
+        max_code_length = DEFAULT_MAX_CODE_LENGTH;
+    }
+    if (max_code_length < 8 || max_code_length > MAX_CODE_LENGTH) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    if (dst_capacity < HUFFMAN_TABLE_MAX_SIZE) {
+        return HUFFMAN_ERROR_DST_TOO_SMALL;
+    }
+    uint64_t frequencies[HUFFMAN_ALPHABET_SIZE];
+    memset(frequencies, 0, sizeof(frequencies));
+    for (size_t i = 0; i < sample_count; i++) {
+        count_bytes((const unsigned char*)samples[i], sample_sizes[i], frequencies);
+    }
+    *dst_size = train_shared_table(frequencies, max_code_length, (unsigned char*)dst, table_id);
+    return *dst_size > 0 ? HUFFMAN_OK : HUFFMAN_ERROR_CODE_LENGTH;
+}
+
+HuffmanStatus huffman_add_shared_table(HuffmanContext* ctx, const void* table, size_t table_size, uint32_t* table_id) {
+    if (ctx == NULL || table == NULL || table_id == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    int result = add_shared_table(&ctx->shared_tables, (const unsigned char*)table, table_size, table_id);
+    if (result == -2) {
+        return HUFFMAN_ERROR_NO_MEMORY;
+    }
+    return result == 0 ? HUFFMAN_OK : HUFFMAN_ERROR_CORRUPT_INPUT;
+}
+
+HuffmanStatus huffman_add_static_table(HuffmanContext* ctx, const SharedTable* table) {
+    if (ctx == NULL || table == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    int result = add_static_shared_table(&ctx->shared_tables, table);
+    if (result == -2) {
+        return HUFFMAN_ERROR_NO_MEMORY;
+    }
+    return result == 0 ? HUFFMAN_OK : HUFFMAN_ERROR_CORRUPT_INPUT;
+}
+
+// A name of exactly 8 hex digits, taken as a table id
+static int parse_table_id(const char* name, uint32_t* id) {
+    if (strlen(name) != 8 || strspn(name, "0123456789abcdefABCDEF") != 8) {
+        return -1;
+    }
+    *id = (uint32_t)strtoul(name, NULL, 16);
+    return 0;
+}
+
+HuffmanStatus huffman_load_shared_table(HuffmanContext* ctx, const char* name, uint32_t* table_id) {
+    if (ctx == NULL || name == NULL || table_id == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    char path[4096];
+    uint32_t wanted;
+    int by_id = parse_table_id(name, &wanted) == 0;
+    if (by_id) {
+        if (find_shared_table(&ctx->shared_tables, wanted) != NULL) {
+            *table_id = wanted; // Loaded before: nothing to read
+            return HUFFMAN_OK;
+        }
+        const char* dir = getenv(HUFFMAN_TABLE_DIR_ENV);
+        int length = snprintf(path, sizeof(path), "%s/%08x%s", dir != NULL && dir[0] != '\0' ? dir : ".",
+                              (unsigned)wanted, HUFFMAN_TABLE_SUFFIX);
+        if (length < 0 || (size_t)length >= sizeof(path)) {
+            return HUFFMAN_ERROR_INVALID_ARGUMENT;
+        }
+        name = path;
+    }
+
+    FILE* file = fopen(name, "rb");
+    if (file == NULL) {
+        return by_id ? HUFFMAN_ERROR_UNKNOWN_TABLE : HUFFMAN_ERROR_IO;
+    }
+    unsigned char data[HUFFMAN_TABLE_MAX_SIZE + 1]; // One byte more shows a file that is too long
+    size_t size = fread(data, 1, sizeof(data), file);
+    int read_error = ferror(file);
+    fclose(file);
+    if (read_error) {
+        return HUFFMAN_ERROR_IO;
+    }
+    HuffmanStatus status = huffman_add_shared_table(ctx, data, size, table_id);
+    if (status == HUFFMAN_OK && by_id && *table_id != wanted) {
+        return HUFFMAN_ERROR_CORRUPT_INPUT; // The file isn't the table its name says
+    }
+    return status;
+}
+
+HuffmanStatus huffman_use_shared_table(HuffmanContext* ctx, uint32_t table_id) {
+    if (ctx == NULL || ctx->options.single_table || ctx->options.sample_size > 0
+        || ctx->options.max_code_length < 8) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    const SharedTable* table = find_shared_table(&ctx->shared_tables, table_id);
+    if (table == NULL) {
+        return HUFFMAN_ERROR_UNKNOWN_TABLE;
+    }
+    for (int i = 0; i < ctx->window; i++) {
+        ctx->jobs[i].shared_table = table;
+    }
+    return HUFFMAN_OK;
+}
+
+HuffmanStatus huffman_compress_message(HuffmanContext* ctx, const void* src, size_t src_size,
+                                       void* dst, size_t dst_capacity, size_t* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || (dst == NULL && dst_capacity > 0) || dst_size == NULL
+        || src_size > HUFFMAN_MAX_BLOCK_SIZE) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    // The same block compress_blocks would write for a one-block input, straight into dst,
+    // with nothing around it
+    HuffmanStats* stats = &ctx->stats;
+    memset(stats, 0, sizeof(*stats));
+    uint64_t start = instrument_now_ns();
+    init_bit_writer_fixed(ctx->writer, (unsigned char*)dst, dst_capacity);
+    BlockJob* job = &ctx->jobs[0];
+    job->data = (const unsigned char*)src;
+    job->size = src_size;
+    job->counted = 0;
+    job->direct_output = ctx->writer;
+    if (src_size == 0) {
+        write_raw_block(ctx->writer, job->data, 0); // No symbols to build codes from
+        job->status = 1;
+        job->histogram_ns = job->table_ns = job->coding_ns = 0;
+    } else {
+        compress_block(job);
+    }
+    *dst_size = 0;
+    if (job->status < 0) {
+        return job_failure(job);
+    }
+    long long written = finish_message(ctx->writer);
+    if (written < 0) {
+        return write_failure(ctx->writer);
+    }
+    stats->uncompressed_size = src_size;
+    stats->compressed_size = (unsigned long long)written;
+    stats->block_count = 1;
+    stats->raw_blocks = job->status > 0;
+    stats->timings.histogram_ns = job->histogram_ns;
+    stats->timings.table_ns = job->table_ns;
+    stats->timings.coding_ns = job->coding_ns;
+    stats->timings.total_ns = instrument_now_ns() - start;
+    *dst_size = (size_t)written;
+    return HUFFMAN_OK;
+}
+
+// --- Estimation ---
+
+HuffmanStatus huffman_estimate(const HuffmanContext* ctx, const void* src, size_t src_size,
+                               size_t sample_size, HuffmanEstimate* estimate) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || estimate == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    memset(estimate, 0, sizeof(*estimate));
+    estimate->input_size = src_size;
+    const unsigned char* data = (const unsigned char*)src;
+    size_t block_size = block_size_for(ctx, 0);
+    size_t sampled = sample_size == 0 || sample_size > src_size ? src_size : sample_size;
+
+    // The blocks of the sample, cut exactly where compress_blocks would cut them
+    uint64_t frequencies[HUFFMAN_ALPHABET_SIZE];
+    uint64_t segment_frequencies[HUFFMAN_STREAM_COUNT][HUFFMAN_ALPHABET_SIZE];
+    unsigned long long index_bytes = 0;
+    BlockSplitCarry split_carry;
+    split_carry.size = 0;
+    for (size_t offset = 0; offset < sampled;) {
+        size_t size = sampled - offset < block_size ? sampled - offset : block_size;
+        if (ctx->options.adaptive_blocks) {
+            size = next_block_size(data + offset, sampled - offset, block_size, frequencies, &split_carry);
+        }
+        int four_streams = count_block(data + offset, size, ctx->options.four_streams, frequencies, segment_frequencies);
+        unsigned long long written;
+        HuffmanStatus status = estimate_counts(frequencies, four_streams ? segment_frequencies : NULL,
+                                               ctx->options.max_code_length, estimate, &written, NULL);
+        if (status != HUFFMAN_OK) {
+            return status;
+        }
+        index_bytes += varint_size(size) + varint_size(written);
+        offset += size;
+    }
+
+    unsigned long long block_count = estimate->block_count;
+    unsigned long long block_bytes = estimate->block_bytes;
+    if (sampled < src_size) {
+        // The rest of the input is assumed to compress like the sample
+        double scale = (double)src_size / (double)sampled;
+        block_count = ctx->options.adaptive_blocks
+                      ? (unsigned long long)((double)block_count * scale + 0.5)
+                      : src_size / block_size + (src_size % block_size != 0);
+        block_bytes = (unsigned long long)((double)block_bytes * scale + 0.5);
+        index_bytes = (unsigned long long)((double)index_bytes * (double)block_count / (double)estimate->block_count + 0.5);
+    }
+    estimate->compressed_size = HUFFMAN_STREAM_HEADER_SIZE + block_bytes
+                                + 1 + varint_size(block_count) + index_bytes + HUFFMAN_FOOTER_SIZE;
+    return HUFFMAN_OK;
+}
+
+HuffmanStatus huffman_estimate_block(const uint64_t frequencies[256], int max_code_length, HuffmanEstimate* estimate) {
+    if (frequencies == NULL || estimate == NULL || max_code_length < 1 || max_code_length > MAX_CODE_LENGTH) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    memset(estimate, 0, sizeof(*estimate));
+    unsigned long long written;
+    HuffmanStatus status = estimate_counts(frequencies, NULL, max_code_length, estimate, &written, NULL);
+    estimate->input_size = estimate->sampled_size;
+    estimate->compressed_size = written;
+    return status;
+}
+
+// --- Decompression ---
+
+// Fills in ctx->decode_stats from the decoder's counters
+static void set_decode_stats(HuffmanContext* ctx, const DecodeStats* decoded, unsigned long long decompressed_size,
+                             uint64_t start) {
+    HuffmanDecodeStats* stats = &ctx->decode_stats;
+    stats->compressed_size = decoded->compressed_bytes;
+    stats->decompressed_size = decompressed_size;
+    stats->block_count = decoded->block_count;
+    stats->raw_blocks = decoded->raw_blocks;
+    memset(&stats->timings, 0, sizeof(stats->timings));
+    stats->timings.table_ns = decoded->table_ns;
+    stats->timings.coding_ns = decoded->decode_ns;
+    stats->timings.read_ns = decoded->read_ns;
+    stats->timings.write_ns = decoded->write_ns;
+    stats->timings.wait_ns = decoded->wait_ns;
+    stats->timings.total_ns = instrument_now_ns() - start;
+}
+
+// Status for a failed decode: -2 and -3 as from the decoder, anything else is bad input or,
+// if input or output (either may be NULL) has its error indicator set, a failed read or write
+static HuffmanStatus decode_failure(long long result, FILE* input, FILE* output) {
+    if (result == -2) {
+        return HUFFMAN_ERROR_UNKNOWN_TABLE;
+    }
+    if (result == -3) {
+        return HUFFMAN_ERROR_NO_MEMORY;
+    }
+    return (input != NULL && ferror(input)) || (output != NULL && ferror(output)) ? HUFFMAN_ERROR_IO : HUFFMAN_ERROR_CORRUPT_INPUT;
+}
+
+static void decode_block_job(void* arg) {
+    DecodeBlockJob* job = (DecodeBlockJob*)arg;
+    memset(&job->stats, 0, sizeof(job->stats));
+    job->result = decode_block_to_memory(job->block, job->block_size, job->out, job->out_size,
+                                         &job->ctx->shared_tables, &job->stats);
+
+    HuffmanContext* ctx = job->ctx;
+    pthread_mutex_lock(&ctx->job_lock);
+    if (--ctx->decode_remaining == 0) {
+        pthread_cond_signal(&ctx->job_finished);
+    }
+    pthread_mutex_unlock(&ctx->job_lock);
+}
+
+HuffmanStatus huffman_decompress_message(HuffmanContext* ctx, const void* src, size_t src_size,
+                                         void* dst, size_t dst_capacity, size_t* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || (dst == NULL && dst_capacity > 0) || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    uint64_t start = instrument_now_ns();
+    DecodeStats decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    memset(&ctx->decode_stats, 0, sizeof(ctx->decode_stats));
+    *dst_size = 0;
+    unsigned long long symbol_count;
+    if (read_block_symbol_count((const unsigned char*)src, src_size, &symbol_count) != 0) {
+        return HUFFMAN_ERROR_CORRUPT_INPUT;
+    }
+    if (symbol_count > dst_capacity) {
+        *dst_size = symbol_count > SIZE_MAX ? SIZE_MAX : (size_t)symbol_count;
+        return HUFFMAN_ERROR_DST_TOO_SMALL;
+    }
+    long long result = decode_block_to_memory((const unsigned char*)src, src_size, (unsigned char*)dst, (size_t)symbol_count,
+                                              &ctx->shared_tables, &decoded);
+    if (result < 0) {
+        return decode_failure(result, NULL, NULL);
+    }
+    set_decode_stats(ctx, &decoded, symbol_count, start);
+    *dst_size = (size_t)symbol_count;
+    return HUFFMAN_OK;
+}
+
+HuffmanStatus huffman_decompressed_size(const void* src, size_t src_size, unsigned long long* size) {
+    if ((src == NULL && src_size > 0) || size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    BlockIndex index;
+    init_block_index(&index);
+    HuffmanStatus status = HUFFMAN_ERROR_CORRUPT_INPUT;
+    if (check_stream_header((const unsigned char*)src, src_size) == 0) {
+        int index_status = read_block_index((const unsigned char*)src, src_size, &index);
+        if (index_status == 0) {
+            *size = block_index_uncompressed_size(&index);
+            status = HUFFMAN_OK;
+        } else if (index_status == -2) {
+            status = HUFFMAN_ERROR_NO_MEMORY;
+        }
+    }
+    free_block_index(&index);
+    return status;
+}
+
+HuffmanStatus huffman_decompress(HuffmanContext* ctx, const void* src, size_t src_size,
+                                 void* dst, size_t dst_capacity, size_t* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || (dst == NULL && dst_capacity > 0) || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    const unsigned char* data = (const unsigned char*)src;
+    unsigned char* out = (unsigned char*)dst;
+    uint64_t start = instrument_now_ns();
+    DecodeStats decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    memset(&ctx->decode_stats, 0, sizeof(ctx->decode_stats));
+    *dst_size = 0;
+    if (check_stream_header(data, src_size) != 0) {
+        return HUFFMAN_ERROR_CORRUPT_INPUT;
+    }
+    int index_status = read_block_index(data, src_size, &ctx->index);
+    if (index_status != 0) {
+        return index_status == -2 ? HUFFMAN_ERROR_NO_MEMORY : HUFFMAN_ERROR_CORRUPT_INPUT;
+    }
+    const BlockIndex* index = &ctx->index;
+    unsigned long long total = block_index_uncompressed_size(index);
+    if (total > dst_capacity) {
+        *dst_size = total > SIZE_MAX ? SIZE_MAX : (size_t)total;
+        return HUFFMAN_ERROR_DST_TOO_SMALL;
+    }
+
+    // The index gives every block its place in dst, so blocks need no ordering at all
+    if (ctx->pool == NULL) {
+        for (size_t i = 0; i < index->count; i++) {
+            const BlockIndexEntry* entry = &index->entries[i];
+            long long result = decode_block_to_memory(data + entry->compressed_offset, (size_t)entry->compressed_size,
+                                                      out + entry->uncompressed_offset, (size_t)entry->uncompressed_size,
+                                                      &ctx->shared_tables, &decoded);
+            if (result < 0) {
+                return decode_failure(result, NULL, NULL);
+            }
+        }
+    } else if (index->count > 0) {
+        if (index->count > ctx->decode_job_capacity) {
+            free(ctx->decode_jobs);
+            ctx->decode_jobs = (DecodeBlockJob*)malloc(sizeof(DecodeBlockJob) * index->count);
+            ctx->decode_job_capacity = ctx->decode_jobs != NULL ? index->count : 0;
+            if (ctx->decode_jobs == NULL) {
+                return HUFFMAN_ERROR_NO_MEMORY;
+            }
+        }
+        ctx->decode_remaining = index->count;
+        uint64_t wait_start = instrument_now_ns();
+        for (size_t i = 0; i < index->count; i++) {
+            const BlockIndexEntry* entry = &index->entries[i];
+            DecodeBlockJob* job = &ctx->decode_jobs[i];
+            job->block = data + entry->compressed_offset;
+            job->block_size = (size_t)entry->compressed_size;
+            job->out = out + entry->uncompressed_offset;
+            job->out_size = (size_t)entry->uncompressed_size;
+            job->ctx = ctx;
+            thread_pool_submit(ctx->pool, decode_block_job, job);
+        }
+        pthread_mutex_lock(&ctx->job_lock);
+        while (ctx->decode_remaining > 0) {
+            pthread_cond_wait(&ctx->job_finished, &ctx->job_lock);
+        }
+        pthread_mutex_unlock(&ctx->job_lock);
+        decoded.wait_ns = instrument_now_ns() - wait_start;
+        for (size_t i = 0; i < index->count; i++) {
+            const DecodeStats* block = &ctx->decode_jobs[i].stats;
+            decoded.block_count += block->block_count;
+            decoded.raw_blocks += block->raw_blocks;
+            decoded.compressed_bytes += block->compressed_bytes;
+            decoded.table_ns += block->table_ns;
+            decoded.decode_ns += block->decode_ns;
+        }
+        for (size_t i = 0; i < index->count; i++) {
+            if (ctx->decode_jobs[i].result < 0) {
+                return decode_failure(ctx->decode_jobs[i].result, NULL, NULL);
+            }
+        }
+    }
+    *dst_size = (size_t)total;
+    decoded.compressed_bytes = src_size; // The header and index too
+    set_decode_stats(ctx, &decoded, total, start);
+    return HUFFMAN_OK;
+}
+
+HuffmanStatus huffman_decompress_stream(HuffmanContext* ctx, FILE* input, FILE* output, unsigned long long* dst_size) {
+    if (ctx == NULL || input == NULL || output == NULL || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    // Every block carries its own code lengths (or names a shared table), so decoding is a single
+    // pass over the stream: read a block header, rebuild the canonical decode table and decode
+    // the block's bits.
+    uint64_t start = instrument_now_ns();
+    DecodeStats decoded;
+    long long decompressed_size = decode_and_write_file(input, output, &ctx->shared_tables,
+                                                        io_thread(ctx, &ctx->input_ahead),
+                                                        io_thread(ctx, &ctx->output_behind), &decoded);
+    set_decode_stats(ctx, &decoded, decompressed_size < 0 ? 0 : (unsigned long long)decompressed_size, start);
+    *dst_size = decompressed_size < 0 ? 0 : (unsigned long long)decompressed_size;
+    return decompressed_size < 0 ? decode_failure(decompressed_size, input, output) : HUFFMAN_OK;
+}
+
+HuffmanStatus huffman_decompress_range(HuffmanContext* ctx, const void* src, size_t src_size,
+                                       unsigned long long start, unsigned long long length,
+                                       FILE* output, unsigned long long* dst_size) {
+    if (ctx == NULL || (src == NULL && src_size > 0) || output == NULL || dst_size == NULL) {
+        return HUFFMAN_ERROR_INVALID_ARGUMENT;
+    }
+    uint64_t begin = instrument_now_ns();
+    DecodeStats decoded;
+    long long decompressed_size = decode_indexed_range((const unsigned char*)src, src_size, start, length,
+                                                       output, ctx->pool, ctx->options.thread_count,
+                                                       &ctx->shared_tables, io_thread(ctx, &ctx->output_behind),
+                                                       &decoded);
+    set_decode_stats(ctx, &decoded, decompressed_size < 0 ? 0 : (unsigned long long)decompressed_size, begin);
+    *dst_size = decompressed_size < 0 ? 0 : (unsigned long long)decompressed_size;
+    return decompressed_size < 0 ? decode_failure(decompressed_size, NULL, output) : HUFFMAN_OK;
+}
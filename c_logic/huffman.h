@@ -0,0 +1,236 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+// Huffman compression library: buffer-to-buffer compression and decompression of the block
+// stream described in huffman_format.h, plus the file and pipe variants the command-line
+// tools are built on.
+//
+// All state lives in a HuffmanContext. There are no globals, so any number of contexts can
+// be used at once on different threads; a single context must only be used by one thread at
+// a time. A context keeps its thread pool, block buffers and index between calls, so
+// compressing many small messages with one context doesn't allocate per message.
+//
+// Build as a static or shared library (see README.md) and include only this header.
+
+#include <stddef.h> // For size_t
+#include <stdint.h> // For uint64_t
+#include <stdio.h>  // For FILE
+
+typedef enum HuffmanStatus {
+    HUFFMAN_OK = 0,
+    HUFFMAN_ERROR_INVALID_ARGUMENT = -1,    // NULL pointer or out-of-range option
+    HUFFMAN_ERROR_DST_TOO_SMALL = -2,       // The output doesn't fit in dst_capacity bytes
+    HUFFMAN_ERROR_CORRUPT_INPUT = -3,       // Not a compressed stream, or a damaged one
+    HUFFMAN_ERROR_CODE_LENGTH = -4,         // max_code_length too small for a block's characters
+    HUFFMAN_ERROR_IO = -5,                  // Reading or writing a FILE failed
+    HUFFMAN_ERROR_UNKNOWN_TABLE = -6,       // A shared table id that was never added to the context
+    HUFFMAN_ERROR_NO_MEMORY = -7            // An allocation (or starting a thread) failed
+} HuffmanStatus;
+
+typedef struct HuffmanOptions {
+    int max_code_length;    // Longest allowed code in bits, 1-64 (default 11)
+    size_t block_size;      // Input bytes per block; 0 = default (1 MiB, or the whole buffer with single_table)
+    int thread_count;       // Threads per context, 1-1024 (default 1, 0 = one per CPU)
+    int single_table;       // 1 = one code table for a whole buffer, threads split the block
+    int four_streams;       // 1 = write blocks as 4 interleavable substreams (faster to decode)
+    size_t sample_size;     // 0 = code tables from each block's exact counts. Otherwise a block
+                            // larger than this is encoded in one pass with a table built from a
+                            // sample of about sample_size of its bytes, in which every byte value
+                            // gets a code. Needs max_code_length >= 8; not with single_table.
+    int adaptive_blocks;    // 1 = end a block where the byte statistics shift instead of every
+                            // block_size bytes, which becomes the largest block (default 4 MiB).
+                            // Not with single_table or sample_size.
+    int exact_sample_stats; // 1 = with sample_size, also count each sampled block exactly after
+                            // encoding it (on its worker) to fill in its byte counts, length limit
+                            // cost and exact_block_bytes in the statistics. Costs the counting
+                            // pass sampling saves and a second tree per block (default 0).
+    int async_io;           // 1 = FILE input is read ahead and FILE output written behind, each on
+                            // an I/O thread of the context, so disk and pipe waits overlap with
+                            // coding instead of adding to it (default 1; 0 = plain stdio calls)
+} HuffmanOptions;
+
+// Where the time of a call went, in nanoseconds. Worker stages are summed over all threads,
+// so with several threads they can add up to more than total_ns. All zero when the library
+// is built with -DHUFFMAN_NO_INSTRUMENTATION (the timers are compiled out).
+typedef struct HuffmanTimings {
+    unsigned long long total_ns;            // Wall time of the call
+    unsigned long long histogram_ns;        // Counting bytes (compression only)
+    unsigned long long table_ns;            // Building trees and codes, or reading block headers into decode tables
+    unsigned long long coding_ns;           // Encoding or decoding the bits (with single_table: the whole block)
+    unsigned long long read_ns;             // Waiting on the input FILE
+    unsigned long long write_ns;            // Waiting on the output FILE
+    unsigned long long wait_ns;             // Calling thread waiting for the workers' next block
+} HuffmanTimings;
+
+// What the last compression call of a context did
+typedef struct HuffmanStats {
+    unsigned long long uncompressed_size;   // Input bytes
+    unsigned long long compressed_size;     // Output bytes, stream header (or appended blocks) through footer
+    unsigned long long block_count;         // Blocks written
+    unsigned long long raw_blocks;          // Blocks stored as is because coding wouldn't shrink them
+    uint64_t frequencies[256];              // Byte counts over all blocks (sampled ones only with exact_sample_stats)
+    unsigned char first_block_code_lengths[256]; // Canonical code lengths of the first Huffman-coded block
+    int max_code_length;                    // Longest code assigned in any Huffman-coded block
+    // The length limit's cost, from each block's exact counts (sampled blocks only with exact_sample_stats)
+    int optimal_max_length;                 // Deepest unrestricted Huffman tree of those blocks
+    unsigned long long optimal_bits;        // Encoded bits with the unrestricted trees' lengths
+    unsigned long long encoded_bits;        // Encoded bits with the length-limited lengths
+    unsigned long long sampled_blocks;      // Blocks whose code table was built from a sample
+    unsigned long long sampled_block_bytes; // Compressed bytes of those blocks
+    unsigned long long exact_block_bytes;   // What they would take with tables from their exact counts (exact_sample_stats)
+    HuffmanTimings timings;
+} HuffmanStats;
+
+// What the last decompression call of a context did
+typedef struct HuffmanDecodeStats {
+    unsigned long long compressed_size;     // Input bytes read
+    unsigned long long decompressed_size;   // Output bytes
+    unsigned long long block_count;         // Blocks decoded
+    unsigned long long raw_blocks;          // Of those, blocks stored as is
+    HuffmanTimings timings;
+} HuffmanDecodeStats;
+
+// What compressing would produce, worked out from byte counts alone: the code lengths are
+// built and every block is sized both ways, but nothing is encoded
+typedef struct HuffmanEstimate {
+    unsigned long long input_size;          // Bytes the estimate is for
+    unsigned long long sampled_size;        // Bytes actually counted (a prefix of the input when sampling)
+    unsigned long long block_count;         // Blocks in the sampled bytes
+    unsigned long long raw_blocks;          // Of those, blocks that would be stored raw
+    unsigned long long coded_bits;          // Exact bitstream bits of the sampled blocks with their code lengths
+    double entropy_bits;                    // Shannon bound of the sampled blocks, each with its own counts
+    unsigned long long header_bytes;        // Block headers and code length tables of the Huffman-coded blocks
+    unsigned long long block_bytes;         // Sampled blocks as they would be written, Huffman or raw
+    unsigned long long compressed_size;     // Whole stream, header through footer: exact unless sampled
+} HuffmanEstimate;
+
+typedef struct HuffmanContext HuffmanContext;
+
+// Fills options with the defaults
+void huffman_default_options(HuffmanOptions* options);
+
+// HUFFMAN_OK if huffman_create_context accepts these options (NULL for the defaults),
+// HUFFMAN_ERROR_INVALID_ARGUMENT if one is out of range
+HuffmanStatus huffman_check_options(const HuffmanOptions* options);
+// options may be NULL for the defaults. Returns NULL if an option is out of range or the
+// context's memory or threads can't be had; huffman_check_options tells the two apart.
+HuffmanContext* huffman_create_context(const HuffmanOptions* options);
+void huffman_free_context(HuffmanContext* ctx);
+
+// Largest compressed size of src_size input bytes with this context's options
+size_t huffman_compress_bound(const HuffmanContext* ctx, size_t src_size);
+
+// Compresses src[0..src_size) into dst[0..dst_capacity) and sets *dst_size. A dst of
+// huffman_compress_bound() bytes is always big enough. The stream is written straight into
+// dst; no output buffer is allocated.
+HuffmanStatus huffman_compress(HuffmanContext* ctx, const void* src, size_t src_size,
+                               void* dst, size_t dst_capacity, size_t* dst_size);
+
+// Decompressed size of a whole compressed stream, read from its block index
+HuffmanStatus huffman_decompressed_size(const void* src, size_t src_size, unsigned long long* size);
+
+// Decompresses a whole stream src[0..src_size) into dst[0..dst_capacity) and sets *dst_size.
+// Every block is decoded straight to its place in dst (on the context's threads). If dst is
+// too small, returns HUFFMAN_ERROR_DST_TOO_SMALL with *dst_size set to the size needed.
+HuffmanStatus huffman_decompress(HuffmanContext* ctx, const void* src, size_t src_size,
+                                 void* dst, size_t dst_capacity, size_t* dst_size);
+
+// Streaming variants. Like every call, they report failures only through the status.
+// Compresses src[0..src_size) (e.g. a mapped file) to output
+HuffmanStatus huffman_compress_to_file(HuffmanContext* ctx, const void* src, size_t src_size,
+                                       FILE* output, unsigned long long* dst_size);
+// Compresses input (a file or pipe) to output, reading one block per thread at a time
+HuffmanStatus huffman_compress_stream(HuffmanContext* ctx, FILE* input, FILE* output, unsigned long long* dst_size);
+// Decompresses input (a file or pipe) to output block by block with constant memory
+HuffmanStatus huffman_decompress_stream(HuffmanContext* ctx, FILE* input, FILE* output, unsigned long long* dst_size);
+// Appending to an existing stream in a file opened for reading and writing ("r+b"), e.g. a
+// growing log: the new blocks take the place of its END byte, and the block index and footer
+// are written again after them, now listing the old blocks and the new ones. Of the old
+// stream only the header, footer and index are read, so the cost is that of compressing the
+// new data. An empty file gets a new stream. *dst_size is the stream's size afterwards, while
+// the statistics count what this call wrote. If the append fails, the old end of the stream is
+// written back and the file is as it was; if even that fails, the status is HUFFMAN_ERROR_IO.
+// Appending is not atomic: the new blocks overwrite the old index and footer in place, so a
+// crash or power loss during the call can leave a file that no longer decodes (its blocks are
+// intact, but the index is gone). Copy the file first where that can't be risked.
+HuffmanStatus huffman_append_to_file(HuffmanContext* ctx, const void* src, size_t src_size,
+                                     FILE* stream, unsigned long long* dst_size);
+HuffmanStatus huffman_append_stream(HuffmanContext* ctx, FILE* input, FILE* stream, unsigned long long* dst_size);
+// Writes decompressed bytes [start, start + length) of a whole stream in memory to output,
+// decoding only the blocks that hold them. length = ULLONG_MAX means up to the end.
+HuffmanStatus huffman_decompress_range(HuffmanContext* ctx, const void* src, size_t src_size,
+                                       unsigned long long start, unsigned long long length,
+                                       FILE* output, unsigned long long* dst_size);
+
+// Estimates compressing src[0..src_size) with ctx's options (block size or adaptive blocks,
+// code length limit, 4 streams; tables are always taken as built from exact counts) at the cost of counting the bytes. With sample_size = 0 every byte is counted
+// and compressed_size is exactly what huffman_compress would return; otherwise only the
+// first sample_size bytes are, and the rest of the input is assumed to compress like them.
+HuffmanStatus huffman_estimate(const HuffmanContext* ctx, const void* src, size_t src_size,
+                               size_t sample_size, HuffmanEstimate* estimate);
+// Estimates one single-stream block from byte counts the caller already has, with codes of
+// at most max_code_length bits. compressed_size is the block alone, without any stream
+// header, index or footer. Costs the tree and code construction the compressor does per
+// block (tens of microseconds), with no memory allocation.
+HuffmanStatus huffman_estimate_block(const uint64_t frequencies[256], int max_code_length, HuffmanEstimate* estimate);
+
+// Shared tables: a code table trained once on sample messages and given to both sides, so a
+// compressed message stores a 4-byte table id instead of its own code length table. Worth it
+// for messages of a few hundred bytes, where that table would cost more than the bits saved
+// by fitting the codes to the message. The stream header, index and footer stay, ~17 bytes.
+// A table file is at most HUFFMAN_TABLE_MAX_SIZE bytes; its id is a hash of its contents.
+#define HUFFMAN_TABLE_MAX_SIZE 512
+#define HUFFMAN_TABLE_DIR_ENV "HUFFMAN_TABLE_DIR"   // Where table ids are looked up (default ".")
+#define HUFFMAN_TABLE_SUFFIX ".huft"
+
+// Trains a table on the bytes of all samples together, with codes of at most max_code_length
+// bits (8-64, 0 = default). Every byte value gets a code, so any message can use the table.
+// Writes the table file to dst (HUFFMAN_TABLE_MAX_SIZE bytes is always enough).
+HuffmanStatus huffman_train_table(const void* const* samples, const size_t* sample_sizes, size_t sample_count,
+                                  int max_code_length, void* dst, size_t dst_capacity, size_t* dst_size,
+                                  uint32_t* table_id);
+// Adds a table file's contents to ctx and sets *table_id. Tables stay for the life of the
+// context (adding one again costs a lookup) and are what decompression looks ids up in.
+HuffmanStatus huffman_add_shared_table(HuffmanContext* ctx, const void* table, size_t table_size, uint32_t* table_id);
+// Reads and adds a table file. name is a path, or 8 hex digits: the id of a table already in
+// ctx, or else of the file <id>.huft in $HUFFMAN_TABLE_DIR.
+HuffmanStatus huffman_load_shared_table(HuffmanContext* ctx, const char* name, uint32_t* table_id);
+// Adds a table compiled into the program: the header huffman_static_table writes from a
+// code map defines one (NAME_table, with its id as NAME_TABLE_ID) as static const data, with
+// its codes and decode table already built, so nothing is kept from adding it but a pointer.
+// Adding it checks the id, codes and decode table against the table's code lengths (building
+// one decode table to compare and freeing it) and returns HUFFMAN_ERROR_CORRUPT_INPUT if they
+// don't match, e.g. for a header from another library version. A block with a byte the map
+// has no code for is stored raw. The header needs only huffman_tables.h, which defines
+// the table layout of this library version: regenerate the header after upgrading the library.
+struct SharedTable; // See huffman_tables.h
+HuffmanStatus huffman_add_static_table(HuffmanContext* ctx, const struct SharedTable* table);
+// Makes every later compression with ctx code its blocks with this added table (a block the
+// table doesn't shrink is still stored raw). Not with single_table, sample_size or a
+// max_code_length below 8.
+HuffmanStatus huffman_use_shared_table(HuffmanContext* ctx, uint32_t table_id);
+
+// Frameless messages: one message as a lone block, without the stream header, END byte, block
+// index and footer (20-22 bytes) a stream adds. With a shared table in use the block is its
+// type byte, its character and bit counts (varints), the 4-byte table id and the bits: 8 bytes
+// on top of the bits for messages under 128 bytes, 10 at most under 16 KB (plus the jump table
+// of four streams from 1 KB on). A message the table doesn't shrink is stored raw, 2-3 bytes on
+// top of the message under 16 KB. Without a shared table the block carries its own code length
+// table. The message (at most 1 GiB) is not split into blocks; a dst of huffman_compress_bound()
+// bytes is always big enough.
+HuffmanStatus huffman_compress_message(HuffmanContext* ctx, const void* src, size_t src_size,
+                                       void* dst, size_t dst_capacity, size_t* dst_size);
+// Decodes a message written by huffman_compress_message, looking its table id up in ctx. If
+// dst is too small, returns HUFFMAN_ERROR_DST_TOO_SMALL with *dst_size set to the size needed.
+HuffmanStatus huffman_decompress_message(HuffmanContext* ctx, const void* src, size_t src_size,
+                                         void* dst, size_t dst_capacity, size_t* dst_size);
+
+// Statistics of the last compression with ctx
+const HuffmanStats* huffman_last_stats(const HuffmanContext* ctx);
+// Statistics of the last decompression with ctx
+const HuffmanDecodeStats* huffman_last_decode_stats(const HuffmanContext* ctx);
+
+// Short description of a status for error messages
+const char* huffman_status_string(HuffmanStatus status);
+
+#endif // HUFFMAN_H
@@ -0,0 +1,78 @@
+#ifndef HUFFMAN_FORMAT_H
+#define HUFFMAN_FORMAT_H
+
+// Layout of a compressed stream:
+//   bytes 0-2  magic "HUF"
+//   byte  3    format version
+//   blocks, each:
+//     byte     block type (HUFFMAN_BLOCK_HUFFMAN, HUFFMAN_BLOCK_RAW, or HUFFMAN_BLOCK_END to
+//              end the stream) in the low 4 bits, flags in the high 4 bits
+//   a HUFFMAN_BLOCK_RAW block then holds:
+//     varint   number of bytes
+//     ...      the bytes, unchanged
+//   a HUFFMAN_BLOCK_HUFFMAN block holds:
+//     varint   number of characters in the block
+//     varint   exact number of bits in the block's bitstream
+//     ...      code length table (see canonical_codes.h), or with
+//              HUFFMAN_BLOCK_FLAG_SHARED_TABLE, 4 bytes: the little-endian id of a shared
+//              table the decoder was given beforehand (see shared_table.h)
+//     with HUFFMAN_BLOCK_FLAG_4_STREAMS, a jump table:
+//       3 varints  exact bit counts of substreams 0-2 (substream 3 has the rest of the bits)
+//     ...      bitstream, MSB first, padded with zero bits to a whole byte; with
+//              HUFFMAN_BLOCK_FLAG_4_STREAMS, the 4 substreams one after another, each padded
+//   block index, right after the END byte:
+//     varint   number of blocks
+//     per block: varint decoded size, varint compressed size (type byte through padding)
+//   footer:
+//     8 bytes  offset of the block index from the start of the stream, little-endian
+//     4 bytes  magic "HIDX"
+//
+// Every block carries its own code table, so the compressor only ever needs one block of
+// input in memory and the decompressor needs none; both can work on pipes. A streaming
+// decoder decodes up to the END byte and then only checks the index and footer against what
+// it decoded (block count, decoded and compressed totals, index offset). Readers of a whole
+// file start from the footer instead, and can decode any block (or many at once) without the
+// others. Appending to a stream writes the new blocks over its END byte and a new index and
+// footer after them, so blocks stay contiguous and the old ones are never rewritten. The
+// exact symbol and bit counts bound every bitstream, so padding bits are never decoded and the
+// decoder's inner loops only check for the end once per batch of symbols.
+// Varints are little-endian base 128: 7 bits per byte, high bit set on all but the last byte.
+// Characters are bytes (0-255). A block whose Huffman coding would not be smaller than its
+// input (already compressed or random data) is stored as a raw block instead, so the stream
+// never grows by more than a few bytes per block and such input decodes at copying speed.
+//
+// A 4-stream block splits its characters into 4 consecutive segments of
+// HUFFMAN_STREAM_SEGMENT(n) characters (the last segments get what is left, possibly nothing)
+// and codes each segment as its own substream with the block's one code table. The jump table
+// tells the decoder where every substream starts, so it can decode all four at once: four
+// independent chains of table lookups instead of one where each waits on the previous code.
+#define HUFFMAN_MAGIC "HUF"
+#define HUFFMAN_MAGIC_SIZE 3
+#define HUFFMAN_FORMAT_VERSION 4
+#define HUFFMAN_STREAM_HEADER_SIZE 4
+
+#define HUFFMAN_BLOCK_END 0
+#define HUFFMAN_BLOCK_HUFFMAN 1
+#define HUFFMAN_BLOCK_RAW 2
+#define HUFFMAN_BLOCK_TYPE_MASK 0x0F
+
+#define HUFFMAN_BLOCK_FLAG_4_STREAMS 0x10
+#define HUFFMAN_BLOCK_FLAG_SHARED_TABLE 0x20
+#define HUFFMAN_STREAM_COUNT 4
+#define HUFFMAN_STREAM_SEGMENT(symbol_count) (((symbol_count) + HUFFMAN_STREAM_COUNT - 1) / HUFFMAN_STREAM_COUNT)
+
+#define HUFFMAN_INDEX_MAGIC "HIDX"
+#define HUFFMAN_INDEX_MAGIC_SIZE 4
+#define HUFFMAN_FOOTER_SIZE 12
+
+// Varints are at most 10 bytes for 64-bit values
+#define HUFFMAN_MAX_VARINT_BYTES 10
+
+// Input bytes per block for -b. Counts are 64-bit, so this only bounds the memory a block
+// needs; the single-table mode (-S) makes a whole file of any size one block.
+#define HUFFMAN_DEFAULT_BLOCK_SIZE (1 << 20)
+#define HUFFMAN_MAX_BLOCK_SIZE (1 << 30)
+// Largest block of the adaptive mode when none is given: it only cuts earlier when the data changes
+#define HUFFMAN_DEFAULT_ADAPTIVE_BLOCK_SIZE (4 << 20)
+
+#endif // HUFFMAN_FORMAT_H
@@ -1,13 +1,52 @@
-#include <stdio.h>
-#include <stdlib.h> // For memory allocation, file handling, etc>
 #include "huffman_node.h" // Include your HuffmanNode definitions
 
-HuffmanNode* create_huffman_node(int ch, int freq, HuffmanNode* left, HuffmanNode* right) {
-    HuffmanNode* node = (HuffmanNode*)malloc(sizeof(HuffmanNode));
-    if (node == NULL) { perror("Failed to allocate HuffmanNode"); exit(EXIT_FAILURE); }
-    node->ch = ch;
-    node->frequency = freq; // Use 'frequency' instead of 'f' for consistency
-    node->left = left;
-    node->right = right;
-    return node;
-}
\ No newline at end of file
+int build_huffman_tree(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], HuffmanTree* tree) {
+    HuffmanNode* nodes = tree->nodes;
+    int leaf_count = 0;
+
+    // Leaves sorted by (frequency, character): insertion sort, at most 256 items
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (frequencies[i] == 0) continue;
+        int j = leaf_count++;
+        while (j > 0 && nodes[j - 1].frequency > frequencies[i]) {
+            nodes[j] = nodes[j - 1];
+            j--;
+        }
+        nodes[j].frequency = frequencies[i];
+        nodes[j].left = HUFFMAN_NO_CHILD;
+        nodes[j].right = HUFFMAN_NO_CHILD;
+        nodes[j].ch = (int16_t)i;
+    }
+    tree->node_count = leaf_count;
+    if (leaf_count == 0) {
+        tree->root = -1;
+        return -1;
+    }
+
+    // Two queues in one array: leaves are nodes[next_leaf .. leaf_count), internal nodes are
+    // nodes[next_internal .. node_count). Each new internal node is at least as frequent as
+    // the previous one, so both queues stay sorted and the minimum is always at a front.
+    // With a single character the loop never runs and that leaf is the root.
+    int next_leaf = 0;
+    int next_internal = leaf_count;
+    while (tree->node_count < 2 * leaf_count - 1) {
+        int children[2];
+        for (int k = 0; k < 2; k++) {
+            // On ties take the leaf: that keeps the tree as shallow as possible
+            if (next_leaf < leaf_count
+                && (next_internal == tree->node_count || nodes[next_leaf].frequency <= nodes[next_internal].frequency)) {
+                children[k] = next_leaf++;
+            } else {
+                children[k] = next_internal++;
+            }
+        }
+        HuffmanNode* parent = &nodes[tree->node_count++];
+        parent->frequency = nodes[children[0]].frequency + nodes[children[1]].frequency;
+        parent->left = (uint16_t)children[0];
+        parent->right = (uint16_t)children[1];
+        parent->ch = -1;
+    }
+
+    tree->root = tree->node_count - 1;
+    return 0;
+}
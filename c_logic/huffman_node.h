@@ -3,14 +3,39 @@
 
 #include <stdio.h>
 #include <stdlib.h> // For memory allocation, file handling, etc>
+#include <stdint.h> // For 64-bit frequencies and 16-bit node indices
+#include "huffman_tables.h" // HUFFMAN_ALPHABET_SIZE
 
+// A tree over at most 256 characters has at most 2 * 256 - 1 nodes
+#define HUFFMAN_MAX_NODES (2 * HUFFMAN_ALPHABET_SIZE - 1)
+#define HUFFMAN_NO_CHILD 0xFFFF
+
+// Nodes live in the HuffmanTree's arena and point to their children by index
 typedef struct HuffmanNode {
-    int ch;             // Character (or a special value like -1 for internal nodes)
-    int frequency;
-    struct HuffmanNode *left;
-    struct HuffmanNode *right;
+    uint64_t frequency; // 64-bit, so blocks larger than 2 GB can't overflow it
+    uint16_t left;      // Arena index of the left child, HUFFMAN_NO_CHILD for a leaf
+    uint16_t right;
+    int16_t ch;         // Character (or a special value like -1 for internal nodes)
 } HuffmanNode;
 
-HuffmanNode* create_huffman_node(int ch, int freq, HuffmanNode* left, HuffmanNode* right);
+// The whole tree in one contiguous block: no per-node allocation, nothing to free.
+// Leaves come first (in order of increasing frequency), then internal nodes in the
+// order they were created; the root is the last node.
+typedef struct HuffmanTree {
+    HuffmanNode nodes[HUFFMAN_MAX_NODES];
+    int node_count;
+    int root;           // Arena index of the root, or -1 for an empty tree
+} HuffmanTree;
+
+// Builds the Huffman tree for a frequency table into tree. Characters with frequency 0 are
+// left out. The leaves are sorted by frequency, then merged with the linear two-queue method:
+// internal nodes are created in order of increasing frequency, so the two least frequent
+// nodes are always at the front of the leaf queue or the internal node queue.
+// Returns 0, or -1 (with tree->root = -1) if no character has a non-zero frequency.
+int build_huffman_tree(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], HuffmanTree* tree);
+
+static inline int is_huffman_leaf(const HuffmanNode* node) {
+    return node->left == HUFFMAN_NO_CHILD;
+}
 
-#endif // HUFFMAN_NODE_H
\ No newline at end of file
+#endif // HUFFMAN_NODE_H
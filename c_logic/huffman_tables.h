@@ -0,0 +1,83 @@
+#ifndef HUFFMAN_TABLES_H
+#define HUFFMAN_TABLES_H
+
+// Layout of the code tables the encoder uses and the lookup tables the decoder uses, and of
+// the shared tables that hold both. This is the one header besides huffman.h a program needs
+// to compile in a static table: the header huffman_static_table writes defines a SharedTable
+// with these types as static const data, for huffman_add_static_table. The layout belongs to
+// the library version the header was generated with, so regenerate static tables after
+// upgrading the library; huffman_add_static_table rejects a table that doesn't match its code lengths.
+
+#include <stdint.h> // For uint32_t ids and uint64_t code words
+
+// Every byte value is a character of the alphabet
+#define HUFFMAN_ALPHABET_SIZE 256
+
+// Max possible code length. Codes are packed into 64-bit words. A tree built from 64-bit
+// frequencies can in theory get deeper (Fibonacci-sized counts), in which case the lengths
+// are recomputed with package-merge, so no code ever exceeds this.
+#define MAX_CODE_LENGTH 64
+
+// Default cap on code lengths. With codes of at most 11 bits the decoder resolves every
+// code with a single lookup in a 2^11-entry table (8 KB), which stays in L1.
+#define DEFAULT_MAX_CODE_LENGTH 11
+
+// A Huffman code packed as an integer: the first bit of the code is the most significant of 'length' bits
+typedef struct HuffmanCode {
+    uint64_t bits;
+    unsigned char length; // 0 means the character has no code
+} HuffmanCode;
+
+// Largest number of bits resolved by a single table lookup (2^11 entries * 4 bytes = 8 KB).
+// Codes up to this length are decoded with one lookup; longer codes (only possible when
+// compressing with a raised -L limit) fall back to a canonical per-length search.
+#define DECODE_TABLE_BITS DEFAULT_MAX_CODE_LENGTH
+
+// One entry of the decoding lookup table, indexed by the next table_bits bits of input
+typedef struct DecodeEntry {
+    short symbol;           // Decoded character, or -1 if the code continues past the table width
+    unsigned char length;   // Bits consumed by this entry (0 means no code starts with these bits)
+} DecodeEntry;
+
+// Most characters a single multi-symbol lookup can produce. The decoder always copies this
+// many bytes and then advances by the entry's count, so every lookup is one fixed-size store.
+#define DECODE_MULTI_MAX_SYMBOLS 4
+
+// One entry of the multi-symbol table: every whole code in the next table_bits bits, in order.
+// Text codes its common characters in 2-5 bits, so one lookup usually yields 2 or 3 of them.
+typedef struct MultiDecodeEntry {
+    unsigned char symbols[DECODE_MULTI_MAX_SYMBOLS];
+    unsigned char count;    // Characters decoded (0 means no code starts with these bits)
+    unsigned char length;   // Bits of all their codes together
+} MultiDecodeEntry;
+
+typedef struct DecodeTable {
+    int table_bits; // Longest code length, capped at DECODE_TABLE_BITS; only 2^table_bits entries are used
+    DecodeEntry entries[1 << DECODE_TABLE_BITS];
+
+    // Canonical decoding data, used for codes longer than table_bits
+    int max_length;
+    uint64_t first_code[MAX_CODE_LENGTH + 1];  // First code of each length
+    int first_index[MAX_CODE_LENGTH + 1];      // Position of that code's character in sorted_symbols
+    int length_count[MAX_CODE_LENGTH + 1];     // Number of codes of each length
+    unsigned char sorted_symbols[HUFFMAN_ALPHABET_SIZE];         // Characters ordered by (code length, character)
+
+    // Built when every code fits in table_bits (always with the default -L 11); the decoders
+    // use it wherever enough input and output are left for a whole batch of lookups. Clearing
+    // multi_symbol makes them fall back to one character per lookup.
+    int multi_symbol;
+    MultiDecodeEntry multi[1 << DECODE_TABLE_BITS];     // 2^11 entries * 6 bytes = 12 KB
+} DecodeTable;
+
+// A registered table (see shared_table.h): its codes for the encoder and its lookup table for
+// the decoder, both built once when the table is added, or at build time for a static table
+// (see static_table_main.c, which writes a header defining one as static const data)
+typedef struct SharedTable {
+    uint32_t id;
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]; // Byte values without a code make a block raw
+    const DecodeTable* decode_table;
+    int is_static;          // 1 = compiled in, never freed
+} SharedTable;
+
+#endif // HUFFMAN_TABLES_H
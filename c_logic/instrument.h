@@ -0,0 +1,25 @@
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#include <stdint.h>
+
+// Clock for the stage timers behind the statistics. The timers are read once per block and
+// stage (and once per 64 KB of file I/O), never per symbol, so they cost well under 0.1% of a
+// run. Building with -DHUFFMAN_NO_INSTRUMENTATION makes the clock a constant 0: every timer
+// then folds away at compile time and the reported times are zero, while the byte and block
+// counters still work.
+#ifndef HUFFMAN_NO_INSTRUMENTATION
+#include <time.h>
+
+static inline uint64_t instrument_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#else
+static inline uint64_t instrument_now_ns(void) {
+    return 0;
+}
+#endif
+
+#endif // INSTRUMENT_H
@@ -0,0 +1,96 @@
+#include "package_merge.h"
+#include "encoder.h" // For MAX_CODE_LENGTH
+#include <string.h>  // For memset
+
+// Package-merge in brief: picture every character as a coin of its frequency at each of the
+// max_length depths. Starting from the deepest level, adjacent items are paired ("packaged")
+// and the packages are merged with the original coins of the next level up. Taking the
+// 2n - 2 cheapest items of the top level, every coin that ends up selected (directly or
+// inside a selected package) adds one bit to its character's code length.
+//
+// Only the selection count per level is needed, not the package contents: selected packages
+// at one level are always the first packages formed, i.e. the first items of the level below,
+// and selected coins are always the cheapest characters.
+int package_merge_code_lengths(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], int max_length, unsigned char lengths[HUFFMAN_ALPHABET_SIZE]) {
+    int symbols[HUFFMAN_ALPHABET_SIZE];
+    int n = 0;
+
+    memset(lengths, 0, HUFFMAN_ALPHABET_SIZE);
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (frequencies[i] > 0) symbols[n++] = i;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (n == 1) {
+        lengths[symbols[0]] = 1;
+        return 0;
+    }
+    if (max_length < 1 || max_length > MAX_CODE_LENGTH || (max_length < 31 && (1 << max_length) < n)) {
+        return -1;
+    }
+
+    // Sort the characters by frequency (insertion sort, at most 256 items)
+    for (int i = 1; i < n; i++) {
+        int s = symbols[i];
+        int j = i - 1;
+        while (j >= 0 && frequencies[symbols[j]] > frequencies[s]) {
+            symbols[j + 1] = symbols[j];
+            j--;
+        }
+        symbols[j + 1] = s;
+    }
+
+    // is_package[level][k] tells whether item k of that level's merged list is a package.
+    // Level max_length - 1 is the deepest one and holds only coins.
+    unsigned char is_package[MAX_CODE_LENGTH][2 * HUFFMAN_ALPHABET_SIZE];
+    int item_count[MAX_CODE_LENGTH];
+    unsigned long long weights[2 * HUFFMAN_ALPHABET_SIZE];
+    unsigned long long merged[2 * HUFFMAN_ALPHABET_SIZE];
+
+    int count = n;
+    for (int k = 0; k < n; k++) {
+        weights[k] = (unsigned long long)frequencies[symbols[k]];
+        is_package[max_length - 1][k] = 0;
+    }
+    item_count[max_length - 1] = n;
+
+    for (int level = max_length - 2; level >= 0; level--) {
+        // Package adjacent pairs of the level below and merge them with the coins
+        int packages = count / 2;
+        int coin = 0, package = 0, out = 0;
+        while (coin < n || package < packages) {
+            unsigned long long package_weight = package < packages
+                ? weights[2 * package] + weights[2 * package + 1] : 0;
+            if (package >= packages || (coin < n && (unsigned long long)frequencies[symbols[coin]] <= package_weight)) {
+                merged[out] = (unsigned long long)frequencies[symbols[coin++]];
+                is_package[level][out++] = 0;
+            } else {
+                merged[out] = package_weight;
+                is_package[level][out++] = 1;
+                package++;
+            }
+        }
+        memcpy(weights, merged, sizeof(unsigned long long) * out);
+        count = out; // n coins + fewer than n packages, always below 2 * HUFFMAN_ALPHABET_SIZE
+        item_count[level] = count;
+    }
+
+    // Walk back down: the 2n - 2 cheapest items of the top level are selected
+    int take = 2 * n - 2;
+    for (int level = 0; level < max_length && take > 0; level++) {
+        if (take > item_count[level]) take = item_count[level];
+        int packages_taken = 0;
+        int coins_taken = 0;
+        for (int k = 0; k < take; k++) {
+            if (is_package[level][k]) packages_taken++;
+            else coins_taken++;
+        }
+        for (int k = 0; k < coins_taken; k++) {
+            lengths[symbols[k]]++;
+        }
+        take = 2 * packages_taken;
+    }
+
+    return 0;
+}
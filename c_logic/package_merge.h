@@ -0,0 +1,13 @@
+#ifndef PACKAGE_MERGE_H
+#define PACKAGE_MERGE_H
+
+#include <stdint.h> // For 64-bit frequencies
+#include "huffman_node.h" // For HUFFMAN_ALPHABET_SIZE
+
+// Computes optimal code lengths under a maximum length using the package-merge algorithm.
+// frequencies[i] == 0 means character i gets no code. On success lengths[] is filled and
+// 0 is returned; -1 is returned if max_length is too small for the number of characters
+// (2^max_length must be at least the number of characters with a non-zero frequency).
+int package_merge_code_lengths(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], int max_length, unsigned char lengths[HUFFMAN_ALPHABET_SIZE]);
+
+#endif // PACKAGE_MERGE_H
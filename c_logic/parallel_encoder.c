@@ -0,0 +1,170 @@
+#include "parallel_encoder.h"
+#include "huffman_node.h" // Tree built once from the merged counts
+#include "histogram.h"    // Frequency counting kernel
+#include "huffman_format.h" // Substream layout
+#include <stdlib.h> // For malloc, free
+#include <string.h> // For memset
+
+// Lets the calling thread wait until every slice of one pass is finished
+typedef struct SliceBatch {
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    int remaining;
+} SliceBatch;
+
+typedef struct SliceJob {
+    const unsigned char* data;
+    size_t size;
+    uint64_t frequencies[HUFFMAN_ALPHABET_SIZE];      // Counted in the first pass
+    const HuffmanCode* codes;       // Set for the second pass
+    unsigned char* out;             // Shared bitstream buffer of the whole block
+    EncodedSlice slice;
+    SliceBatch* batch;
+} SliceJob;
+
+static void finish_slice(SliceJob* job) {
+    pthread_mutex_lock(&job->batch->lock);
+    if (--job->batch->remaining == 0) {
+        pthread_cond_signal(&job->batch->finished);
+    }
+    pthread_mutex_unlock(&job->batch->lock);
+}
+
+static void count_slice(void* arg) {
+    SliceJob* job = (SliceJob*)arg;
+    memset(job->frequencies, 0, sizeof(job->frequencies));
+    count_bytes(job->data, job->size, job->frequencies);
+    finish_slice(job);
+}
+
+static void encode_slice_job(void* arg) {
+    SliceJob* job = (SliceJob*)arg;
+    encode_slice(job->data, job->size, job->codes, job->out, &job->slice);
+    finish_slice(job);
+}
+
+// Runs function on every slice and returns when all of them are done
+static void run_slices(ThreadPool* pool, SliceJob* jobs, int slice_count, ThreadPoolFunction function, SliceBatch* batch) {
+    batch->remaining = slice_count;
+    for (int i = 0; i < slice_count; i++) {
+        if (pool != NULL) {
+            thread_pool_submit(pool, function, &jobs[i]);
+        } else {
+            function(&jobs[i]);
+        }
+    }
+    pthread_mutex_lock(&batch->lock);
+    while (batch->remaining > 0) {
+        pthread_cond_wait(&batch->finished, &batch->lock);
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+int encode_block_parallel(BitWriter* writer, ThreadPool* pool, int thread_count,
+                          const unsigned char* data, size_t size, int max_code_length, int four_streams,
+                          uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], CodeBuildStats* stats) {
+    // A few slices per thread, so work stealing can even out slices that encode slower
+    size_t slice_count = thread_count > 1 ? (size_t)thread_count * 4 : 1;
+    size_t max_slices = (size + PARALLEL_MIN_SLICE_SIZE - 1) / PARALLEL_MIN_SLICE_SIZE;
+    if (slice_count > max_slices) slice_count = max_slices;
+    if (slice_count == 0) slice_count = 1;
+
+    // With 4 substreams every slice lies inside one segment, and each segment gets the same
+    // number of slices, so slice i belongs to substream i / slices_per_stream
+    int stream_count = four_streams && size >= FOUR_STREAMS_MIN_SYMBOLS ? HUFFMAN_STREAM_COUNT : 1;
+    size_t slices_per_stream = (slice_count + stream_count - 1) / stream_count;
+    slice_count = slices_per_stream * stream_count;
+    size_t segment = stream_count > 1 ? HUFFMAN_STREAM_SEGMENT(size) : size;
+
+    SliceJob* jobs = (SliceJob*)malloc(sizeof(SliceJob) * slice_count);
+    if (jobs == NULL) {
+        return -2;
+    }
+    SliceBatch batch;
+    pthread_mutex_init(&batch.lock, NULL);
+    pthread_cond_init(&batch.finished, NULL);
+
+    for (int stream = 0; stream < stream_count; stream++) {
+        size_t start = segment * stream < size ? segment * stream : size;
+        size_t length = size - start > segment ? segment : size - start;
+        size_t offset = 0;
+        for (size_t j = 0; j < slices_per_stream; j++) {
+            SliceJob* job = &jobs[stream * slices_per_stream + j];
+            size_t end = length / slices_per_stream * (j + 1) + (j + 1 == slices_per_stream ? length % slices_per_stream : 0);
+            job->data = data + start + offset;
+            job->size = end - offset;
+            job->codes = codes;
+            job->batch = &batch;
+            offset = end;
+        }
+    }
+
+    // --- Pass 1: histograms of all slices, merged into the block's counts ---
+    run_slices(pool, jobs, (int)slice_count, count_slice, &batch);
+    memset(frequencies, 0, sizeof(uint64_t) * HUFFMAN_ALPHABET_SIZE);
+    for (size_t i = 0; i < slice_count; i++) {
+        for (int c = 0; c < HUFFMAN_ALPHABET_SIZE; c++) {
+            frequencies[c] += jobs[i].frequencies[c];
+        }
+    }
+
+    // --- One tree and one code table for the whole block ---
+    int status = 0;
+    unsigned long long stream_bits[HUFFMAN_STREAM_COUNT] = {0};
+    unsigned long long total_bits = 0;
+    HuffmanTree huffman_tree;
+    if (build_huffman_tree(frequencies, &huffman_tree) != 0
+        || build_huffman_codes(&huffman_tree, max_code_length, codes, stats) != 0) {
+        status = -1;
+    }
+
+    if (status == 0) {
+        // --- Bit offset of every slice: prefix sum of the slices' exact bit counts ---
+        // Each substream starts on a fresh byte, so the sum is rounded up between substreams
+        for (size_t i = 0; i < slice_count; i++) {
+            if (stream_count > 1 && i % slices_per_stream == 0) {
+                total_bits = (total_bits + 7) / 8 * 8;
+            }
+            jobs[i].slice.bit_offset = total_bits;
+            jobs[i].slice.bit_count = encoded_bit_count(jobs[i].frequencies, codes);
+            total_bits += jobs[i].slice.bit_count;
+            stream_bits[stream_count > 1 ? i / slices_per_stream : 0] += jobs[i].slice.bit_count;
+        }
+    }
+
+    // The exact size is known before encoding, so incompressible input is only copied
+    if (status == 0 && huffman_block_size(frequencies, codes, stream_count > 1 ? stream_bits : NULL) >= raw_block_size(size)) {
+        write_raw_block(writer, data, size);
+        status = 1;
+    }
+
+    if (status == 0) {
+        size_t total_bytes = (size_t)((total_bits + 7) / 8);
+        unsigned char* out = (unsigned char*)malloc(total_bytes);
+        EncodedSlice* slices = (EncodedSlice*)malloc(sizeof(EncodedSlice) * slice_count);
+        if (out == NULL || slices == NULL) {
+            status = -2;
+        } else {
+            for (size_t i = 0; i < slice_count; i++) {
+                jobs[i].out = out;
+            }
+
+            // --- Pass 2: every slice encodes straight into its part of the shared buffer ---
+            run_slices(pool, jobs, (int)slice_count, encode_slice_job, &batch);
+            for (size_t i = 0; i < slice_count; i++) {
+                slices[i] = jobs[i].slice;
+            }
+            merge_slice_edges(out, slices, (int)slice_count);
+
+            write_block_header(writer, frequencies, codes, stream_count > 1 ? stream_bits : NULL);
+            write_bytes(writer, out, total_bytes);
+        }
+        free(slices);
+        free(out);
+    }
+
+    pthread_cond_destroy(&batch.finished);
+    pthread_mutex_destroy(&batch.lock);
+    free(jobs);
+    return status;
+}
@@ -0,0 +1,28 @@
+#ifndef PARALLEL_ENCODER_H
+#define PARALLEL_ENCODER_H
+
+#include "encoder.h"     // BitWriter, HuffmanCode, CodeBuildStats
+#include "thread_pool.h" // Threads the slices run on
+
+// Smallest slice worth its own thread; smaller blocks get fewer slices
+#define PARALLEL_MIN_SLICE_SIZE (256 * 1024)
+
+// Encodes data[0..size) as ONE block with ONE code table, using thread_count threads of pool
+// (pool may be NULL to do everything on the calling thread):
+//   1. the block is cut into slices whose histograms are counted in parallel and merged,
+//   2. the tree and canonical codes are built once from the merged counts,
+//   3. each slice's exact bit count follows from its own histogram, and a prefix sum of
+//      those gives every slice its bit offset in the block's bitstream,
+//   4. all slices are encoded in parallel straight into one shared output buffer,
+//      then the bytes shared at slice edges are OR-ed together.
+// With four_streams the slices are grouped by the block's 4 segments and the block is written
+// as 4 substreams (unless it is too small). A block that would not get smaller is stored raw.
+// The result is exactly what encode_and_write_block would write. frequencies, codes and stats
+// receive the block's counts, codes and length-limit statistics.
+// Returns 0 for a Huffman block, 1 for a raw block, -1 if the codes could not be built and
+// -2 if there was no memory for the slices (nothing written either way).
+int encode_block_parallel(BitWriter* writer, ThreadPool* pool, int thread_count,
+                          const unsigned char* data, size_t size, int max_code_length, int four_streams,
+                          uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], HuffmanCode codes[HUFFMAN_ALPHABET_SIZE], CodeBuildStats* stats);
+
+#endif // PARALLEL_ENCODER_H
@@ -0,0 +1,212 @@
+#include "shared_table.h"
+#include "canonical_codes.h" // Serialized code lengths
+#include "huffman_node.h"    // Tree construction for training
+#include <stdlib.h>
+#include <string.h>
+
+void init_shared_tables(SharedTables* set) {
+    set->tables = NULL;
+    set->count = 0;
+    set->capacity = 0;
+}
+
+void free_shared_tables(SharedTables* set) {
+    for (size_t i = 0; i < set->count; i++) {
+        if (!set->tables[i]->is_static) {
+            free_decode_table((DecodeTable*)set->tables[i]->decode_table);
+            free((SharedTable*)set->tables[i]);
+        }
+    }
+    free((void*)set->tables);
+    init_shared_tables(set);
+}
+
+// 32-bit FNV-1a: ids only have to tell the few tables of one deployment apart
+static uint32_t table_hash(const unsigned char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+uint32_t shared_table_id(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]) {
+    unsigned char table[CODE_LENGTHS_MAX_BYTES];
+    return table_hash(table, write_code_lengths(lengths, table));
+}
+
+size_t train_shared_table(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], int max_code_length,
+                          unsigned char* out, uint32_t* id) {
+    if (max_code_length < 8 || max_code_length > MAX_CODE_LENGTH) {
+        return 0;
+    }
+    uint64_t counts[HUFFMAN_ALPHABET_SIZE];
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        counts[i] = frequencies[i] + 1;
+    }
+    HuffmanTree tree;
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    if (build_huffman_tree(counts, &tree) != 0 || build_huffman_codes(&tree, max_code_length, codes, NULL) != 0) {
+        return 0;
+    }
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        lengths[i] = codes[i].length;
+    }
+
+    size_t table_size = write_code_lengths(lengths, out + SHARED_TABLE_HEADER_SIZE);
+    *id = shared_table_id(lengths);
+    memcpy(out, SHARED_TABLE_MAGIC, SHARED_TABLE_MAGIC_SIZE);
+    out[4] = SHARED_TABLE_VERSION;
+    for (int i = 0; i < 4; i++) {
+        out[5 + i] = (unsigned char)(*id >> (8 * i));
+    }
+    return SHARED_TABLE_HEADER_SIZE + table_size;
+}
+
+// Makes room for one more table in set. Returns 0, or -1 if the list can't grow.
+static int reserve_table(SharedTables* set) {
+    if (set->count == set->capacity) {
+        size_t capacity = set->capacity > 0 ? set->capacity * 2 : 8;
+        const SharedTable** tables = (const SharedTable**)realloc((void*)set->tables, sizeof(SharedTable*) * capacity);
+        if (tables == NULL) {
+            return -1;
+        }
+        set->tables = tables;
+        set->capacity = capacity;
+    }
+    return 0;
+}
+
+int add_shared_table(SharedTables* set, const unsigned char* data, size_t size, uint32_t* id) {
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    if (size < SHARED_TABLE_HEADER_SIZE || memcmp(data, SHARED_TABLE_MAGIC, SHARED_TABLE_MAGIC_SIZE) != 0
+        || data[4] != SHARED_TABLE_VERSION) {
+        return -1;
+    }
+    long table_size = read_code_lengths(data + SHARED_TABLE_HEADER_SIZE, size - SHARED_TABLE_HEADER_SIZE, lengths);
+    if (table_size < 0 || (size_t)table_size != size - SHARED_TABLE_HEADER_SIZE) {
+        return -1;
+    }
+    uint32_t stored_id = 0;
+    for (int i = 0; i < 4; i++) {
+        stored_id |= (uint32_t)data[5 + i] << (8 * i);
+    }
+    // The id must be the hash, and every byte value must have a code for the encoder
+    if (stored_id != table_hash(data + SHARED_TABLE_HEADER_SIZE, (size_t)table_size)) {
+        return -1;
+    }
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] == 0) return -1;
+    }
+    *id = stored_id;
+
+    const SharedTable* existing = find_shared_table(set, stored_id);
+    if (existing != NULL) {
+        return memcmp(existing->lengths, lengths, sizeof(lengths)) == 0 ? 0 : -1;
+    }
+
+    if (reserve_table(set) != 0) {
+        return -2;
+    }
+    SharedTable* table = (SharedTable*)malloc(sizeof(SharedTable));
+    if (table == NULL) {
+        return -2;
+    }
+    table->id = stored_id;
+    memcpy(table->lengths, lengths, sizeof(lengths));
+    assign_canonical_codes(lengths, table->codes);
+    table->decode_table = build_decode_table(lengths);
+    table->is_static = 0;
+    if (table->decode_table == NULL) {
+        free(table);
+        return -2;
+    }
+    set->tables[set->count++] = table;
+    return 0;
+}
+
+// Returns 1 if a (from a static table) holds what b (just built) does, over the entries the
+// decoder reads: 2^table_bits lookups, the canonical data up to max_length, and the
+// multi-symbol table if it is used. The rest is never read, so its contents don't matter.
+static int same_decode_table(const DecodeTable* a, const DecodeTable* b) {
+    if (a->table_bits != b->table_bits || a->max_length != b->max_length || a->multi_symbol != b->multi_symbol
+        || a->max_length < 0 || a->max_length > MAX_CODE_LENGTH
+        || memcmp(a->sorted_symbols, b->sorted_symbols, sizeof(a->sorted_symbols)) != 0) {
+        return 0;
+    }
+    int entries = 1 << b->table_bits;
+    for (int i = 0; i < entries; i++) {
+        if (a->entries[i].symbol != b->entries[i].symbol || a->entries[i].length != b->entries[i].length) {
+            return 0;
+        }
+    }
+    for (int len = 0; len <= b->max_length; len++) {
+        if (a->first_code[len] != b->first_code[len] || a->first_index[len] != b->first_index[len]
+            || a->length_count[len] != b->length_count[len]) {
+            return 0;
+        }
+    }
+    if (b->multi_symbol) {
+        for (int i = 0; i < entries; i++) {
+            const MultiDecodeEntry* x = &a->multi[i];
+            const MultiDecodeEntry* y = &b->multi[i];
+            if (x->count != y->count || x->length != y->length
+                || memcmp(x->symbols, y->symbols, DECODE_MULTI_MAX_SYMBOLS) != 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Checks a compiled-in table against its own code lengths: its id, its codes and its decode
+// table must be what a table file with these lengths would get. A header generated for another
+// library version or edited by hand fails here instead of miscoding blocks. Returns 0, -1 on a
+// mismatch, or -2 if there is no memory for the decode table to compare with.
+static int check_static_table(const SharedTable* table) {
+    if (validate_code_lengths(table->lengths) != 0 || table->id != shared_table_id(table->lengths)
+        || table->decode_table == NULL) {
+        return -1;
+    }
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    assign_canonical_codes(table->lengths, codes);
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (table->codes[i].length != codes[i].length || table->codes[i].bits != codes[i].bits) {
+            return -1;
+        }
+    }
+    DecodeTable* decode_table = build_decode_table(table->lengths);
+    if (decode_table == NULL) {
+        return -2;
+    }
+    int same = same_decode_table(table->decode_table, decode_table);
+    free(decode_table);
+    return same ? 0 : -1;
+}
+
+int add_static_shared_table(SharedTables* set, const SharedTable* table) {
+    int check = check_static_table(table);
+    if (check != 0) {
+        return check;
+    }
+    const SharedTable* existing = find_shared_table(set, table->id);
+    if (existing != NULL) {
+        return memcmp(existing->lengths, table->lengths, sizeof(table->lengths)) == 0 ? 0 : -1;
+    }
+    if (reserve_table(set) != 0) {
+        return -2;
+    }
+    set->tables[set->count++] = table;
+    return 0;
+}
+
+const SharedTable* find_shared_table(const SharedTables* set, uint32_t id) {
+    // A context holds a handful of tables, so a linear scan beats anything fancier
+    for (size_t i = 0; i < set->count; i++) {
+        if (set->tables[i]->id == id) {
+            return set->tables[i];
+        }
+    }
+    return NULL;
+}
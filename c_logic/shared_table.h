@@ -0,0 +1,59 @@
+#ifndef SHARED_TABLE_H
+#define SHARED_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "huffman_tables.h" // SharedTable
+#include "encoder.h" // For HuffmanCode
+#include "decoder.h" // For DecodeTable
+
+// Shared tables are code tables trained once on sample data and kept outside the compressed
+// stream. A block coded with one stores the table's id instead of its code length table (see
+// huffman_format.h), so a message of a few hundred bytes costs its bits and a few bytes of
+// header rather than a table and a tree.
+//
+// Table file:
+//   4 bytes  magic "HUFT"
+//   1 byte   table format version (SHARED_TABLE_VERSION)
+//   4 bytes  table id, little-endian: the FNV-1a hash of the code length table that follows
+//            (so a table has the same id whether it was loaded from a file or compiled in)
+//   ...      code length table (see canonical_codes.h); every byte value has a code
+#define SHARED_TABLE_MAGIC "HUFT"
+#define SHARED_TABLE_MAGIC_SIZE 4
+#define SHARED_TABLE_VERSION 1
+#define SHARED_TABLE_HEADER_SIZE 9
+
+// The tables a context knows, by id
+typedef struct SharedTables {
+    const SharedTable** tables; // Entries never move, so pointers to them stay valid
+    size_t count;
+    size_t capacity;
+} SharedTables;
+
+void init_shared_tables(SharedTables* set);
+void free_shared_tables(SharedTables* set);
+
+// Writes the table file for codes trained on these byte counts into out (at least
+// SHARED_TABLE_HEADER_SIZE + CODE_LENGTHS_MAX_BYTES bytes). Every byte value gets one extra
+// count, so messages with bytes the samples never had still encode. Returns the table's
+// size, or 0 if max_code_length is below 8 (too short for 256 codes).
+size_t train_shared_table(const uint64_t frequencies[HUFFMAN_ALPHABET_SIZE], int max_code_length,
+                          unsigned char* out, uint32_t* id);
+
+// Parses a table file and adds it to set unless a table with its id is there already.
+// Returns 0 and sets *id, -1 if the data is not a valid table (or collides with a
+// different table of the same id), or -2 if there is no memory for it.
+int add_shared_table(SharedTables* set, const unsigned char* data, size_t size, uint32_t* id);
+
+// Adds a compiled-in table, after checking that its id, codes and decode table match its code
+// lengths (the decode table is built once to compare, then freed). Returns -1 if they don't or
+// a different table with the same id is there already, or -2 if there is no memory for it.
+int add_static_shared_table(SharedTables* set, const SharedTable* table);
+
+// The id of a table with these code lengths: the FNV-1a hash of its code length table
+uint32_t shared_table_id(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE]);
+
+// The table with this id, or NULL
+const SharedTable* find_shared_table(const SharedTables* set, uint32_t id);
+
+#endif // SHARED_TABLE_H
@@ -0,0 +1,218 @@
+// static_table_main.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h> // For the table name check
+
+#include "shared_table.h"    // SharedTable and table ids
+#include "canonical_codes.h" // Checking the map's codes are canonical
+#include "decoder.h"         // The decode table written into the header
+
+// Turns a code map (the "<byte> <code bits>" lines write_huffman_map_to_file writes) into a
+// header that defines the table as static const data: the encoder's codes and the decoder's
+// whole lookup table, built here once instead of in every process that uses the table.
+
+static void print_usage(const char *program) {
+    fprintf(stderr, "Usage: %s <map_file> <table_name> <output_header|->\n", program);
+    fprintf(stderr, "  Writes a C header defining <table_name>_table, a shared table with the map's codes\n");
+    fprintf(stderr, "  and its decode table prebuilt, for huffman_add_static_table. Blocks compressed\n");
+    fprintf(stderr, "  with it decompress with the same table from a file (-t) and vice versa.\n");
+}
+
+// Reads the map into lengths[] and codes[]. Returns 0, or -1 after printing the problem.
+static int read_map(const char *filename, unsigned char lengths[HUFFMAN_ALPHABET_SIZE],
+                    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]) {
+    FILE *map = fopen(filename, "r");
+    if (map == NULL) {
+        perror("Error opening map file");
+        return -1;
+    }
+    memset(lengths, 0, HUFFMAN_ALPHABET_SIZE);
+    init_huffman_codes_array(codes);
+    char line[256];
+    int line_number = 0;
+    int status = 0;
+    while (status == 0 && fgets(line, sizeof(line), map) != NULL) {
+        line_number++;
+        int symbol;
+        char bits[MAX_CODE_LENGTH + 2];
+        if (line[0] == '\n') continue;
+        if (sscanf(line, "%d %65s", &symbol, bits) != 2 || symbol < 0 || symbol >= HUFFMAN_ALPHABET_SIZE
+            || strlen(bits) > MAX_CODE_LENGTH || strspn(bits, "01") != strlen(bits) || lengths[symbol] != 0) {
+            fprintf(stderr, "Error: %s:%d is not a \"<byte> <code bits>\" line for a new byte value.\n", filename, line_number);
+            status = -1;
+            break;
+        }
+        lengths[symbol] = (unsigned char)strlen(bits);
+        for (const char *bit = bits; *bit != '\0'; bit++) {
+            codes[symbol].bits = codes[symbol].bits << 1 | (uint64_t)(*bit - '0');
+        }
+        codes[symbol].length = lengths[symbol];
+    }
+    fclose(map);
+    return status;
+}
+
+// Returns 0 if the codes are the canonical codes of their lengths, which is what the stream
+// format and the decoder rely on, and fit in one code tree
+static int check_canonical(const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE]) {
+    // Kraft sum in units of 2^-MAX_CODE_LENGTH, checked length by length so it can't overflow
+    unsigned long long room = 1;
+    int count[MAX_CODE_LENGTH + 1] = {0};
+    int symbols = 0;
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] > 0) {
+            count[lengths[i]]++;
+            symbols++;
+        }
+    }
+    for (int len = 1; len <= MAX_CODE_LENGTH; len++) {
+        room = 2 * room;
+        if ((unsigned long long)count[len] > room) {
+            return -1;
+        }
+        room -= (unsigned long long)count[len];
+        if (room > HUFFMAN_ALPHABET_SIZE) room = HUFFMAN_ALPHABET_SIZE; // Enough for any remaining lengths
+    }
+    if (symbols == 0) {
+        return -1;
+    }
+    HuffmanCode canonical[HUFFMAN_ALPHABET_SIZE];
+    assign_canonical_codes(lengths, canonical);
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        if (lengths[i] > 0 && canonical[i].bits != codes[i].bits) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Writes count numbers, 16 to a line
+static void write_numbers(FILE *out, const char *format, const unsigned long long *values, int count) {
+    for (int i = 0; i < count; i++) {
+        fprintf(out, i % 16 == 0 ? "\n        " : " ");
+        fprintf(out, format, values[i]);
+        fputc(',', out);
+    }
+    fprintf(out, "\n    },\n");
+}
+
+static void write_header(FILE *out, const char *map_filename, const char *name, uint32_t id,
+                         const unsigned char lengths[HUFFMAN_ALPHABET_SIZE], const HuffmanCode codes[HUFFMAN_ALPHABET_SIZE],
+                         const DecodeTable *table) {
+    unsigned long long values[1 << DECODE_TABLE_BITS];
+    char guard[128];
+    size_t n;
+    for (n = 0; name[n] != '\0' && n < sizeof(guard) - 1; n++) {
+        guard[n] = (char)toupper((unsigned char)name[n]);
+    }
+    guard[n] = '\0';
+    int entries = 1 << table->table_bits;
+
+    fprintf(out, "// Generated by huffman_static_table from %s. Do not edit.\n", map_filename);
+    fprintf(out, "// Include in one source file and add with huffman_add_static_table(ctx, &%s_table).\n", name);
+    fprintf(out, "// The table layout is this library version's: regenerate it after upgrading the library.\n");
+    fprintf(out, "#ifndef %s_TABLE_H\n#define %s_TABLE_H\n\n", guard, guard);
+    fprintf(out, "#include \"huffman_tables.h\"\n\n");
+    fprintf(out, "#define %s_TABLE_ID 0x%08xu\n\n", guard, (unsigned)id);
+
+    fprintf(out, "static const DecodeTable %s_decode_table = {\n", name);
+    fprintf(out, "    .table_bits = %d,\n", table->table_bits);
+    fprintf(out, "    .entries = {");
+    for (int i = 0; i < entries; i++) {
+        fprintf(out, i % 8 == 0 ? "\n        " : " ");
+        fprintf(out, "{%d, %d},", table->entries[i].symbol, table->entries[i].length);
+    }
+    fprintf(out, "\n    },\n");
+    fprintf(out, "    .max_length = %d,\n", table->max_length);
+    fprintf(out, "    .first_code = {");
+    for (int i = 0; i <= MAX_CODE_LENGTH; i++) values[i] = table->first_code[i];
+    write_numbers(out, "0x%llxu", values, table->max_length + 1);
+    fprintf(out, "    .first_index = {");
+    for (int i = 0; i <= MAX_CODE_LENGTH; i++) values[i] = (unsigned long long)table->first_index[i];
+    write_numbers(out, "%llu", values, table->max_length + 1);
+    fprintf(out, "    .length_count = {");
+    for (int i = 0; i <= MAX_CODE_LENGTH; i++) values[i] = (unsigned long long)table->length_count[i];
+    write_numbers(out, "%llu", values, table->max_length + 1);
+    fprintf(out, "    .sorted_symbols = {");
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) values[i] = table->sorted_symbols[i];
+    write_numbers(out, "%llu", values, HUFFMAN_ALPHABET_SIZE);
+    fprintf(out, "    .multi_symbol = %d,\n", table->multi_symbol);
+    if (table->multi_symbol) {
+        fprintf(out, "    .multi = {");
+        for (int i = 0; i < entries; i++) {
+            const MultiDecodeEntry *multi = &table->multi[i];
+            fprintf(out, i % 4 == 0 ? "\n        " : " ");
+            fprintf(out, "{{%d, %d, %d, %d}, %d, %d},", multi->symbols[0], multi->symbols[1], multi->symbols[2],
+                    multi->symbols[3], multi->count, multi->length);
+        }
+        fprintf(out, "\n    },\n");
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static const SharedTable %s_table = {\n", name);
+    fprintf(out, "    .id = %s_TABLE_ID,\n", guard);
+    fprintf(out, "    .lengths = {");
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) values[i] = lengths[i];
+    write_numbers(out, "%llu", values, HUFFMAN_ALPHABET_SIZE);
+    fprintf(out, "    .codes = {");
+    for (int i = 0; i < HUFFMAN_ALPHABET_SIZE; i++) {
+        fprintf(out, i % 8 == 0 ? "\n        " : " ");
+        fprintf(out, "{0x%llxu, %d},", (unsigned long long)codes[i].bits, codes[i].length);
+    }
+    fprintf(out, "\n    },\n");
+    fprintf(out, "    .decode_table = &%s_decode_table,\n", name);
+    fprintf(out, "    .is_static = 1,\n");
+    fprintf(out, "};\n\n#endif // %s_TABLE_H\n", guard);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const char *map_filename = argv[1];
+    const char *name = argv[2];
+    const char *output_filename = argv[3];
+    int valid_name = (isalpha((unsigned char)name[0]) || name[0] == '_') && strlen(name) < 100;
+    for (const char *c = name; *c != '\0'; c++) {
+        if (!isalnum((unsigned char)*c) && *c != '_') valid_name = 0;
+    }
+    if (!valid_name) {
+        fprintf(stderr, "Error: The table name must be a C identifier.\n");
+        return 1;
+    }
+
+    unsigned char lengths[HUFFMAN_ALPHABET_SIZE];
+    HuffmanCode codes[HUFFMAN_ALPHABET_SIZE];
+    if (read_map(map_filename, lengths, codes) != 0) {
+        return 1;
+    }
+    if (check_canonical(lengths, codes) != 0) {
+        fprintf(stderr, "Error: The codes in %s are not canonical Huffman codes (write the map with huffman_compressor).\n", map_filename);
+        return 1;
+    }
+
+    DecodeTable *table = build_decode_table(lengths);
+    if (table == NULL) {
+        perror("Failed to allocate decode table");
+        return 1;
+    }
+    uint32_t id = shared_table_id(lengths);
+    FILE *out = strcmp(output_filename, "-") == 0 ? stdout : fopen(output_filename, "w");
+    if (out == NULL) {
+        perror("Error opening output header");
+        free_decode_table(table);
+        return 1;
+    }
+    write_header(out, map_filename, name, id, lengths, codes, table);
+    free_decode_table(table);
+    if (out != stdout ? fclose(out) != 0 : fflush(out) != 0) {
+        perror("Error writing output header");
+        return 1;
+    }
+    if (out != stdout) {
+        printf("Static table %s (id %08x) written to %s\n", name, (unsigned)id, output_filename);
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+// roundtrip_test.c
+// Compresses inputs of every size from 0 to a few hundred bytes, plus larger ones around the
+// 4-stream threshold and across several blocks, and decodes each stream three ways: with
+// huffman_decompress, with huffman_decompress_stream (which checks the block index and footer
+// after the END byte) and with huffman_decompress_range (which decodes through the index), for
+// the whole stream and for a range in its middle. It runs with -L 11, -L 16, four streams (-I)
+// and a single table (-S), and checks that the last byte of a block's bitstream was padded with
+// every count from 0 to 7 bits. Then it truncates and corrupts the trailer (END byte, index and
+// footer) of a multi-block stream byte by byte, and both decoders that read it must reject it.
+//
+// Build from the c_logic directory, after building libhuffman.a:
+//   gcc -O2 tests/roundtrip_test.c libhuffman.a -pthread -lm -o roundtrip_test
+// Usage: roundtrip_test [max_size]
+// Prints one line per configuration and exits with status 1 if anything failed.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h> // For ULLONG_MAX
+
+#include "../huffman.h"
+#include "../huffman_format.h"
+
+typedef struct TestConfig {
+    const char* name;
+    int max_code_length;
+    int four_streams;
+    int single_table;
+} TestConfig;
+
+static const TestConfig configs[] = {
+    {"-L 11", 11, 0, 0},
+    {"-L 16", 16, 0, 0},
+    {"-I", 11, 1, 0},
+    {"-S", 11, 0, 1},
+};
+
+// Sizes past the generated 0..max_size run: around the 4-stream threshold, and over several blocks
+static const size_t large_sizes[] = {1023, 1024, 1025, 1029, 4095, 4097, 9000, 70001};
+#define TEST_BLOCK_SIZE 4096 // Small blocks, so the larger inputs have several (except with -S)
+
+static int failures = 0;
+
+static uint64_t next_random(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Skewed bytes: each symbol about half as likely as the one before, over 40 symbols, so the
+// trees are deep (long codes with -L 16, a cut-off tail with -L 11) and most inputs compress
+static void fill_skewed(unsigned char* data, size_t size, uint64_t seed) {
+    uint64_t state = seed | 1;
+    for (size_t i = 0; i < size; i++) {
+        uint64_t r = next_random(&state);
+        int symbol = 0;
+        while (symbol < 39 && (r & 1)) {
+            symbol++;
+            r >>= 1;
+        }
+        data[i] = (unsigned char)('A' + symbol);
+    }
+}
+
+static void fail(const TestConfig* config, size_t size, const char* what) {
+    if (failures < 20) {
+        printf("FAIL [%s] size %zu: %s\n", config->name, size, what);
+    }
+    failures++;
+}
+
+static unsigned long long read_varint(const unsigned char** p, const unsigned char* end) {
+    unsigned long long value = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        unsigned char byte = *(*p)++;
+        value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    return value;
+}
+
+// Padding bits in the last byte of the first block's bitstream, or -1 if that block is stored
+// raw or split into 4 substreams
+static int first_block_padding(const unsigned char* stream, size_t size) {
+    const unsigned char* p = stream + HUFFMAN_STREAM_HEADER_SIZE;
+    const unsigned char* end = stream + size;
+    if (p >= end || (*p & HUFFMAN_BLOCK_TYPE_MASK) != HUFFMAN_BLOCK_HUFFMAN || (*p & HUFFMAN_BLOCK_FLAG_4_STREAMS)) {
+        return -1;
+    }
+    p++;
+    read_varint(&p, end); // Characters
+    unsigned long long bits = read_varint(&p, end);
+    return (int)((8 - bits % 8) % 8);
+}
+
+// Everything written to file, which must hold expected[0..size)
+static int file_holds(FILE* file, const unsigned char* expected, size_t size) {
+    if (fflush(file) != 0 || fseek(file, 0, SEEK_END) != 0 || ftell(file) != (long)size) {
+        return 0;
+    }
+    rewind(file);
+    unsigned char buffer[4096];
+    size_t offset = 0;
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        if (memcmp(buffer, expected + offset, n) != 0) {
+            return 0;
+        }
+        offset += n;
+    }
+    return offset == size;
+}
+
+// Empties a scratch file for the next decode
+static FILE* reset_file(FILE* file) {
+    fclose(file);
+    FILE* fresh = tmpfile();
+    if (fresh == NULL) {
+        perror("tmpfile");
+        exit(EXIT_FAILURE);
+    }
+    return fresh;
+}
+
+// Decodes stream[0..stream_size) with huffman_decompress_stream; returns its status
+static HuffmanStatus decode_as_stream(HuffmanContext* ctx, const unsigned char* stream, size_t stream_size,
+                                      FILE** input, FILE** output) {
+    *input = reset_file(*input);
+    *output = reset_file(*output);
+    if (fwrite(stream, 1, stream_size, *input) != stream_size || fflush(*input) != 0) {
+        perror("Writing the test stream");
+        exit(EXIT_FAILURE);
+    }
+    rewind(*input);
+    unsigned long long size;
+    return huffman_decompress_stream(ctx, *input, *output, &size);
+}
+
+// One input through one configuration, decoded every way
+static void check_roundtrip(HuffmanContext* ctx, const TestConfig* config, const unsigned char* data, size_t size,
+                            unsigned char* stream, size_t stream_capacity, unsigned char* decoded,
+                            FILE** input, FILE** output, int padding_seen[8], int* four_stream_blocks) {
+    size_t stream_size;
+    if (huffman_compress(ctx, data, size, stream, stream_capacity, &stream_size) != HUFFMAN_OK) {
+        fail(config, size, "huffman_compress");
+        return;
+    }
+    int padding = first_block_padding(stream, stream_size);
+    if (padding >= 0) {
+        padding_seen[padding] = 1;
+    }
+    const unsigned char* first_block = stream + HUFFMAN_STREAM_HEADER_SIZE;
+    if (stream_size > HUFFMAN_STREAM_HEADER_SIZE && (*first_block & HUFFMAN_BLOCK_FLAG_4_STREAMS)) {
+        (*four_stream_blocks)++;
+    }
+
+    size_t decoded_size;
+    if (huffman_decompress(ctx, stream, stream_size, decoded, size, &decoded_size) != HUFFMAN_OK
+        || decoded_size != size || memcmp(decoded, data, size) != 0) {
+        fail(config, size, "huffman_decompress");
+    }
+    if (decode_as_stream(ctx, stream, stream_size, input, output) != HUFFMAN_OK || !file_holds(*output, data, size)) {
+        fail(config, size, "huffman_decompress_stream");
+    }
+
+    unsigned long long range_size;
+    *output = reset_file(*output);
+    if (huffman_decompress_range(ctx, stream, stream_size, 0, ULLONG_MAX, *output, &range_size) != HUFFMAN_OK
+        || range_size != size || !file_holds(*output, data, size)) {
+        fail(config, size, "huffman_decompress_range (whole stream)");
+    }
+    // A range that starts and ends inside blocks
+    size_t start = size / 3;
+    size_t length = size / 3;
+    *output = reset_file(*output);
+    if (huffman_decompress_range(ctx, stream, stream_size, start, length, *output, &range_size) != HUFFMAN_OK
+        || range_size != length || !file_holds(*output, data + start, length)) {
+        fail(config, size, "huffman_decompress_range (middle)");
+    }
+}
+
+// Every truncation of the trailer, and every byte of it changed, must be rejected by the
+// stream decoder (which checks the index against what it decoded) and by the indexed decoder
+static void check_damaged_trailer(HuffmanContext* ctx, const TestConfig* config, const unsigned char* data, size_t size,
+                                  unsigned char* stream, size_t stream_capacity, FILE** input, FILE** output) {
+    size_t stream_size;
+    if (huffman_compress(ctx, data, size, stream, stream_capacity, &stream_size) != HUFFMAN_OK) {
+        fail(config, size, "huffman_compress");
+        return;
+    }
+    // The END byte is right before the index, whose offset the footer holds
+    const unsigned char* footer = stream + stream_size - HUFFMAN_FOOTER_SIZE;
+    unsigned long long index_offset = 0;
+    for (int i = 7; i >= 0; i--) {
+        index_offset = (index_offset << 8) | footer[i];
+    }
+    size_t trailer_start = (size_t)index_offset - 1;
+    unsigned long long range_size;
+    char what[96];
+
+    for (size_t cut = trailer_start; cut < stream_size; cut++) {
+        if (decode_as_stream(ctx, stream, cut, input, output) == HUFFMAN_OK) {
+            snprintf(what, sizeof(what), "stream truncated to %zu of %zu bytes decoded", cut, stream_size);
+            fail(config, size, what);
+        }
+        *output = reset_file(*output);
+        if (huffman_decompress_range(ctx, stream, cut, 0, ULLONG_MAX, *output, &range_size) == HUFFMAN_OK) {
+            snprintf(what, sizeof(what), "stream truncated to %zu of %zu bytes range-decoded", cut, stream_size);
+            fail(config, size, what);
+        }
+    }
+    for (size_t at = trailer_start; at < stream_size; at++) {
+        stream[at] ^= 0x01;
+        if (decode_as_stream(ctx, stream, stream_size, input, output) == HUFFMAN_OK) {
+            snprintf(what, sizeof(what), "trailer byte %zu changed, stream decoded", at - trailer_start);
+            fail(config, size, what);
+        }
+        *output = reset_file(*output);
+        if (huffman_decompress_range(ctx, stream, stream_size, 0, ULLONG_MAX, *output, &range_size) == HUFFMAN_OK) {
+            snprintf(what, sizeof(what), "trailer byte %zu changed, range decoded", at - trailer_start);
+            fail(config, size, what);
+        }
+        stream[at] ^= 0x01;
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t max_size = argc > 1 ? (size_t)strtoul(argv[1], NULL, 10) : 300;
+    size_t largest = max_size;
+    for (size_t i = 0; i < sizeof(large_sizes) / sizeof(large_sizes[0]); i++) {
+        if (large_sizes[i] > largest) {
+            largest = large_sizes[i];
+        }
+    }
+    unsigned char* data = (unsigned char*)malloc(largest);
+    unsigned char* decoded = (unsigned char*)malloc(largest);
+    FILE* input = tmpfile();
+    FILE* output = tmpfile();
+    if (data == NULL || decoded == NULL || input == NULL || output == NULL) {
+        perror("Failed to set up the test");
+        return 1;
+    }
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        const TestConfig* config = &configs[c];
+        HuffmanOptions options;
+        huffman_default_options(&options);
+        options.max_code_length = config->max_code_length;
+        options.four_streams = config->four_streams;
+        options.single_table = config->single_table;
+        options.block_size = config->single_table ? 0 : TEST_BLOCK_SIZE;
+        options.thread_count = 2;
+        HuffmanContext* ctx = huffman_create_context(&options);
+        if (ctx == NULL) {
+            fail(config, 0, "huffman_create_context");
+            continue;
+        }
+        size_t stream_capacity = huffman_compress_bound(ctx, largest);
+        unsigned char* stream = (unsigned char*)malloc(stream_capacity);
+        if (stream == NULL) {
+            perror("Failed to allocate stream buffer");
+            return 1;
+        }
+
+        int before = failures;
+        int padding_seen[8] = {0};
+        int four_stream_blocks = 0;
+        for (size_t size = 0; size <= max_size + sizeof(large_sizes) / sizeof(large_sizes[0]); size++) {
+            size_t n = size <= max_size ? size : large_sizes[size - max_size - 1];
+            fill_skewed(data, n, 0x9E3779B97F4A7C15ull + n);
+            check_roundtrip(ctx, config, data, n, stream, stream_capacity, decoded, &input, &output,
+                            padding_seen, &four_stream_blocks);
+        }
+        for (int padding = 0; padding < 8; padding++) {
+            if (!padding_seen[padding]) {
+                char what[64];
+                snprintf(what, sizeof(what), "no block ended with %d padding bits", padding);
+                fail(config, max_size, what);
+            }
+        }
+        if (config->four_streams && four_stream_blocks == 0) {
+            fail(config, max_size, "no block was written as 4 streams");
+        }
+        fill_skewed(data, 9000, 7);
+        check_damaged_trailer(ctx, config, data, 9000, stream, stream_capacity, &input, &output);
+
+        printf("%-6s %s\n", config->name, failures == before ? "ok" : "FAILED");
+        free(stream);
+        huffman_free_context(ctx);
+    }
+
+    fclose(input);
+    fclose(output);
+    free(decoded);
+    free(data);
+    if (failures > 0) {
+        printf("%d checks failed\n", failures);
+        return 1;
+    }
+    printf("All round trips passed\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "thread_pool.h"
+#include <stdlib.h> // For malloc, free
+#include <unistd.h> // For sysconf
+
+// --- Per-worker deques ---
+
+static void init_deque(WorkDeque* deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->tasks = NULL;
+    deque->head = 0;
+    deque->count = 0;
+    deque->capacity = 0;
+}
+
+// Returns 0, or -1 if the deque is full and can't grow
+static int push_tail(WorkDeque* deque, ThreadPoolTask task) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        // Grow the ring buffer, unrolling it so the oldest task is at index 0 again
+        int new_capacity = deque->capacity > 0 ? deque->capacity * 2 : 16;
+        ThreadPoolTask* tasks = (ThreadPoolTask*)malloc(sizeof(ThreadPoolTask) * new_capacity);
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&deque->lock);
+            return -1;
+        }
+        for (int i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity = new_capacity;
+    }
+    deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+// The owner takes its oldest task, so tasks submitted in order also finish roughly in order
+static int pop_head(WorkDeque* deque, ThreadPoolTask* task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// Thieves take the newest task, from the other end than the owner
+static int steal_tail(WorkDeque* deque, ThreadPoolTask* task) {
+    int found = 0;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+        found = 1;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return found;
+}
+
+// --- Workers ---
+
+static void* worker_main(void* arg) {
+    ThreadPoolWorker* worker = (ThreadPoolWorker*)arg;
+    ThreadPool* pool = worker->pool;
+
+    for (;;) {
+        // Claim one pending task first. The claim guarantees that a task is waiting in some
+        // deque, so the search below always ends without sleeping or spinning on an empty pool.
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending == 0 && !pool->shutting_down) {
+            pthread_cond_wait(&pool->work_available, &pool->lock);
+        }
+        if (pool->pending == 0) { // Shutting down and nothing left to run
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pool->pending--;
+        pthread_mutex_unlock(&pool->lock);
+
+        ThreadPoolTask task;
+        int found = pop_head(&pool->deques[worker->index], &task);
+        for (int i = 1; !found; i++) {
+            found = steal_tail(&pool->deques[(worker->index + i) % pool->thread_count], &task);
+        }
+        task.function(task.arg);
+    }
+}
+
+// Stops and joins the first 'started' workers and frees the pool
+static void destroy_thread_pool(ThreadPool* pool, int started) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutting_down = 1;
+    pthread_cond_broadcast(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < pool->thread_count; i++) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].tasks);
+    }
+    pthread_cond_destroy(&pool->work_available);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
+
+ThreadPool* create_thread_pool(int thread_count) {
+    if (thread_count < 1) thread_count = 1;
+
+    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = (ThreadPoolWorker*)malloc(sizeof(ThreadPoolWorker) * thread_count);
+    pool->deques = (WorkDeque*)malloc(sizeof(WorkDeque) * thread_count);
+    if (pool->workers == NULL || pool->deques == NULL) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+    pool->thread_count = thread_count;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_available, NULL);
+    pool->pending = 0;
+    pool->shutting_down = 0;
+    pool->next_deque = 0;
+
+    for (int i = 0; i < thread_count; i++) {
+        init_deque(&pool->deques[i]);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+            destroy_thread_pool(pool, i);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void thread_pool_submit(ThreadPool* pool, ThreadPoolFunction function, void* arg) {
+    ThreadPoolTask task = {function, arg};
+
+    pthread_mutex_lock(&pool->lock);
+    int target = pool->next_deque;
+    pool->next_deque = (pool->next_deque + 1) % pool->thread_count;
+    pthread_mutex_unlock(&pool->lock);
+
+    // The task must be in a deque before it is counted as pending, see worker_main. Without
+    // memory to queue it, the caller runs it: the caller only waits for tasks without holding
+    // locks they need, so this is slower but never wrong.
+    if (push_tail(&pool->deques[target], task) != 0) {
+        function(arg);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_cond_signal(&pool->work_available);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void free_thread_pool(ThreadPool* pool) {
+    if (pool == NULL) return;
+    destroy_thread_pool(pool, pool->thread_count);
+}
+
+int online_cpu_count(void) {
+#ifdef _SC_NPROCESSORS_ONLN
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count > 0) {
+        return (int)count;
+    }
+#endif
+    return 1;
+}
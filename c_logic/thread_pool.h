@@ -0,0 +1,60 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+
+// A unit of work: function(arg) runs on one of the pool's threads
+typedef void (*ThreadPoolFunction)(void* arg);
+
+typedef struct ThreadPoolTask {
+    ThreadPoolFunction function;
+    void* arg;
+} ThreadPoolTask;
+
+// Double-ended queue of tasks belonging to one worker (ring buffer, grows as needed).
+// The owner takes tasks from the head; idle workers steal from the tail.
+typedef struct WorkDeque {
+    pthread_mutex_t lock;
+    ThreadPoolTask* tasks;
+    int head;       // Index of the oldest task
+    int count;
+    int capacity;
+} WorkDeque;
+
+typedef struct ThreadPool ThreadPool;
+
+typedef struct ThreadPoolWorker {
+    ThreadPool* pool;
+    int index;      // Which deque this worker owns
+    pthread_t thread;
+} ThreadPoolWorker;
+
+// Work-stealing pool: every worker has its own deque, so workers rarely contend for a lock,
+// and a worker that runs out of tasks steals from the others instead of sitting idle.
+struct ThreadPool {
+    int thread_count;
+    ThreadPoolWorker* workers;
+    WorkDeque* deques;
+
+    pthread_mutex_t lock;           // Protects the fields below
+    pthread_cond_t work_available;
+    int pending;                    // Tasks queued but not yet claimed by a worker
+    int shutting_down;
+    int next_deque;                 // Round-robin target for thread_pool_submit
+};
+
+// Starts thread_count worker threads (at least 1). Returns NULL if the memory or a thread
+// can't be had; the threads already started are stopped again.
+ThreadPool* create_thread_pool(int thread_count);
+
+// Queues function(arg). Tasks are spread over the workers' deques in round-robin order. If a
+// deque is full and can't grow, function(arg) runs on the calling thread instead.
+void thread_pool_submit(ThreadPool* pool, ThreadPoolFunction function, void* arg);
+
+// Runs every task still queued, then stops and joins the workers and frees the pool
+void free_thread_pool(ThreadPool* pool);
+
+// Number of online CPUs, or 1 if it can't be determined
+int online_cpu_count(void);
+
+#endif // THREAD_POOL_H